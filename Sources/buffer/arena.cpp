@@ -0,0 +1,76 @@
+#include "buffer/arena.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace white
+{
+
+std::string_view Arena::Copy(std::string_view str)
+{
+    char *begin = Allocate(str.size());
+    memcpy(begin, str.data(), str.size());
+    return std::string_view(begin, str.size());
+}
+
+std::string_view Arena::Join(std::initializer_list<std::string_view> pieces)
+{
+    std::size_t len = 0;
+    for(auto piece : pieces)
+        len += piece.size();
+    char *begin = Allocate(len + 1);
+    char *end = begin;
+    for(auto piece : pieces)
+    {
+        memcpy(end, piece.data(), piece.size());
+        end += piece.size();
+    }
+    *end = '\0';
+    return std::string_view(begin, len);
+}
+
+void Arena::Shrink()
+{
+    if(head_)
+    {
+        while(head_->next)
+        {
+            Block *block = head_->next;
+            head_->next = block->next;
+            ::operator delete(block);
+        }
+    }
+    Reset();
+}
+
+std::size_t Arena::Capacity() const
+{
+    std::size_t capacity = 0;
+    for(Block *block = head_; block; block = block->next)
+        capacity += block->size;
+    return capacity;
+}
+
+void Arena::NextBlock(std::size_t len)
+{
+    Block *prev = current_;
+    Block *next = current_ ? current_->next : head_;
+    if(!next || next->size < len)
+    {
+        // inserted before the free blocks too small for it, which are taken by the next allocations
+        std::size_t size = std::max(len, block_size_);
+        Block *block = static_cast<Block*>(::operator new(sizeof(Block) + size));
+        block->size = size;
+        block->next = next;
+        if(prev)
+            prev->next = block;
+        else
+            head_ = block;
+        next = block;
+    }
+    current_ = next;
+    used_ = 0;
+}
+
+} // namespace white
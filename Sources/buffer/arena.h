@@ -0,0 +1,117 @@
+#ifndef WHITEWEBSERVER_BUFFER_ARENA_H_
+#define WHITEWEBSERVER_BUFFER_ARENA_H_
+
+#include <cstddef>
+#include <initializer_list>
+#include <string_view>
+
+namespace white
+{
+
+/**
+ * @brief Bump pointer memory for the strings of a request and its response, such as the paths and the error
+ * pages. Nothing is freed alone, Reset() rewinds to the first block once the responses are written, and the
+ * blocks are kept for the next ones, so a connection in the steady state never allocates.
+ */
+class Arena
+{
+public:
+    /**
+     * @brief Construct a new Arena object, no block is allocated before the first Allocate().
+     *
+     * @param block_size of each block, a larger allocation gets a block of its own size
+     */
+    explicit Arena(std::size_t block_size = kDefaultBlockSize);
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena &operator=(const Arena&) = delete;
+
+    char *Allocate(std::size_t len);
+
+    std::string_view Copy(std::string_view str);
+
+    /**
+     * @brief Concatenate the pieces, followed by '\0' beyond the view so it can be given to the system calls.
+     *
+     * @param pieces
+     * @return std::string_view
+     */
+    std::string_view Join(std::initializer_list<std::string_view> pieces);
+
+    /**
+     * @brief Everything allocated is released, the blocks are kept.
+     *
+     */
+    void Reset();
+
+    /**
+     * @brief Reset and free the blocks but the first one, after a request far larger than the common ones.
+     *
+     */
+    void Shrink();
+
+    std::size_t Capacity() const;
+
+public:
+    static constexpr std::size_t kDefaultBlockSize = 4096;
+
+private:
+    struct Block
+    {
+        Block *next;
+        std::size_t size;
+
+        char *Data();
+    };
+
+private:
+    /**
+     * @brief Continue in the next block, the first one after the current large enough for len, allocated if none.
+     *
+     * @param len
+     */
+    void NextBlock(std::size_t len);
+
+private:
+    std::size_t block_size_;
+    Block *head_;
+    Block *current_; // allocated from, the blocks after it are free
+    std::size_t used_; // bytes of the current block
+};
+
+inline Arena::Arena(std::size_t block_size) : block_size_(block_size), head_(nullptr), current_(nullptr), used_(0)
+{
+
+}
+
+inline Arena::~Arena()
+{
+    Shrink();
+    if(head_)
+        ::operator delete(head_);
+}
+
+inline char *Arena::Allocate(std::size_t len)
+{
+    if(!current_ || used_ + len > current_->size)
+        NextBlock(len);
+    char *begin = current_->Data() + used_;
+    used_ += len;
+    return begin;
+}
+
+inline void Arena::Reset()
+{
+    current_ = head_;
+    used_ = 0;
+}
+
+inline char *Arena::Block::Data()
+{
+    return reinterpret_cast<char*>(this + 1);
+}
+
+} // namespace white
+
+#endif
@@ -125,10 +125,10 @@ inline void Buffer::RetrieveUntil(const char* end)
     Retrieve(end - ReadBeginConst());
 }
 
-// Always guarantee that it is safe to get the element immediately before the beginning.
+// Always guarantee that it is safe to get the element immediately before the beginning, only what is written is read.
 inline void Buffer::Clear()
 {
-    bzero(buffer_container_.data(), buffer_container_.size());
+    buffer_container_[0] = '\0';
     write_idx_ = read_idx_ = 1;
 }
 
@@ -192,7 +192,6 @@ inline void Buffer::MakeSpace(std::size_t len)
         std::copy(buffer_container_.data() + read_idx_ - 1, buffer_container_.data() + write_idx_, buffer_container_.data());
         write_idx_ = 1 + ReadableBytes();
         read_idx_ = 1;
-        bzero(buffer_container_.data() + write_idx_, WritableBytes());
     }
 }
 
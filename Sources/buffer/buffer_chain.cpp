@@ -0,0 +1,214 @@
+#include "buffer/buffer_chain.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+namespace white
+{
+
+ChunkPool::ChunkPool() : free_(nullptr), free_count_(0)
+{
+
+}
+
+ChunkPool::~ChunkPool()
+{
+    while(free_)
+    {
+        Chunk *chunk = free_;
+        free_ = chunk->next;
+        delete chunk;
+    }
+}
+
+// the bytes of a chunk are never zeroed, only what is written into it is read
+ChunkPool::Chunk *ChunkPool::Acquire()
+{
+    Chunk *chunk = free_;
+    if(chunk)
+    {
+        free_ = chunk->next;
+        --free_count_;
+    }else
+        chunk = new Chunk;
+    chunk->next = nullptr;
+    chunk->begin = chunk->end = 0;
+    return chunk;
+}
+
+void ChunkPool::Release(Chunk *chunk)
+{
+    if(free_count_ >= kMaxFree)
+    {
+        delete chunk;
+        return;
+    }
+    chunk->next = free_;
+    free_ = chunk;
+    ++free_count_;
+}
+
+BufferChain::BufferChain() : head_(nullptr), tail_(nullptr), readable_(0)
+{
+
+}
+
+BufferChain::~BufferChain()
+{
+    Clear();
+}
+
+void BufferChain::Append(const char *begin, std::size_t len)
+{
+    if(!begin)
+        return;
+    readable_ += len;
+    while(len > 0)
+    {
+        if(!tail_ || tail_->end == ChunkPool::kCapacity)
+            Push(ChunkPool::Local().Acquire());
+        std::size_t n = std::min(len, ChunkPool::kCapacity - tail_->end);
+        memcpy(tail_->data + tail_->end, begin, n);
+        tail_->end += n;
+        begin += n;
+        len -= n;
+    }
+}
+
+void BufferChain::Append(BufferChain &chain, std::size_t len)
+{
+    len = std::min(len, chain.readable_);
+    while(len > 0)
+    {
+        ChunkPool::Chunk *chunk = chain.head_;
+        std::size_t n = chunk->end - chunk->begin;
+        if(n > len)
+        {
+            Append(chunk->data + chunk->begin, len);
+            chain.Retrieve(len);
+            return;
+        }
+        chain.Pop();
+        chain.readable_ -= n;
+        Push(chunk);
+        readable_ += n;
+        len -= n;
+    }
+}
+
+void BufferChain::Retrieve(std::size_t len)
+{
+    len = std::min(len, readable_);
+    readable_ -= len;
+    while(len > 0)
+    {
+        std::size_t n = head_->end - head_->begin;
+        if(n > len)
+        {
+            head_->begin += len;
+            return;
+        }
+        len -= n;
+        ChunkPool::Local().Release(Pop());
+    }
+}
+
+int BufferChain::Iovecs(iovec *iov, int max_iov, std::size_t offset, std::size_t len, std::size_t *covered) const
+{
+    int count = 0;
+    *covered = 0;
+    for(ChunkPool::Chunk *chunk = head_; chunk && len > 0 && count < max_iov; chunk = chunk->next)
+    {
+        std::size_t n = chunk->end - chunk->begin;
+        if(offset >= n)
+        {
+            offset -= n;
+            continue;
+        }
+        n = std::min(n - offset, len);
+        iov[count].iov_base = chunk->data + chunk->begin + offset;
+        iov[count++].iov_len = n;
+        offset = 0;
+        len -= n;
+        *covered += n;
+    }
+    return count;
+}
+
+std::string_view BufferChain::Peek(std::size_t len, std::string *scratch) const
+{
+    len = std::min(len, readable_);
+    if(len == 0)
+        return {};
+    if(head_->end - head_->begin >= len)
+        return std::string_view(head_->data + head_->begin, len);
+    scratch->resize(len);
+    Copy(0, len, &(*scratch)[0]);
+    return *scratch;
+}
+
+void BufferChain::Copy(std::size_t offset, std::size_t len, char *dest) const
+{
+    for(ChunkPool::Chunk *chunk = head_; chunk && len > 0; chunk = chunk->next)
+    {
+        std::size_t n = chunk->end - chunk->begin;
+        if(offset >= n)
+        {
+            offset -= n;
+            continue;
+        }
+        n = std::min(n - offset, len);
+        memcpy(dest, chunk->data + chunk->begin + offset, n);
+        offset = 0;
+        dest += n;
+        len -= n;
+    }
+}
+
+// as much as the 64KB the contiguous buffer reads beyond its space, the chunks not filled go back at once
+ssize_t BufferChain::ReadFromFd(int fd, int *err)
+{
+    static constexpr int kSpares = 4;
+    ChunkPool &pool = ChunkPool::Local();
+    ChunkPool::Chunk *spares[kSpares];
+    iovec iov[kSpares + 1];
+    int iov_cnt = 0;
+    std::size_t tail_free = tail_ ? ChunkPool::kCapacity - tail_->end : 0;
+    if(tail_free > 0)
+    {
+        iov[iov_cnt].iov_base = tail_->data + tail_->end;
+        iov[iov_cnt++].iov_len = tail_free;
+    }
+    for(int i = 0; i < kSpares; ++i)
+    {
+        spares[i] = pool.Acquire();
+        iov[iov_cnt].iov_base = spares[i]->data;
+        iov[iov_cnt++].iov_len = ChunkPool::kCapacity;
+    }
+
+    ssize_t len = readv(fd, iov, iov_cnt);
+    if(len < 0)
+        *err = errno;
+    std::size_t rest = len > 0 ? len : 0;
+    readable_ += rest;
+    std::size_t n = std::min(rest, tail_free);
+    if(n > 0)
+        tail_->end += n;
+    rest -= n;
+    for(int i = 0; i < kSpares; ++i)
+    {
+        if(rest == 0)
+        {
+            pool.Release(spares[i]);
+            continue;
+        }
+        n = std::min(rest, ChunkPool::kCapacity);
+        spares[i]->end = n;
+        Push(spares[i]);
+        rest -= n;
+    }
+    return len;
+}
+
+} // namespace white
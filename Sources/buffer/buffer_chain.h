@@ -0,0 +1,173 @@
+#ifndef WHITEWEBSERVER_BUFFER_BUFFER_CHAIN_H_
+#define WHITEWEBSERVER_BUFFER_BUFFER_CHAIN_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace white
+{
+
+/**
+ * @brief Fixed size chunks kept by each thread for its buffer chains. A chunk released by another thread than the
+ * one which acquired it joins the pool of the releasing thread, each pool keeps up to kMaxFree chunks.
+ */
+class ChunkPool
+{
+public:
+    struct Chunk
+    {
+        Chunk *next;
+        uint32_t begin; // the readable bytes are [begin, end) of data
+        uint32_t end;
+        char data[16 * 1024 - 16];
+    };
+
+    static constexpr std::size_t kCapacity = sizeof(Chunk::data);
+    static constexpr std::size_t kMaxFree = 64;
+
+public:
+    ~ChunkPool();
+
+    static ChunkPool &Local();
+
+    Chunk *Acquire();
+    void Release(Chunk *chunk);
+
+private:
+    ChunkPool();
+
+private:
+    Chunk *free_;
+    std::size_t free_count_;
+};
+
+static_assert(sizeof(ChunkPool::Chunk) == 16 * 1024, "a chunk is 16KB");
+
+/**
+ * @brief A buffer made of chunks from the pool of the thread. Appending never moves the bytes already in it, the
+ * readable bytes are written by writev straight from the chunks, and every chunk goes back to the pool as soon as
+ * it is read through.
+ */
+class BufferChain
+{
+public:
+    BufferChain();
+    ~BufferChain();
+
+    BufferChain(const BufferChain&) = delete;
+    BufferChain &operator=(const BufferChain&) = delete;
+
+    std::size_t ReadableBytes() const;
+
+    void Append(std::string_view str);
+    void Append(const char *begin, std::size_t len);
+
+    /**
+     * @brief Move the first len bytes of another chain to the end of this one, the chunks read through are
+     * handed over, only the bytes of a chunk left partly read are copied.
+     *
+     * @param chain
+     * @param len
+     */
+    void Append(BufferChain &chain, std::size_t len);
+
+    /**
+     * @brief retrieve content of size len, giving back the chunks read through
+     *
+     * @param len
+     */
+    void Retrieve(std::size_t len);
+    void Clear();
+
+    /**
+     * @brief Fill iov with the pieces of len readable bytes from offset.
+     *
+     * @param iov
+     * @param max_iov
+     * @param offset
+     * @param len
+     * @param covered the bytes of len in the pieces, less than len if max_iov was not enough
+     * @return int the pieces filled
+     */
+    int Iovecs(iovec *iov, int max_iov, std::size_t offset, std::size_t len, std::size_t *covered) const;
+
+    /**
+     * @brief The first len readable bytes, in place if they lie in one chunk, or copied into scratch.
+     *
+     * @param len
+     * @param scratch
+     * @return std::string_view
+     */
+    std::string_view Peek(std::size_t len, std::string *scratch) const;
+
+    /**
+     * @brief Copy len readable bytes from offset.
+     *
+     * @param offset
+     * @param len
+     * @param dest
+     */
+    void Copy(std::size_t offset, std::size_t len, char *dest) const;
+
+    // provide read of single time, into the free space of the last chunk and a new one.
+    ssize_t ReadFromFd(int fd, int *err);
+
+private:
+    void Push(ChunkPool::Chunk *chunk);
+    ChunkPool::Chunk *Pop();
+
+private:
+    ChunkPool::Chunk *head_;
+    ChunkPool::Chunk *tail_;
+    std::size_t readable_;
+};
+
+inline ChunkPool &ChunkPool::Local()
+{
+    thread_local ChunkPool pool;
+    return pool;
+}
+
+inline std::size_t BufferChain::ReadableBytes() const
+{
+    return readable_;
+}
+
+inline void BufferChain::Append(std::string_view str)
+{
+    Append(str.data(), str.size());
+}
+
+inline void BufferChain::Clear()
+{
+    while(head_)
+        ChunkPool::Local().Release(Pop());
+    readable_ = 0;
+}
+
+inline void BufferChain::Push(ChunkPool::Chunk *chunk)
+{
+    chunk->next = nullptr;
+    if(tail_)
+        tail_->next = chunk;
+    else
+        head_ = chunk;
+    tail_ = chunk;
+}
+
+inline ChunkPool::Chunk *BufferChain::Pop()
+{
+    ChunkPool::Chunk *chunk = head_;
+    head_ = chunk->next;
+    if(!head_)
+        tail_ = nullptr;
+    return chunk;
+}
+
+} // namespace white
+
+#endif
@@ -0,0 +1,175 @@
+#include "cache/hot_object_cache.h"
+#include "logger/logger.h"
+
+#include <algorithm>
+
+namespace white {
+
+HotObjectCache::FrequencySketch::FrequencySketch(std::size_t width) :
+additions_(0)
+{
+    std::size_t real_width = 1;
+    while(real_width < width)
+        real_width <<= 1;
+    mask_ = real_width - 1;
+    sample_size_ = real_width * 10;
+    table_.resize(real_width * kDepth);
+}
+
+void HotObjectCache::FrequencySketch::Increment(std::size_t hash)
+{
+    bool is_added = false;
+    for(int row = 0; row < kDepth; ++row)
+    {
+        uint8_t &counter = table_[Index(hash, row)];
+        if(counter < kMaxCount)
+        {
+            ++counter;
+            is_added = true;
+        }
+    }
+    if(is_added && ++additions_ >= sample_size_)
+        Reset();
+}
+
+int HotObjectCache::FrequencySketch::Estimate(std::size_t hash) const
+{
+    int frequency = kMaxCount;
+    for(int row = 0; row < kDepth; ++row)
+        frequency = std::min<int>(frequency, table_[Index(hash, row)]);
+    return frequency;
+}
+
+// age all the counters, so the objects which were popular long ago fade out
+void HotObjectCache::FrequencySketch::Reset()
+{
+    for(auto &counter : table_)
+        counter >>= 1;
+    additions_ /= 2;
+}
+
+HotObjectCache::HotObjectCache(std::size_t memory_budget, std::size_t max_object_size, int revalidate_interval) :
+shard_budget_(memory_budget / kShardNum),
+max_object_size_(max_object_size),
+revalidate_interval_(revalidate_interval),
+hits_(0),
+misses_(0),
+admissions_(0),
+rejections_(0),
+evictions_(0),
+bytes_(0)
+{
+    shards_.reserve(kShardNum);
+    for(std::size_t i = 0; i < kShardNum; ++i)
+        shards_.emplace_back(new Shard(kSketchWidth));
+}
+
+HotObjectCache::~HotObjectCache()
+{
+
+}
+
+HotObjectCache::Object HotObjectCache::Get(std::string_view key)
+{
+    std::size_t hash = std::hash<std::string_view>{}(key);
+    Shard &shard = GetShard(hash);
+    Object object;
+    {
+        std::lock_guard<std::mutex> locker(shard.mutex);
+        shard.sketch.Increment(hash);
+        auto it = shard.map.find(key);
+        if(it != shard.map.end())
+        {
+            auto node = it->second;
+            if(Clock::now() - node->created < revalidate_interval_)
+            {
+                shard.lru.splice(shard.lru.begin(), shard.lru, node);
+                object = node->object;
+            }else
+                Erase(shard, node); // rendered again from the file
+        }
+    }
+    uint64_t lookups;
+    if(object)
+        lookups = ++hits_ + misses_.load(std::memory_order_relaxed);
+    else
+        lookups = ++misses_ + hits_.load(std::memory_order_relaxed);
+    if(lookups % kStatsLogInterval == 0)
+        LogStats();
+    return object;
+}
+
+bool HotObjectCache::Admit(std::string_view key, std::size_t size)
+{
+    if(size > max_object_size_ || size > shard_budget_)
+        return false;
+    std::size_t hash = std::hash<std::string_view>{}(key);
+    Shard &shard = GetShard(hash);
+    std::lock_guard<std::mutex> locker(shard.mutex);
+    return CanAdmit(shard, hash, size);
+}
+
+bool HotObjectCache::Put(std::string_view key, Object object)
+{
+    std::size_t size = object->size();
+    if(size > max_object_size_ || size > shard_budget_)
+        return false;
+    std::size_t hash = std::hash<std::string_view>{}(key);
+    Shard &shard = GetShard(hash);
+    std::lock_guard<std::mutex> locker(shard.mutex);
+    auto it = shard.map.find(key);
+    if(it != shard.map.end())
+        Erase(shard, it->second);
+    if(!CanAdmit(shard, hash, size))
+    {
+        ++rejections_;
+        return false;
+    }
+    while(shard.bytes + size > shard_budget_)
+    {
+        Erase(shard, std::prev(shard.lru.end()));
+        ++evictions_;
+    }
+    shard.lru.push_front({std::string(key), std::move(object), Clock::now()});
+    shard.map.emplace(shard.lru.front().key, shard.lru.begin());
+    shard.bytes += size;
+    bytes_ += size;
+    ++admissions_;
+    return true;
+}
+
+// the candidate has to be more frequent than every victim making room for it
+bool HotObjectCache::CanAdmit(Shard &shard, std::size_t hash, std::size_t size) const
+{
+    int frequency = shard.sketch.Estimate(hash);
+    std::size_t freed = 0;
+    for(auto victim = shard.lru.rbegin(); shard.bytes - freed + size > shard_budget_ && victim != shard.lru.rend(); ++victim)
+    {
+        if(shard.sketch.Estimate(std::hash<std::string_view>{}(victim->key)) >= frequency)
+            return false;
+        freed += victim->object->size();
+    }
+    return true;
+}
+
+void HotObjectCache::Erase(Shard &shard, std::list<Node>::iterator node)
+{
+    shard.bytes -= node->object->size();
+    bytes_ -= node->object->size();
+    shard.map.erase(node->key);
+    shard.lru.erase(node);
+}
+
+HotObjectCache::Stats HotObjectCache::GetStats() const
+{
+    return {hits_.load(), misses_.load(), admissions_.load(), rejections_.load(), evictions_.load(), bytes_.load()};
+}
+
+void HotObjectCache::LogStats() const
+{
+    auto stats = GetStats();
+    LOG_INFO("[hot object cache] hits: ", stats.hits, " misses: ", stats.misses, " admissions: ", stats.admissions,
+             " rejections: ", stats.rejections, " evictions: ", stats.evictions, " bytes: ", stats.bytes);
+}
+
+} // namespace white
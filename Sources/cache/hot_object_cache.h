@@ -0,0 +1,172 @@
+#ifndef WHITEWEBSERVER_CACHE_HOT_OBJECT_CACHE_H_
+#define WHITEWEBSERVER_CACHE_HOT_OBJECT_CACHE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace white {
+
+/**
+ * @brief Cache of small, fully rendered responses (status line, headers and body), so a hit is written
+ * by a single writev from shared immutable memory.
+ *
+ * Entries are spread over shards, each with its own lock, LRU list and share of the memory budget.
+ * A new object is only admitted if it is requested more often than the objects it would evict,
+ * the frequencies are estimated by a count-min sketch which is halved periodically (TinyLFU).
+ */
+class HotObjectCache
+{
+    using Clock = std::chrono::steady_clock;
+    using TimeStamp = std::chrono::steady_clock::time_point;
+
+public:
+    using Object = std::shared_ptr<const std::string>;
+
+    struct Stats
+    {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t admissions;
+        uint64_t rejections;
+        uint64_t evictions;
+        std::size_t bytes;
+    };
+
+public:
+    /**
+     * @brief Construct a new Hot Object Cache object
+     *
+     * @param memory_budget max bytes of all the objects.
+     * @param max_object_size objects larger than it are never cached.
+     * @param revalidate_interval milliseconds before an object is dropped and rendered again.
+     */
+    HotObjectCache(std::size_t memory_budget, std::size_t max_object_size, int revalidate_interval);
+    ~HotObjectCache();
+
+    /**
+     * @brief Get the object and record the access, return nullptr if missing or expired.
+     *
+     * @param key
+     * @return Object
+     */
+    Object Get(std::string_view key);
+
+    /**
+     * @brief Return true if an object of the size would be admitted now, to avoid rendering one for nothing.
+     *
+     * @param key
+     * @param size
+     * @return true
+     * @return false
+     */
+    bool Admit(std::string_view key, std::size_t size);
+
+    /**
+     * @brief Put the object into cache if admitted.
+     *
+     * @param key
+     * @param object
+     * @return true if admitted.
+     * @return false
+     */
+    bool Put(std::string_view key, Object object);
+
+    std::size_t MaxObjectSize() const;
+
+    Stats GetStats() const;
+
+private:
+    class FrequencySketch
+    {
+    public:
+        FrequencySketch(std::size_t width);
+
+        void Increment(std::size_t hash);
+        int Estimate(std::size_t hash) const;
+
+    private:
+        static constexpr int kDepth = 4;
+        static constexpr uint8_t kMaxCount = 15;
+
+    private:
+        std::size_t Index(std::size_t hash, int row) const;
+        void Reset();
+
+    private:
+        std::size_t mask_;
+        std::size_t additions_;
+        std::size_t sample_size_;
+        std::vector<uint8_t> table_;
+    };
+
+    struct Node
+    {
+        std::string key;
+        Object object;
+        TimeStamp created;
+    };
+
+    struct Shard
+    {
+        Shard(std::size_t sketch_width) : sketch(sketch_width), bytes(0) {}
+
+        std::mutex mutex;
+        FrequencySketch sketch;
+        std::list<Node> lru; // most recently used at front
+        std::unordered_map<std::string_view, std::list<Node>::iterator> map; // keyed by the key in the node
+        std::size_t bytes;
+    };
+
+private:
+    static constexpr std::size_t kShardNum = 16;
+    static constexpr std::size_t kSketchWidth = 4096;
+    static constexpr uint64_t kStatsLogInterval = 1 << 16; // lookups between two stats logs
+
+private:
+    Shard &GetShard(std::size_t hash);
+    bool CanAdmit(Shard &shard, std::size_t hash, std::size_t size) const;
+    void Erase(Shard &shard, std::list<Node>::iterator node);
+    void LogStats() const;
+
+private:
+    std::size_t shard_budget_;
+    std::size_t max_object_size_;
+    std::chrono::milliseconds revalidate_interval_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+    std::atomic<uint64_t> admissions_;
+    std::atomic<uint64_t> rejections_;
+    std::atomic<uint64_t> evictions_;
+    std::atomic<std::size_t> bytes_;
+};
+
+inline std::size_t HotObjectCache::MaxObjectSize() const
+{
+    return max_object_size_;
+}
+
+inline HotObjectCache::Shard &HotObjectCache::GetShard(std::size_t hash)
+{
+    return *shards_[hash % kShardNum];
+}
+
+inline std::size_t HotObjectCache::FrequencySketch::Index(std::size_t hash, int row) const
+{
+    // double hashing, the high half as the step
+    std::size_t step = (hash >> 32) | 1;
+    return row * (mask_ + 1) + ((hash + row * step) & mask_);
+}
+
+} // namespace white
+
+#endif
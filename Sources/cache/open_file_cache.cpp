@@ -0,0 +1,88 @@
+#include "cache/open_file_cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+
+namespace white {
+
+OpenFileCache::OpenFileCache(std::size_t capacity, int revalidate_interval, MimeResolver mime_resolver) :
+shard_capacity_((capacity + kShardNum - 1) / kShardNum),
+revalidate_interval_(revalidate_interval),
+mime_resolver_(std::move(mime_resolver)),
+shards_(kShardNum)
+{
+    if(shard_capacity_ == 0)
+        shard_capacity_ = 1;
+}
+
+OpenFileCache::~OpenFileCache()
+{
+
+}
+
+OpenFileCache::EntryPtr OpenFileCache::Get(std::string_view path)
+{
+    Shard &shard = shards_[std::hash<std::string_view>{}(path) % kShardNum];
+    EntryPtr stale_entry;
+    {
+        std::lock_guard<std::mutex> locker(shard.mutex);
+        auto it = shard.map.find(path);
+        if(it != shard.map.end())
+        {
+            auto node = it->second;
+            shard.lru.splice(shard.lru.begin(), shard.lru, node);
+            if(Clock::now() - node->validated < revalidate_interval_)
+                return node->entry;
+            stale_entry = node->entry;
+        }
+    }
+
+    // the file system is touched without holding the lock
+    std::string file_path(path);
+    EntryPtr entry;
+    if(stale_entry)
+    {
+        struct stat file_stat;
+        int error = stat(file_path.c_str(), &file_stat) < 0 ? errno : 0;
+        if(error == stale_entry->error && (error || IsSameFile(file_stat, stale_entry->file_stat)))
+            entry = stale_entry;
+    }
+    if(!entry)
+        entry = Open(file_path);
+
+    std::lock_guard<std::mutex> locker(shard.mutex);
+    auto it = shard.map.find(path);
+    if(it != shard.map.end())
+    {
+        it->second->entry = entry;
+        it->second->validated = Clock::now();
+        return entry;
+    }
+    shard.lru.push_front({std::move(file_path), entry, Clock::now()});
+    shard.map.emplace(shard.lru.front().path, shard.lru.begin());
+    if(shard.lru.size() > shard_capacity_)
+    {
+        shard.map.erase(shard.lru.back().path);
+        shard.lru.pop_back();
+    }
+    return entry;
+}
+
+OpenFileCache::EntryPtr OpenFileCache::Open(const std::string &path) const
+{
+    auto entry = std::make_shared<Entry>();
+    if(stat(path.c_str(), &entry->file_stat) < 0)
+    {
+        entry->error = errno;
+        return entry;
+    }
+    if(S_ISDIR(entry->file_stat.st_mode))
+        return entry;
+    entry->fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    entry->mime_type = mime_resolver_(path);
+    entry->header_block = "Content-type: " + entry->mime_type + "\r\n"
+                        + "Content-Length: " + std::to_string(entry->file_stat.st_size) + "\r\n";
+    return entry;
+}
+
+} // namespace white
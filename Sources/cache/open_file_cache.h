@@ -0,0 +1,115 @@
+#ifndef WHITEWEBSERVER_CACHE_OPEN_FILE_CACHE_H_
+#define WHITEWEBSERVER_CACHE_OPEN_FILE_CACHE_H_
+
+#include <chrono>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace white {
+
+/**
+ * @brief Cache of opened static files and their metadata, keyed by the resolved path.
+ *
+ * Entries are spread over shards, each with its own lock and LRU list, and are revalidated by stat()
+ * once they are older than the revalidation interval. A file is closed when it is evicted and the
+ * last response using it is finished.
+ */
+class OpenFileCache
+{
+    using Clock = std::chrono::steady_clock;
+    using TimeStamp = std::chrono::steady_clock::time_point;
+
+public:
+    using MimeResolver = std::function<std::string_view(std::string_view path)>;
+
+    struct Entry
+    {
+        Entry() = default;
+        Entry(const Entry &) = delete;
+        Entry &operator=(const Entry &) = delete;
+        ~Entry();
+
+        bool Exists() const { return error == 0; }
+
+        int fd = -1; // -1 for directories or files unable to open
+        int error = 0; // errno of stat()
+        struct stat file_stat{};
+        std::string mime_type;
+        std::string header_block; // "Content-type: ...\r\nContent-Length: ...\r\n"
+    };
+
+    using EntryPtr = std::shared_ptr<const Entry>;
+
+public:
+    /**
+     * @brief Construct a new Open File Cache object
+     *
+     * @param capacity max number of the entries.
+     * @param revalidate_interval milliseconds before an entry is checked again by stat().
+     * @param mime_resolver get the mime type from the path.
+     */
+    OpenFileCache(std::size_t capacity, int revalidate_interval, MimeResolver mime_resolver);
+    ~OpenFileCache();
+
+    /**
+     * @brief Get the entry of the path, open it if it is not cached. Never return nullptr, missing files are cached too.
+     * A hit allocates nothing, the path is copied only to touch the file system.
+     *
+     * @param path
+     * @return EntryPtr
+     */
+    EntryPtr Get(std::string_view path);
+
+private:
+    struct Node
+    {
+        std::string path;
+        EntryPtr entry;
+        TimeStamp validated;
+    };
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::list<Node> lru; // most recently used at front
+        std::unordered_map<std::string_view, std::list<Node>::iterator> map; // keyed by the path in the node
+    };
+
+private:
+    static constexpr std::size_t kShardNum = 16;
+
+private:
+    EntryPtr Open(const std::string &path) const;
+    static bool IsSameFile(const struct stat &lhs, const struct stat &rhs);
+
+private:
+    std::size_t shard_capacity_;
+    std::chrono::milliseconds revalidate_interval_;
+    MimeResolver mime_resolver_;
+    std::vector<Shard> shards_;
+};
+
+inline OpenFileCache::Entry::~Entry()
+{
+    if(fd >= 0)
+        close(fd);
+}
+
+inline bool OpenFileCache::IsSameFile(const struct stat &lhs, const struct stat &rhs)
+{
+    return lhs.st_ino == rhs.st_ino && lhs.st_dev == rhs.st_dev && lhs.st_size == rhs.st_size
+        && lhs.st_mtim.tv_sec == rhs.st_mtim.tv_sec && lhs.st_mtim.tv_nsec == rhs.st_mtim.tv_nsec
+        && lhs.st_mode == rhs.st_mode;
+}
+
+} // namespace white
+
+#endif
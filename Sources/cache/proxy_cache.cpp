@@ -0,0 +1,605 @@
+#include "cache/proxy_cache.h"
+#include "logger/logger.h"
+
+#include <algorithm>
+#include <charconv>
+#include <ctime>
+#include <fcntl.h>
+#include <filesystem>
+#include <strings.h>
+#include <unistd.h>
+
+namespace white {
+
+namespace {
+
+std::string_view Trim(std::string_view value)
+{
+    while(!value.empty() && (value.front() == ' ' || value.front() == '\t'))
+        value.remove_prefix(1);
+    while(!value.empty() && (value.back() == ' ' || value.back() == '\t'))
+        value.remove_suffix(1);
+    return value;
+}
+
+bool IsName(std::string_view lhs, std::string_view rhs)
+{
+    return lhs.size() == rhs.size() && strncasecmp(lhs.data(), rhs.data(), lhs.size()) == 0;
+}
+
+/**
+ * @brief Call on_directive(name, value) for every directive of a Cache-Control like list, such as "max-age=60, public".
+ */
+template<typename Callback>
+void ForEachDirective(std::string_view list, Callback on_directive)
+{
+    while(!list.empty())
+    {
+        auto comma = list.find(',');
+        std::string_view directive = Trim(list.substr(0, comma));
+        list.remove_prefix(comma == std::string_view::npos ? list.size() : comma + 1);
+        auto equal = directive.find('=');
+        std::string_view value;
+        if(equal != std::string_view::npos)
+        {
+            value = Trim(directive.substr(equal + 1));
+            if(value.size() >= 2 && value.front() == '"' && value.back() == '"')
+                value = value.substr(1, value.size() - 2);
+            directive = Trim(directive.substr(0, equal));
+        }
+        if(!directive.empty())
+            on_directive(directive, value);
+    }
+}
+
+bool HasDirective(std::string_view list, std::string_view name)
+{
+    bool has = false;
+    ForEachDirective(list, [&](std::string_view directive, std::string_view) { has = has || IsName(directive, name); });
+    return has;
+}
+
+int ToSeconds(std::string_view value)
+{
+    long long seconds = 0;
+    if(std::from_chars(value.data(), value.data() + value.size(), seconds).ec != std::errc() || seconds < 0)
+        return 0;
+    return static_cast<int>(std::min<long long>(seconds, INT32_MAX));
+}
+
+// "Sun, 06 Nov 1994 08:49:37 GMT", -1 if malformed
+time_t ParseHttpDate(std::string_view value)
+{
+    std::string date(value);
+    tm time{};
+    if(strptime(date.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &time) == nullptr)
+        return -1;
+    return timegm(&time);
+}
+
+// hop-by-hop, and Age which is added when served
+bool IsUnstoredHeader(std::string_view name)
+{
+    return IsName(name, "Connection") || IsName(name, "Keep-Alive") || IsName(name, "Proxy-Connection")
+           || IsName(name, "Transfer-Encoding") || IsName(name, "Age");
+}
+
+} // namespace
+
+ProxyCache::ProxyCache(const Config &config) :
+shard_memory_(config.memory / kShardNum),
+memory_max_object_(config.memory_max_object),
+max_object_(config.max_object),
+path_(config.path),
+shard_disk_(config.disk / kShardNum),
+stale_while_revalidate_(config.stale_while_revalidate),
+is_coalescing_(config.coalesce),
+file_seq_(0),
+is_stop_(false),
+hits_(0),
+stale_hits_(0),
+misses_(0),
+revalidated_(0),
+coalesced_(0),
+memory_bytes_(0),
+disk_bytes_(0)
+{
+    shards_.reserve(kShardNum);
+    for(std::size_t i = 0; i < kShardNum; ++i)
+        shards_.emplace_back(new Shard());
+
+    if(!path_.empty())
+    {
+        // the files are only known by this process, the ones left by the last run are useless
+        std::error_code error;
+        std::filesystem::create_directories(path_, error);
+        for(auto &file : std::filesystem::directory_iterator(path_, error))
+            if(file.path().extension() == ".cache")
+                std::filesystem::remove(file.path(), error);
+        if(error)
+        {
+            LOG_WARN("Proxy cache directory ", path_, " unavailable, cache in memory only: ", error.message());
+            path_.clear();
+        }
+    }
+    revalidator_ = std::thread(&ProxyCache::RevalidateLoop, this);
+}
+
+ProxyCache::~ProxyCache()
+{
+    {
+        std::lock_guard<std::mutex> locker(revalidate_mutex_);
+        is_stop_ = true;
+    }
+    revalidate_cv_.notify_all();
+    revalidator_.join();
+    for(auto &shard : shards_)
+        for(auto &item : shard->map)
+            if(!item.second->path.empty())
+                unlink(item.second->path.c_str());
+}
+
+void ProxyCache::SetFetcher(Fetcher fetcher)
+{
+    fetcher_ = std::move(fetcher);
+}
+
+bool ProxyCache::Lookup(std::string_view method, std::string_view host, std::string_view uri,
+                        const HeaderGetter &request_header, Hit *hit)
+{
+    std::string primary = PrimaryKey(method, host, uri);
+    Shard &shard = GetShard(primary);
+    bool is_hit = false;
+    bool is_revalidate = false;
+    Revalidation revalidation;
+    {
+        std::lock_guard<std::mutex> locker(shard.mutex);
+        auto vary = shard.vary.find(primary);
+        auto it = shard.map.find(vary == shard.vary.end() ? primary : VariantKey(primary, vary->second, request_header));
+        if(it != shard.map.end())
+        {
+            Entry *entry = it->second.get();
+            int age = entry->age + std::chrono::duration_cast<std::chrono::seconds>(Clock::now() - entry->stored).count();
+            bool is_fresh = age < entry->max_age;
+            if(!is_fresh && !(fetcher_ && age < entry->max_age + entry->stale_while_revalidate))
+                Erase(shard, entry); // expired
+            else if(entry->body || !entry->path.empty()) // neither while it is being written to disk
+            {
+                hit->head = entry->head;
+                hit->body_size = entry->body_size;
+                hit->age = age;
+                hit->is_stale = !is_fresh;
+                if(entry->body)
+                {
+                    hit->body = entry->body;
+                    shard.memory_lru.splice(shard.memory_lru.begin(), shard.memory_lru, entry->memory_node);
+                    is_hit = true;
+                }else if((hit->fd = open(entry->path.c_str(), O_RDONLY | O_CLOEXEC)) >= 0)
+                {
+                    shard.disk_lru.splice(shard.disk_lru.begin(), shard.disk_lru, entry->disk_node);
+                    is_hit = true;
+                }else
+                    Erase(shard, entry);
+                if(is_hit && !is_fresh && !entry->is_revalidating)
+                {
+                    entry->is_revalidating = true;
+                    is_revalidate = true;
+                    revalidation = {std::string(method), std::string(host), std::string(uri), entry->refetch_request};
+                }
+            }
+        }
+    }
+    if(is_revalidate)
+    {
+        {
+            std::lock_guard<std::mutex> locker(revalidate_mutex_);
+            revalidations_.push_back(std::move(revalidation));
+        }
+        revalidate_cv_.notify_one();
+    }
+
+    uint64_t lookups;
+    if(is_hit)
+    {
+        if(hit->is_stale)
+            ++stale_hits_;
+        lookups = ++hits_ + misses_.load(std::memory_order_relaxed);
+    }else
+        lookups = ++misses_ + hits_.load(std::memory_order_relaxed);
+    if(lookups % kStatsLogInterval == 0)
+        LogStats();
+    return is_hit;
+}
+
+void ProxyCache::Store(std::string_view method, std::string_view host, std::string_view uri, const HeaderGetter &request_header,
+                       std::string_view head, std::string_view body, const Policy &policy, std::string refetch_request)
+{
+    if(!policy.is_cacheable || body.size() > max_object_)
+        return;
+    bool is_in_memory = body.size() <= memory_max_object_ && body.size() <= shard_memory_;
+    std::string path;
+    if(!is_in_memory)
+    {
+        if(path_.empty() || body.size() > shard_disk_)
+            return;
+        path = WriteFile(body);
+        if(path.empty())
+            return;
+    }
+
+    auto entry = std::make_unique<Entry>();
+    auto line_end = head.find("\r\n");
+    entry->head.reserve(head.size());
+    entry->head.append(head.substr(0, line_end));
+    for(auto begin = line_end; begin < head.size(); begin = line_end)
+    {
+        line_end = std::min(head.find("\r\n", begin + 2), head.size());
+        std::string_view line = head.substr(begin, line_end - begin); // with the CRLF before
+        if(!IsUnstoredHeader(Trim(line.substr(2, line.find(':') - 2))))
+            entry->head.append(line);
+    }
+    if(is_in_memory)
+        entry->body = std::make_shared<const std::string>(body);
+    entry->path = std::move(path);
+    entry->body_size = body.size();
+    entry->stored = Clock::now();
+    entry->age = policy.age;
+    entry->max_age = policy.max_age;
+    entry->stale_while_revalidate = policy.stale_while_revalidate;
+    entry->refetch_request = std::move(refetch_request);
+    entry->is_revalidating = false;
+
+    std::string primary = PrimaryKey(method, host, uri);
+    Shard &shard = GetShard(primary);
+    std::vector<std::pair<std::string, Body>> demotions; // out of memory, to be written to disk
+    {
+        std::lock_guard<std::mutex> locker(shard.mutex);
+        if(policy.vary.empty())
+            shard.vary.erase(primary);
+        else
+            shard.vary[primary] = policy.vary;
+        entry->key = policy.vary.empty() ? primary : VariantKey(primary, policy.vary, request_header);
+        auto it = shard.map.find(entry->key);
+        if(it != shard.map.end())
+            Erase(shard, it->second.get());
+        Entry *stored = entry.get();
+        shard.map.emplace(stored->key, std::move(entry));
+        if(is_in_memory)
+        {
+            stored->memory_node = shard.memory_lru.insert(shard.memory_lru.begin(), stored);
+            shard.memory_bytes += stored->body_size;
+            memory_bytes_ += stored->body_size;
+            while(shard.memory_bytes > shard_memory_)
+            {
+                Entry *victim = shard.memory_lru.back();
+                if(victim->path.empty() && !path_.empty())
+                    demotions.emplace_back(victim->key, victim->body);
+                DropFromMemory(shard, victim);
+                if(victim->path.empty() && path_.empty())
+                    Erase(shard, victim);
+            }
+        }else
+        {
+            stored->disk_node = shard.disk_lru.insert(shard.disk_lru.begin(), stored);
+            shard.disk_bytes += stored->body_size;
+            disk_bytes_ += stored->body_size;
+            while(shard.disk_bytes > shard_disk_)
+                DropFromDisk(shard, shard.disk_lru.back());
+        }
+    }
+
+    // written without the lock, the entry is a miss meanwhile
+    for(auto &demotion : demotions)
+    {
+        std::string file = WriteFile(*demotion.second);
+        std::lock_guard<std::mutex> locker(shard.mutex);
+        auto it = shard.map.find(demotion.first);
+        Entry *entry = it == shard.map.end() ? nullptr : it->second.get();
+        if(!entry || entry->body || !entry->path.empty())
+        {
+            if(!file.empty())
+                unlink(file.c_str()); // replaced meanwhile
+            continue;
+        }
+        if(file.empty() || entry->body_size > shard_disk_)
+        {
+            if(!file.empty())
+                unlink(file.c_str());
+            Erase(shard, entry);
+            continue;
+        }
+        entry->path = std::move(file);
+        entry->disk_node = shard.disk_lru.insert(shard.disk_lru.begin(), entry);
+        shard.disk_bytes += entry->body_size;
+        disk_bytes_ += entry->body_size;
+        while(shard.disk_bytes > shard_disk_)
+            DropFromDisk(shard, shard.disk_lru.back());
+    }
+}
+
+bool ProxyCache::IsCacheableRequest(std::string_view method, const HeaderGetter &request_header)
+{
+    return IsStorableRequest(method, request_header) && !HasDirective(request_header("Cache-Control"), "no-cache")
+           && !HasDirective(request_header("Pragma"), "no-cache");
+}
+
+bool ProxyCache::IsStorableRequest(std::string_view method, const HeaderGetter &request_header)
+{
+    return (method == "GET" || method == "HEAD") && request_header("Authorization").empty()
+           && !HasDirective(request_header("Cache-Control"), "no-store");
+}
+
+ProxyCache::Policy ProxyCache::Evaluate(int status, std::string_view head) const
+{
+    Policy policy{};
+    switch(status)
+    {
+        // cacheable by default, RFC 7231 6.1
+        case 200: case 203: case 204: case 300: case 301: case 308: case 404: case 405: case 410: case 414: case 501:
+            break;
+        default:
+            return policy;
+    }
+    if(!FindHeader(head, "Set-Cookie").empty())
+        return policy;
+
+    bool is_private = false;
+    int max_age = -1;
+    int s_maxage = -1;
+    int stale_while_revalidate = stale_while_revalidate_;
+    ForEachDirective(FindHeader(head, "Cache-Control"), [&](std::string_view name, std::string_view value) {
+        if(IsName(name, "no-store") || IsName(name, "private") || IsName(name, "no-cache"))
+            is_private = true;
+        else if(IsName(name, "max-age"))
+            max_age = ToSeconds(value);
+        else if(IsName(name, "s-maxage"))
+            s_maxage = ToSeconds(value);
+        else if(IsName(name, "stale-while-revalidate"))
+            stale_while_revalidate = ToSeconds(value);
+    });
+    if(is_private)
+        return policy;
+    if(s_maxage >= 0)
+        max_age = s_maxage;
+    else if(max_age < 0)
+    {
+        auto expires = FindHeader(head, "Expires");
+        if(expires.empty())
+            return policy; // no freshness to follow, never guessed
+        time_t expires_time = ParseHttpDate(expires);
+        time_t date = ParseHttpDate(FindHeader(head, "Date"));
+        if(date < 0)
+            date = time(nullptr);
+        max_age = expires_time > date ? static_cast<int>(std::min<time_t>(expires_time - date, INT32_MAX)) : 0;
+    }
+
+    bool is_vary_all = false;
+    ForEachDirective(FindHeader(head, "Vary"), [&](std::string_view name, std::string_view) {
+        if(name == "*")
+            is_vary_all = true;
+        std::string lower(name);
+        std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+        policy.vary.push_back(std::move(lower));
+    });
+    if(is_vary_all)
+        return policy;
+    std::sort(policy.vary.begin(), policy.vary.end());
+
+    policy.age = ToSeconds(FindHeader(head, "Age"));
+    policy.max_age = max_age;
+    policy.stale_while_revalidate = stale_while_revalidate;
+    policy.is_cacheable = policy.age < max_age + stale_while_revalidate;
+    return policy;
+}
+
+std::string_view ProxyCache::FindHeader(std::string_view head, std::string_view name)
+{
+    for(auto begin = head.find("\r\n"); begin != std::string_view::npos && begin + 2 < head.size(); )
+    {
+        begin += 2;
+        auto end = head.find("\r\n", begin);
+        std::string_view line = head.substr(begin, end == std::string_view::npos ? std::string_view::npos : end - begin);
+        auto colon = line.find(':');
+        if(colon != std::string_view::npos && IsName(Trim(line.substr(0, colon)), name))
+            return Trim(line.substr(colon + 1));
+        begin = end;
+    }
+    return {};
+}
+
+ProxyCache::Stats ProxyCache::GetStats() const
+{
+    return {hits_.load(), stale_hits_.load(), misses_.load(), revalidated_.load(), coalesced_.load(), memory_bytes_.load(), disk_bytes_.load()};
+}
+
+bool ProxyCache::BeginFlight(const std::string &key)
+{
+    Shard &shard = GetShard(key);
+    std::lock_guard<std::mutex> locker(shard.mutex);
+    return shard.flights.try_emplace(key).second;
+}
+
+bool ProxyCache::WaitFlight(const std::string &key, const void *owner, Waker waker)
+{
+    Shard &shard = GetShard(key);
+    std::lock_guard<std::mutex> locker(shard.mutex);
+    auto it = shard.flights.find(key);
+    if(it == shard.flights.end())
+        return false;
+    it->second.emplace_back(owner, std::move(waker));
+    ++coalesced_;
+    return true;
+}
+
+void ProxyCache::CancelFlight(const std::string &key, const void *owner)
+{
+    Shard &shard = GetShard(key);
+    std::lock_guard<std::mutex> locker(shard.mutex);
+    auto it = shard.flights.find(key);
+    if(it == shard.flights.end())
+        return;
+    auto &waiters = it->second;
+    waiters.erase(std::remove_if(waiters.begin(), waiters.end(), [owner](auto &waiter) { return waiter.first == owner; }), waiters.end());
+}
+
+// woken under the lock, so a waiter cancelled by its close is never woken after it
+void ProxyCache::EndFlight(const std::string &key)
+{
+    Shard &shard = GetShard(key);
+    std::lock_guard<std::mutex> locker(shard.mutex);
+    auto it = shard.flights.find(key);
+    if(it == shard.flights.end())
+        return;
+    for(auto &waiter : it->second)
+        waiter.second();
+    shard.flights.erase(it);
+}
+
+std::string ProxyCache::PrimaryKey(std::string_view method, std::string_view host, std::string_view uri)
+{
+    std::string key;
+    key.reserve(method.size() + host.size() + uri.size() + 1);
+    key.append(method).append(" ").append(host).append(uri);
+    return key;
+}
+
+// the sorted names of Vary with the values of the request, a missing header is different from an empty one
+std::string ProxyCache::VariantKey(const std::string &primary, const std::vector<std::string> &vary,
+                                   const HeaderGetter &request_header)
+{
+    std::string key = primary;
+    for(auto &name : vary)
+    {
+        auto value = request_header(name);
+        key.append("\n").append(name).append(value.data() ? ":" : "!").append(value);
+    }
+    return key;
+}
+
+std::string ProxyCache::WriteFile(std::string_view body)
+{
+    std::string path = path_ + "/" + std::to_string(file_seq_++) + ".cache";
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if(fd < 0)
+    {
+        LOG_WARN("Fail to create proxy cache file ", path);
+        return {};
+    }
+    std::size_t written = 0;
+    while(written < body.size())
+    {
+        ssize_t len = write(fd, body.data() + written, body.size() - written);
+        if(len <= 0)
+            break;
+        written += len;
+    }
+    close(fd);
+    if(written < body.size())
+    {
+        LOG_WARN("Fail to write proxy cache file ", path);
+        unlink(path.c_str());
+        return {};
+    }
+    return path;
+}
+
+void ProxyCache::Erase(Shard &shard, Entry *entry)
+{
+    if(entry->body)
+        DropFromMemory(shard, entry);
+    if(!entry->path.empty())
+        DropFromDisk(shard, entry);
+    else
+        shard.map.erase(shard.map.find(entry->key));
+}
+
+void ProxyCache::DropFromMemory(Shard &shard, Entry *entry)
+{
+    shard.memory_lru.erase(entry->memory_node);
+    shard.memory_bytes -= entry->body_size;
+    memory_bytes_ -= entry->body_size;
+    entry->body.reset();
+}
+
+// the entry is gone unless it is still in memory
+void ProxyCache::DropFromDisk(Shard &shard, Entry *entry)
+{
+    unlink(entry->path.c_str()); // a hit being sent keeps reading it
+    shard.disk_lru.erase(entry->disk_node);
+    shard.disk_bytes -= entry->body_size;
+    disk_bytes_ -= entry->body_size;
+    entry->path.clear();
+    if(!entry->body)
+        shard.map.erase(shard.map.find(entry->key));
+}
+
+void ProxyCache::RevalidateLoop()
+{
+    while(true)
+    {
+        Revalidation revalidation;
+        {
+            std::unique_lock<std::mutex> locker(revalidate_mutex_);
+            revalidate_cv_.wait(locker, [this]{ return is_stop_ || !revalidations_.empty(); });
+            if(is_stop_)
+                return;
+            revalidation = std::move(revalidations_.front());
+            revalidations_.pop_front();
+        }
+        Revalidate(revalidation);
+    }
+}
+
+void ProxyCache::Revalidate(const Revalidation &revalidation)
+{
+    HeaderGetter request_header = [&](std::string_view name) { return FindHeader(revalidation.request, name); };
+    std::string response;
+    if(fetcher_(revalidation.request, &response))
+    {
+        auto head_end = response.find("\r\n\r\n");
+        int status = 0;
+        auto status_begin = response.find(' ');
+        if(status_begin < head_end)
+            std::from_chars(response.data() + status_begin + 1, response.data() + head_end, status);
+        std::string_view head(response.data(), head_end == std::string::npos ? 0 : head_end);
+        std::string_view body;
+        if(head_end != std::string::npos)
+            body = std::string_view(response).substr(head_end + 4);
+        std::size_t content_length = 0;
+        auto length = FindHeader(head, "Content-Length");
+        bool is_complete = head_end != std::string::npos && FindHeader(head, "Transfer-Encoding").empty()
+                           && (length.empty() || (std::from_chars(length.data(), length.data() + length.size(), content_length).ec == std::errc()
+                                                  && body.size() >= content_length));
+        if(!length.empty())
+            body = body.substr(0, content_length);
+        if(revalidation.method == "HEAD")
+            body = {};
+        auto policy = Evaluate(status, head);
+        if(is_complete && policy.is_cacheable)
+        {
+            Store(revalidation.method, revalidation.host, revalidation.uri, request_header, head, body, policy, revalidation.request);
+            ++revalidated_;
+            return;
+        }
+        LOG_INFO("Refetched ", revalidation.uri, " is not cacheable anymore");
+    }else
+        LOG_WARN("Fail to refetch ", revalidation.uri, " from upstream");
+
+    // the stale response is kept until it expires, refetched again on the next hit
+    std::string primary = PrimaryKey(revalidation.method, revalidation.host, revalidation.uri);
+    Shard &shard = GetShard(primary);
+    std::lock_guard<std::mutex> locker(shard.mutex);
+    auto vary = shard.vary.find(primary);
+    auto it = shard.map.find(vary == shard.vary.end() ? primary : VariantKey(primary, vary->second, request_header));
+    if(it != shard.map.end())
+        it->second->is_revalidating = false;
+}
+
+void ProxyCache::LogStats() const
+{
+    auto stats = GetStats();
+    LOG_INFO("[proxy cache] hits: ", stats.hits, " stale hits: ", stats.stale_hits, " misses: ", stats.misses,
+             " revalidations: ", stats.revalidations, " coalesced: ", stats.coalesced, " memory bytes: ", stats.memory_bytes, " disk bytes: ", stats.disk_bytes);
+}
+
+} // namespace white
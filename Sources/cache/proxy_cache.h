@@ -0,0 +1,316 @@
+#ifndef WHITEWEBSERVER_CACHE_PROXY_CACHE_H_
+#define WHITEWEBSERVER_CACHE_PROXY_CACHE_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace white {
+
+/**
+ * @brief Cache of the responses from the upstream, keyed on the method, host and uri, and the request
+ * headers named by Vary. Freshness follows Cache-Control (s-maxage, max-age, no-store, private, no-cache)
+ * and Expires of the response.
+ *
+ * Bodies live in memory while they are hot, the least recently used ones fall back to their files on disk,
+ * which are sent by sendfile. Large bodies are only kept on disk. A response stale for less than its
+ * stale-while-revalidate is still served, and refetched in the background by the revalidation thread.
+ *
+ * Concurrent misses of the same request are coalesced: the first one goes to the upstream as the leader of a
+ * flight, and the later ones wait for the flight to end, then look up the response it stored.
+ *
+ * Entries are spread over shards, each with its own lock, LRU lists and share of the budgets.
+ */
+class ProxyCache
+{
+    using Clock = std::chrono::steady_clock;
+    using TimeStamp = std::chrono::steady_clock::time_point;
+
+public:
+    using Body = std::shared_ptr<const std::string>;
+
+    // the value of a request header, empty if missing
+    using HeaderGetter = std::function<std::string_view(std::string_view name)>;
+
+    // send the request to the upstream and read the whole response, false on failure
+    using Fetcher = std::function<bool(const std::string &request, std::string *response)>;
+
+    // resume a request waiting for a flight, called with the lock of the flight held, so it must not block
+    using Waker = std::function<void()>;
+
+    struct Policy
+    {
+        bool is_cacheable;
+        int max_age; // seconds fresh
+        int stale_while_revalidate; // seconds served stale while refetching, after max_age
+        int age; // seconds old already when received
+        std::vector<std::string> vary; // names of the request headers
+    };
+
+    struct Hit
+    {
+        std::string head; // status line and headers, without the empty line
+        Body body; // in memory, or
+        int fd = -1; // the file on disk, opened for the hit and closed by the caller
+        std::size_t body_size = 0;
+        int age = 0; // seconds
+        bool is_stale = false;
+    };
+
+    struct Config
+    {
+        std::size_t memory; // bytes of the bodies in memory
+        std::size_t memory_max_object; // larger bodies go to disk directly
+        std::size_t max_object; // larger bodies are never cached
+        std::string path; // directory of the files, no disk tier if empty
+        std::size_t disk; // bytes of the files
+        int stale_while_revalidate; // seconds, for the responses not telling
+        bool coalesce; // concurrent misses of the same request wait for the first one
+    };
+
+    struct Stats
+    {
+        uint64_t hits;
+        uint64_t stale_hits;
+        uint64_t misses;
+        uint64_t revalidations;
+        uint64_t coalesced; // misses which waited for a flight instead of going to the upstream
+        std::size_t memory_bytes;
+        std::size_t disk_bytes;
+    };
+
+public:
+    ProxyCache(const Config &config);
+    ~ProxyCache();
+
+    /**
+     * @brief Set how the revalidation thread refetches stale responses. Stale responses are never served
+     * without it.
+     *
+     * @param fetcher
+     */
+    void SetFetcher(Fetcher fetcher);
+
+    /**
+     * @brief Look up the response to a request. A stale hit has its refetch scheduled.
+     *
+     * @param method
+     * @param host
+     * @param uri
+     * @param request_header headers of the request, for Vary
+     * @param hit
+     * @return true fresh, or stale but still to be served
+     * @return false
+     */
+    bool Lookup(std::string_view method, std::string_view host, std::string_view uri,
+                const HeaderGetter &request_header, Hit *hit);
+
+    /**
+     * @brief Store the response if it fits, replacing the older one of the request.
+     *
+     * @param method
+     * @param host
+     * @param uri
+     * @param request_header
+     * @param head status line and headers, without the empty line
+     * @param body
+     * @param policy by Evaluate
+     * @param refetch_request the request sent to refetch it once stale, it must ask to close the connection
+     */
+    void Store(std::string_view method, std::string_view host, std::string_view uri, const HeaderGetter &request_header,
+               std::string_view head, std::string_view body, const Policy &policy, std::string refetch_request);
+
+    /**
+     * @brief Return true if a request may be answered from the cache. A request with no-cache is still
+     * allowed to be stored, see IsStorableRequest.
+     *
+     * @param method
+     * @param request_header
+     * @return true
+     * @return false
+     */
+    static bool IsCacheableRequest(std::string_view method, const HeaderGetter &request_header);
+    static bool IsStorableRequest(std::string_view method, const HeaderGetter &request_header);
+
+    /**
+     * @brief Decide if and how long a response may be cached by its status and headers.
+     *
+     * @param status
+     * @param head
+     * @return Policy
+     */
+    Policy Evaluate(int status, std::string_view head) const;
+
+    /**
+     * @brief Get the value of the header in the head of a request or response, empty if missing.
+     *
+     * @param head
+     * @param name case-insensitive
+     * @return std::string_view
+     */
+    static std::string_view FindHeader(std::string_view head, std::string_view name);
+
+    /**
+     * @brief The key of the request regardless of Vary, which also names its flight.
+     * 
+     * @param method 
+     * @param host 
+     * @param uri 
+     * @return std::string 
+     */
+    static std::string PrimaryKey(std::string_view method, std::string_view host, std::string_view uri);
+
+    /**
+     * @brief Start fetching the response to a missed request, unless another request is fetching it already.
+     * 
+     * @param key by PrimaryKey
+     * @return true the leader, EndFlight must follow
+     * @return false a flight is in progress, wait for it
+     */
+    bool BeginFlight(const std::string &key);
+
+    /**
+     * @brief Wait for the flight to end.
+     * 
+     * @param key 
+     * @param owner identifies the waiter for CancelFlight
+     * @param waker 
+     * @return true waiting
+     * @return false the flight has already ended, look up again now
+     */
+    bool WaitFlight(const std::string &key, const void *owner, Waker waker);
+    void CancelFlight(const std::string &key, const void *owner);
+
+    /**
+     * @brief End the flight, stored or not, and wake all its waiters.
+     * 
+     * @param key 
+     */
+    void EndFlight(const std::string &key);
+
+    bool IsCoalescing() const;
+
+    std::size_t MaxObjectSize() const;
+
+    Stats GetStats() const;
+
+private:
+    struct Entry
+    {
+        std::string key;
+        std::string head;
+        Body body; // null once it falls out of memory
+        std::string path; // empty if not on disk
+        std::size_t body_size;
+        TimeStamp stored;
+        int age;
+        int max_age;
+        int stale_while_revalidate;
+        std::string refetch_request;
+        bool is_revalidating;
+        std::list<Entry*>::iterator memory_node; // valid if body
+        std::list<Entry*>::iterator disk_node; // valid if path is not empty
+    };
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::unordered_map<std::string, std::unique_ptr<Entry>> map;
+        std::unordered_map<std::string, std::vector<std::string>> vary; // the primary key -> names of the headers
+        std::unordered_map<std::string, std::vector<std::pair<const void*, Waker>>> flights; // the primary key -> waiters
+        std::list<Entry*> memory_lru; // most recently used at front
+        std::list<Entry*> disk_lru;
+        std::size_t memory_bytes = 0;
+        std::size_t disk_bytes = 0;
+    };
+
+    struct Revalidation
+    {
+        std::string method;
+        std::string host;
+        std::string uri;
+        std::string request;
+    };
+
+private:
+    static constexpr std::size_t kShardNum = 8;
+    static constexpr uint64_t kStatsLogInterval = 1 << 16; // lookups between two stats logs
+
+private:
+    static std::string VariantKey(const std::string &primary, const std::vector<std::string> &vary,
+                                  const HeaderGetter &request_header);
+
+    Shard &GetShard(const std::string &primary);
+
+    /**
+     * @brief Write the body into a new file in the cache directory.
+     *
+     * @param body
+     * @return std::string the path, empty if failed
+     */
+    std::string WriteFile(std::string_view body);
+
+    void Erase(Shard &shard, Entry *entry);
+    void DropFromMemory(Shard &shard, Entry *entry);
+    void DropFromDisk(Shard &shard, Entry *entry);
+
+    void RevalidateLoop();
+    void Revalidate(const Revalidation &revalidation);
+    void LogStats() const;
+
+private:
+    std::size_t shard_memory_;
+    std::size_t memory_max_object_;
+    std::size_t max_object_;
+    std::string path_;
+    std::size_t shard_disk_;
+    int stale_while_revalidate_;
+    bool is_coalescing_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::atomic<uint64_t> file_seq_;
+
+    Fetcher fetcher_;
+    std::thread revalidator_;
+    std::mutex revalidate_mutex_;
+    std::condition_variable revalidate_cv_;
+    std::deque<Revalidation> revalidations_;
+    bool is_stop_;
+
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> stale_hits_;
+    std::atomic<uint64_t> misses_;
+    std::atomic<uint64_t> revalidated_;
+    std::atomic<uint64_t> coalesced_;
+    std::atomic<std::size_t> memory_bytes_;
+    std::atomic<std::size_t> disk_bytes_;
+};
+
+inline std::size_t ProxyCache::MaxObjectSize() const
+{
+    return max_object_;
+}
+
+inline bool ProxyCache::IsCoalescing() const
+{
+    return is_coalescing_;
+}
+
+inline ProxyCache::Shard &ProxyCache::GetShard(const std::string &primary)
+{
+    return *shards_[std::hash<std::string>{}(primary) % kShardNum];
+}
+
+} // namespace white
+
+#endif
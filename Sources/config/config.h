@@ -3,16 +3,68 @@
 
 #include <arpa/inet.h>
 #include <string>
+#include <vector>
 
 namespace white {
 
-struct ProxyConfig
+// how a request picks a server of the upstream group
+enum class ProxyBalance
 {
-    std::string protocol_;
+    ROUND_ROBIN,
+    LEAST_CONN, // the server with the fewest requests in flight
+    HASH_IP, // consistent hash of the client address
+    HASH_URI, // consistent hash of the path
+};
+
+struct UpstreamServer
+{
+    std::string host_;
     in_addr addr_;
     in_port_t port_;
+};
+
+struct ProxyConfig
+{
+    std::string protocol_;
+    std::vector<UpstreamServer> servers_;
     std::string path_;
-    std::string host_;
+    ProxyBalance balance_ = ProxyBalance::ROUND_ROBIN;
+    int health_check_interval_ = 0; // milliseconds between active health checks, 0 if disabled
+    int health_check_timeout_ = 1000;
+    int health_check_fails_ = 2; // consecutive failed checks before a server is ejected
+    int health_check_passes_ = 2; // consecutive passed checks before an ejected server is back
+    std::string health_check_path_; // GET it and expect 2xx or 3xx, only connect if empty
+    std::size_t keepalive_ = 32; // max idle connections kept to the upstream, 0 if never reused
+    int keepalive_timeout_ = 60000; // milliseconds before an idle upstream connection is closed
+    std::size_t prewarm_ = 0; // upstream connections opened at startup
+    int connect_timeout_ = 5000; // milliseconds before connecting to the upstream fails with 504
+    bool splice_ = true; // relay the bodies of responses by splice through pipes, or copy them
+    bool cache_ = false; // cache the responses following their Cache-Control
+    std::size_t cache_memory_ = 64 << 20; // bytes of the cached bodies in memory
+    std::size_t cache_memory_max_object_ = 1 << 20; // larger bodies are only cached on disk
+    std::size_t cache_max_object_ = 16 << 20; // larger bodies are never cached
+    std::string cache_path_; // directory of the cached bodies on disk, no disk tier if empty
+    std::size_t cache_disk_ = 1 << 30; // bytes of the cached bodies on disk
+    int cache_stale_while_revalidate_ = 0; // seconds, for the responses not telling
+    bool cache_coalesce_ = true; // concurrent misses of the same request wait for the first one instead of going upstream
+};
+
+// how a location matches the path of a request
+enum class LocationMatch
+{
+    EXACT,
+    PREFIX,
+    REGEX,
+};
+
+struct LocationConfig
+{
+    LocationMatch match_;
+    std::string pattern_;
+    std::string root_; // static files under it, the root of the server if empty
+    ProxyConfig proxy_config_; // proxied if it has servers, with the proxy options of the server
+    std::string redirect_; // redirected if not empty, $uri is replaced by the uri of the request
+    int redirect_code_ = 302;
 };
 
 class Config
@@ -27,30 +79,70 @@ public:
 public:
     const in_addr Address() const { return address_; };
     const in_port_t Port() const { return port_; };
+    const std::vector<std::string> &ServerNames() const { return server_names_; };
+    const bool IsDefaultServer() const { return is_default_server_; };
     const std::string &WebRoot() const { return web_root_; };
     const std::string &LogDir() const { return log_dir_; };
     const int Timeout() const { return timeout_; };
     const std::vector<std::string> &IndexFile() const { return index_file_; };
+    const int ThreadNum() const { return thread_num_; };
+    const bool IsMultiReactor() const { return is_multi_reactor_; };
+    const bool IsWorkStealing() const { return is_work_stealing_; };
+    const bool IsTimingWheel() const { return is_timing_wheel_; };
+    const bool IsIoUring() const { return is_io_uring_; };
+    const bool IsSendfile() const { return is_sendfile_; };
+    const std::size_t OpenFileCacheSize() const { return open_file_cache_size_; };
+    const int OpenFileCacheValid() const { return open_file_cache_valid_; };
+    const std::size_t HotObjectCacheMemory() const { return hot_object_cache_memory_; };
+    const std::size_t HotObjectCacheMaxObject() const { return hot_object_cache_max_object_; };
+    const int HotObjectCacheValid() const { return hot_object_cache_valid_; };
 
     const bool IsProxy() const {return is_proxy_; };
     const ProxyConfig &GetProxyConfig() const {return proxy_config_; };
+    const std::vector<LocationConfig> &Locations() const {return locations_; };
 
 private:
     in_port_t port_;
     in_addr address_;
+    std::vector<std::string> server_names_; // matched with the Host header when servers share the address and port
+    bool is_default_server_; // answers the requests matching no name, else the first server of the address and port
     std::string web_root_;
     std::string log_dir_;
     int timeout_;
+    int thread_num_;
+    bool is_multi_reactor_; // one epoll loop per thread, each accepting from its own SO_REUSEPORT socket
+    bool is_work_stealing_; // use WorkStealingPool instead of ThreadPool in single reactor mode
+    bool is_timing_wheel_; // use TimingWheel instead of HeapTimer for connection timeouts
+    bool is_io_uring_; // wait for the events on io_uring instead of epoll, epoll if the kernel lacks it
+    bool is_sendfile_; // send static files by sendfile, or by mmap and writev
+    std::size_t open_file_cache_size_; // 0 if the open file cache is disabled
+    int open_file_cache_valid_; // milliseconds before a cached file is checked again
+    std::size_t hot_object_cache_memory_; // 0 if the hot object cache is disabled
+    std::size_t hot_object_cache_max_object_; // larger responses are never cached
+    int hot_object_cache_valid_; // milliseconds before a cached response is rendered again
 
     bool is_proxy_;
     ProxyConfig proxy_config_;
+    std::vector<LocationConfig> locations_; // in the order of the config, which regexes are tried in
     std::vector<std::string> index_file_;
 
 };
 
 inline Config::Config() :
 port_(0),
+is_default_server_(false),
 timeout_(0),
+thread_num_(8),
+is_multi_reactor_(false),
+is_work_stealing_(false),
+is_timing_wheel_(false),
+is_io_uring_(false),
+is_sendfile_(true),
+open_file_cache_size_(0),
+open_file_cache_valid_(60000),
+hot_object_cache_memory_(0),
+hot_object_cache_max_object_(64 << 10),
+hot_object_cache_valid_(60000),
 is_proxy_(false)
 {
 
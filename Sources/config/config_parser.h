@@ -35,6 +35,33 @@ public:
 private:
     void Parse();
 
+    /**
+     * @brief Parse a url of proxy_pass, such as http://127.0.0.1:8080/, the protocol and the path go to proxy_config.
+     * 
+     * @param url 
+     * @param proxy_config 
+     * @return UpstreamServer 
+     */
+    static UpstreamServer ParseProxyPass(const std::string &url, ProxyConfig &proxy_config);
+
+    /**
+     * @brief Parse proxy_pass, a url or an array of urls for an upstream group, into the servers of proxy_config.
+     * 
+     * @param proxy_pass 
+     * @param proxy_config 
+     */
+    static void ParseProxyPass(const Json::Value &proxy_pass, ProxyConfig &proxy_config);
+
+    /**
+     * @brief Parse a location such as {"prefix": "/api/", "proxy_pass": "http://127.0.0.1:8080/"}, matched by
+     * one of exact, prefix and regex, and handled by one of root, proxy_pass and redirect.
+     * 
+     * @param location 
+     * @param proxy_config the proxy options of the server
+     * @return LocationConfig 
+     */
+    static LocationConfig ParseLocation(const Json::Value &location, const ProxyConfig &proxy_config);
+
 private:
     std::vector<Config> configs_;
     std::queue<std::string> config_docs_queue_;
@@ -88,69 +115,111 @@ inline void ConfigParser::Parse()
         if(root["port"] != Json::nullValue)
             new_config.port_ = htons(root["port"].asInt());
         
+        if(root["server_name"].isArray())
+        {
+            const Json::Value &server_names = root["server_name"];
+            for(int i = 0; i < server_names.size(); ++i)
+                new_config.server_names_.push_back(server_names[i].asString());
+        }else if(root["server_name"] != Json::nullValue)
+            new_config.server_names_.push_back(root["server_name"].asString());
+        new_config.is_default_server_ = root.get("default_server", false).asBool();
+
         new_config.log_dir_ = root.get("log_path", "/var/log/whitewebserver").asString();
         new_config.web_root_ = root.get("root", "/etc/whitewebserver/html").asString();
         new_config.timeout_ = root.get("timeout", 60000).asInt();
+        new_config.thread_num_ = root.get("threads", 8).asInt();
+        if(new_config.thread_num_ <= 0)
+            ParseErrorHanding("Threads config error!");
+        new_config.is_multi_reactor_ = root.get("multi_reactor", false).asBool();
+        new_config.is_work_stealing_ = root.get("work_stealing", false).asBool();
+        new_config.is_sendfile_ = root.get("sendfile", true).asBool();
+        if(root["open_file_cache"] != Json::nullValue)
+        {
+            const Json::Value &open_file_cache = root["open_file_cache"];
+            new_config.open_file_cache_size_ = open_file_cache.get("max", 1024).asUInt();
+            new_config.open_file_cache_valid_ = open_file_cache.get("valid", 60000).asInt();
+        }
+        if(root["hot_object_cache"] != Json::nullValue)
+        {
+            const Json::Value &hot_object_cache = root["hot_object_cache"];
+            new_config.hot_object_cache_memory_ = hot_object_cache.get("memory", 64 << 20).asUInt64();
+            new_config.hot_object_cache_max_object_ = hot_object_cache.get("max_object_size", 64 << 10).asUInt64();
+            new_config.hot_object_cache_valid_ = hot_object_cache.get("valid", 60000).asInt();
+        }
+        std::string timer = root.get("timer", "heap").asString();
+        if(timer == "wheel")
+            new_config.is_timing_wheel_ = true;
+        else if(timer != "heap")
+            ParseErrorHanding("Timer config error!");
+
+        std::string events = root.get("events", "epoll").asString();
+        if(events == "io_uring")
+            new_config.is_io_uring_ = true;
+        else if(events != "epoll")
+            ParseErrorHanding("Events config error!");
         
+        // the proxy options apply to the proxy_pass of the server and of every location
+        std::string balance = root.get("proxy_balance", "round_robin").asString();
+        if(balance == "round_robin")
+            new_config.proxy_config_.balance_ = ProxyBalance::ROUND_ROBIN;
+        else if(balance == "least_conn")
+            new_config.proxy_config_.balance_ = ProxyBalance::LEAST_CONN;
+        else if(balance == "hash_ip")
+            new_config.proxy_config_.balance_ = ProxyBalance::HASH_IP;
+        else if(balance == "hash_uri")
+            new_config.proxy_config_.balance_ = ProxyBalance::HASH_URI;
+        else
+            ParseErrorHanding("Proxy balance config error!");
+        if(root["proxy_health_check"] != Json::nullValue)
+        {
+            const Json::Value &health_check = root["proxy_health_check"];
+            new_config.proxy_config_.health_check_interval_ = health_check.get("interval", 5000).asInt();
+            new_config.proxy_config_.health_check_timeout_ = health_check.get("timeout", 1000).asInt();
+            new_config.proxy_config_.health_check_fails_ = health_check.get("fails", 2).asInt();
+            new_config.proxy_config_.health_check_passes_ = health_check.get("passes", 2).asInt();
+            new_config.proxy_config_.health_check_path_ = health_check.get("path", "").asString();
+            if(new_config.proxy_config_.health_check_interval_ < 0 || new_config.proxy_config_.health_check_timeout_ <= 0
+               || new_config.proxy_config_.health_check_fails_ <= 0 || new_config.proxy_config_.health_check_passes_ <= 0)
+                ParseErrorHanding("Proxy health check config error!");
+        }
+        new_config.proxy_config_.connect_timeout_ = root.get("proxy_connect_timeout", 5000).asInt();
+        if(new_config.proxy_config_.connect_timeout_ <= 0)
+            ParseErrorHanding("Proxy connect timeout config error!");
+        new_config.proxy_config_.splice_ = root.get("proxy_splice", true).asBool();
+        if(root["proxy_keepalive"] != Json::nullValue)
+        {
+            const Json::Value &proxy_keepalive = root["proxy_keepalive"];
+            new_config.proxy_config_.keepalive_ = proxy_keepalive.get("max_idle", 32).asUInt();
+            new_config.proxy_config_.keepalive_timeout_ = proxy_keepalive.get("timeout", 60000).asInt();
+            new_config.proxy_config_.prewarm_ = proxy_keepalive.get("prewarm", 0).asUInt();
+        }
+        if(root["proxy_cache"] != Json::nullValue)
+        {
+            const Json::Value &proxy_cache = root["proxy_cache"];
+            new_config.proxy_config_.cache_ = true;
+            new_config.proxy_config_.cache_memory_ = proxy_cache.get("memory", 64 << 20).asUInt64();
+            new_config.proxy_config_.cache_memory_max_object_ = proxy_cache.get("memory_max_object", 1 << 20).asUInt64();
+            new_config.proxy_config_.cache_max_object_ = proxy_cache.get("max_object", 16 << 20).asUInt64();
+            new_config.proxy_config_.cache_path_ = proxy_cache.get("path", "").asString();
+            new_config.proxy_config_.cache_disk_ = proxy_cache.get("disk", 1 << 30).asUInt64();
+            new_config.proxy_config_.cache_stale_while_revalidate_ = proxy_cache.get("stale_while_revalidate", 0).asInt();
+            new_config.proxy_config_.cache_coalesce_ = proxy_cache.get("coalesce", true).asBool();
+            if(new_config.proxy_config_.cache_stale_while_revalidate_ < 0)
+                ParseErrorHanding("Proxy cache config error!");
+        }
         if(root["proxy_pass"] != Json::nullValue)
         {
             new_config.is_proxy_ = true;
-            std::string proxy_pass_origin_path = root["proxy_pass"].asString();
-
-            auto protocol_end_pos = proxy_pass_origin_path.find(':', 0);
-            if(protocol_end_pos == std::string::npos)
-                ParseErrorHanding("Proxy pass config error!");
-            if(protocol_end_pos == 4 && (strcasecmp(proxy_pass_origin_path.substr(0, 4).c_str(), "http") == 0))
-                new_config.proxy_config_.protocol_ = "http";
-            else if(protocol_end_pos == 5 && (strcasecmp(proxy_pass_origin_path.substr(0, 5).c_str(), "https") == 0))
-                new_config.proxy_config_.protocol_ = "https";
-            else
-                ParseErrorHanding("Proxy pass config error!");
-
-            auto addr_start_pos = protocol_end_pos + 3;
-            auto addr_end_pos = proxy_pass_origin_path.find(':', addr_start_pos);
-            if(addr_end_pos == std::string::npos)
-            {
-                if(new_config.proxy_config_.protocol_ == "http")
-                    new_config.proxy_config_.port_ = htons(80);
-                else
-                    new_config.proxy_config_.port_ = htons(443);
-                addr_end_pos = proxy_pass_origin_path.find('/', addr_start_pos);
-                if(addr_end_pos == std::string::npos)
-                {
-                    new_config.proxy_config_.path_ = "/";
-                    addr_end_pos = proxy_pass_origin_path.size();
-                }
-            }else
-            {
-                auto host_str = proxy_pass_origin_path.substr(addr_start_pos, addr_end_pos - addr_start_pos).c_str();
-                new_config.proxy_config_.host_ = host_str;
-                hostent *host_info = gethostbyname(host_str);
-                if(host_info != nullptr)
-                {
-                    new_config.proxy_config_.addr_ = *(in_addr*)(host_info->h_addr_list)[0];
-                }else
-                {
-                    if(inet_pton(AF_INET, 
-                                host_str,
-                                &new_config.proxy_config_.addr_) 
-                        != 1)
-                        ParseErrorHanding("Proxy pass config error!");
-                }
-            }
-            auto port_end_pos = proxy_pass_origin_path.find('/', addr_end_pos);
-            if(port_end_pos == std::string::npos)
-            {
-                new_config.proxy_config_.port_ = htons(stoi(proxy_pass_origin_path.substr(addr_end_pos + 1)));
-                new_config.proxy_config_.path_ = "/";
-            }
-            else if(port_end_pos != addr_end_pos)
-            {
-                new_config.proxy_config_.port_ = htons(stoi(proxy_pass_origin_path.substr(addr_end_pos + 1, port_end_pos - addr_end_pos - 1)));
-                new_config.proxy_config_.path_ = proxy_pass_origin_path.substr(port_end_pos);
-            }
+            ParseProxyPass(root["proxy_pass"], new_config.proxy_config_);
         }
-        
+
+        if(root["locations"] != Json::nullValue)
+        {
+            const Json::Value &locations = root["locations"];
+            for(int i = 0; i < locations.size(); ++i)
+                new_config.locations_.push_back(ParseLocation(locations[i], new_config.proxy_config_));
+        }
+
         if(root["index"] != Json::nullValue)
         {
             Json::Value index_file = root["index"];
@@ -162,6 +231,96 @@ inline void ConfigParser::Parse()
     }
 }
 
+inline void ConfigParser::ParseProxyPass(const Json::Value &proxy_pass, ProxyConfig &proxy_config)
+{
+    if(proxy_pass.isArray())
+    {
+        if(proxy_pass.empty())
+            ParseErrorHanding("Proxy pass config error!");
+        for(int i = 0; i < proxy_pass.size(); ++i)
+        {
+            std::string protocol = proxy_config.protocol_;
+            std::string path = proxy_config.path_;
+            proxy_config.servers_.push_back(ParseProxyPass(proxy_pass[i].asString(), proxy_config));
+            // the servers of a group are sent the same request
+            if(i > 0 && (proxy_config.protocol_ != protocol || proxy_config.path_ != path))
+                ParseErrorHanding("Proxy pass config error, the urls of an upstream group differ in protocol or path!");
+        }
+    }else
+        proxy_config.servers_.push_back(ParseProxyPass(proxy_pass.asString(), proxy_config));
+}
+
+inline LocationConfig ConfigParser::ParseLocation(const Json::Value &location, const ProxyConfig &proxy_config)
+{
+    LocationConfig location_config;
+    if(location["exact"] != Json::nullValue)
+    {
+        location_config.match_ = LocationMatch::EXACT;
+        location_config.pattern_ = location["exact"].asString();
+    }else if(location["prefix"] != Json::nullValue)
+    {
+        location_config.match_ = LocationMatch::PREFIX;
+        location_config.pattern_ = location["prefix"].asString();
+    }else if(location["regex"] != Json::nullValue)
+    {
+        location_config.match_ = LocationMatch::REGEX;
+        location_config.pattern_ = location["regex"].asString();
+    }else
+        ParseErrorHanding("Location config error, exact, prefix or regex required!");
+
+    location_config.root_ = location.get("root", "").asString();
+    location_config.redirect_ = location.get("redirect", "").asString();
+    location_config.redirect_code_ = location.get("code", 302).asInt();
+    if(location_config.redirect_code_ != 301 && location_config.redirect_code_ != 302
+       && location_config.redirect_code_ != 307 && location_config.redirect_code_ != 308)
+        ParseErrorHanding("Location redirect code config error!");
+    if(location["proxy_pass"] != Json::nullValue)
+    {
+        location_config.proxy_config_ = proxy_config;
+        location_config.proxy_config_.servers_.clear();
+        ParseProxyPass(location["proxy_pass"], location_config.proxy_config_);
+    }
+    if(!location_config.root_.empty() + !location_config.redirect_.empty() + !location_config.proxy_config_.servers_.empty() > 1)
+        ParseErrorHanding("Location config error, only one of root, proxy_pass and redirect allowed!");
+    return location_config;
+}
+
+inline UpstreamServer ConfigParser::ParseProxyPass(const std::string &url, ProxyConfig &proxy_config)
+{
+    UpstreamServer server;
+    auto protocol_end_pos = url.find("://");
+    if(protocol_end_pos == std::string::npos)
+        ParseErrorHanding("Proxy pass config error!");
+    std::string protocol = url.substr(0, protocol_end_pos);
+    if(strcasecmp(protocol.c_str(), "http") == 0)
+        proxy_config.protocol_ = "http";
+    else if(strcasecmp(protocol.c_str(), "https") == 0)
+        proxy_config.protocol_ = "https";
+    else
+        ParseErrorHanding("Proxy pass config error!");
+
+    auto addr_start_pos = protocol_end_pos + 3;
+    auto path_pos = url.find('/', addr_start_pos);
+    if(path_pos == std::string::npos)
+        path_pos = url.size();
+    proxy_config.path_ = path_pos == url.size() ? "/" : url.substr(path_pos);
+    auto port_pos = url.find(':', addr_start_pos);
+    if(port_pos == std::string::npos || port_pos > path_pos)
+    {
+        server.port_ = htons(proxy_config.protocol_ == "http" ? 80 : 443);
+        port_pos = path_pos;
+    }else
+        server.port_ = htons(stoi(url.substr(port_pos + 1, path_pos - port_pos - 1)));
+
+    server.host_ = url.substr(addr_start_pos, port_pos - addr_start_pos);
+    hostent *host_info = gethostbyname(server.host_.c_str());
+    if(host_info != nullptr)
+        server.addr_ = *(in_addr*)(host_info->h_addr_list)[0];
+    else if(inet_pton(AF_INET, server.host_.c_str(), &server.addr_) != 1)
+        ParseErrorHanding("Proxy pass config error!");
+    return server;
+}
+
 } // namespace white
 
 #endif
\ No newline at end of file
@@ -9,27 +9,38 @@
 #include <sys/epoll.h>
 #include <vector>
 #include "unistd.h"
+#include "epoll/poller.h"
 
 namespace white
 {
 
-class Epoll
+class Epoll : public Poller
 {
 public:
     Epoll(int epoll_max_event = 10000);
-    ~Epoll();
+    ~Epoll() override;
 
-    bool AddFd(int fd, int event);
+    bool AddFd(int fd, int event, void *data) override;
 
-    bool ModFd(int fd, int event);
+    bool AddListenFd(int fd, int event, void *data) override;
 
-    bool DelFd(int fd);
+    bool AddRecvFd(int fd, int event, void *data) override;
 
-    int Wait(int timeout = -1);
+    bool ModFd(int fd, int event, void *data) override;
 
-    int GetEventFd(std::size_t index) const;
+    bool DelFd(int fd) override;
 
-    int GetEvents(std::size_t index) const;
+    int Wait(int timeout = -1) override;
+
+    void *GetEventData(std::size_t index) const override;
+
+    int GetEvents(std::size_t index) const override;
+
+    int GetAcceptedFd(std::size_t index) const override;
+
+    std::string_view GetReceived(std::size_t index, bool *is_more) const override;
+
+    bool IsIoUring() const override;
 
 private:
     int epollfd_;
@@ -52,18 +63,28 @@ inline Epoll::~Epoll()
     close(epollfd_);
 }
 
-inline bool Epoll::AddFd(int fd, int events)
+inline bool Epoll::AddFd(int fd, int events, void *data)
 {
     epoll_event event{};
-    event.data.fd = fd;
+    event.data.ptr = data;
     event.events = events;
     return epoll_ctl(epollfd_, EPOLL_CTL_ADD, fd, &event) == 0;
 }
 
-inline bool Epoll::ModFd(int fd, int events)
+inline bool Epoll::AddListenFd(int fd, int events, void *data)
+{
+    return AddFd(fd, events, data);
+}
+
+inline bool Epoll::AddRecvFd(int fd, int events, void *data)
+{
+    return AddFd(fd, events, data);
+}
+
+inline bool Epoll::ModFd(int fd, int events, void *data)
 {
     epoll_event event{};
-    event.data.fd = fd;
+    event.data.ptr = data;
     event.events = events;
     return epoll_ctl(epollfd_, EPOLL_CTL_MOD, fd, &event) == 0;
 }
@@ -78,15 +99,31 @@ inline int Epoll::Wait(int timeout)
     return epoll_wait(epollfd_, events_.data(), epoll_max_event_, timeout);
 }
 
-inline int Epoll::GetEventFd(std::size_t index) const
+inline void *Epoll::GetEventData(std::size_t index) const
 {
-    return events_[index].data.fd;
+    return events_[index].data.ptr;
 }
 
 inline int Epoll::GetEvents(std::size_t index) const
 {
     return events_[index].events;
 }
+
+inline int Epoll::GetAcceptedFd(std::size_t) const
+{
+    return -1;
+}
+
+inline std::string_view Epoll::GetReceived(std::size_t, bool *is_more) const
+{
+    *is_more = false;
+    return {};
+}
+
+inline bool Epoll::IsIoUring() const
+{
+    return false;
+}
 } // namespace white
 
 #endif
\ No newline at end of file
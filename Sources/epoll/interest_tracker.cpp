@@ -0,0 +1,83 @@
+#include "epoll/interest_tracker.h"
+#include "logger/logger.h"
+
+namespace white {
+
+InterestTracker::InterestTracker(Poller &poller, bool is_oneshot, int max_fd) :
+poller_(poller),
+is_oneshot_(is_oneshot),
+interests_(max_fd),
+saved_(0),
+made_(0)
+{
+
+}
+
+bool InterestTracker::Add(int fd, int events, void *data, bool is_recv)
+{
+    auto &interest = Get(fd);
+    interest.events = events;
+    interest.data = data;
+    interest.is_armed = true;
+    return is_recv ? poller_.AddRecvFd(fd, events, data) : poller_.AddFd(fd, events, data);
+}
+
+bool InterestTracker::Arm(int fd, int events)
+{
+    auto &interest = Get(fd);
+    if(is_oneshot_)
+        return poller_.ModFd(fd, events, interest.data);
+    interest.is_armed = true;
+    if(interest.events == events)
+    {
+        Save();
+        return true;
+    }
+    return Modify(fd, interest, events);
+}
+
+void InterestTracker::Park(int fd)
+{
+    if(is_oneshot_)
+        return;
+    auto &interest = Get(fd);
+    if(interest.events != kDisarmed)
+        Modify(fd, interest, kDisarmed);
+    interest.is_armed = true; // whatever the other thread arms is wanted
+}
+
+bool InterestTracker::Del(int fd)
+{
+    Get(fd) = {};
+    return poller_.DelFd(fd);
+}
+
+bool InterestTracker::Fire(int fd)
+{
+    if(is_oneshot_)
+        return true;
+    auto &interest = Get(fd);
+    if(interest.is_armed)
+    {
+        interest.is_armed = false;
+        return true;
+    }
+    if(interest.events != kDisarmed)
+        Modify(fd, interest, kDisarmed);
+    return false;
+}
+
+void InterestTracker::Save()
+{
+    if(++saved_ % kStatsLogInterval == 0)
+        LOG_INFO("[epoll_ctl] saved ", saved_, " made ", made_);
+}
+
+bool InterestTracker::Modify(int fd, Interest &interest, int events)
+{
+    ++made_;
+    interest.events = events;
+    return poller_.ModFd(fd, events, interest.data);
+}
+
+} // namespace white
@@ -0,0 +1,116 @@
+#ifndef WHITEWEBSERVER_EPOLL_INTEREST_TRACKER_H_
+#define WHITEWEBSERVER_EPOLL_INTEREST_TRACKER_H_
+
+#include "epoll/poller.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace white {
+
+/**
+ * @brief The events each connection of a reactor is waiting for.
+ *
+ * In the one shot mode, for the pools whose workers must never handle a connection twice at once, every arm
+ * goes to the poller. Otherwise the reactor owns its connections alone, which stay registered level triggered:
+ * an arm with the events already registered is skipped, and a delivery disarms the fd only in the tracker, as
+ * EPOLLONESHOT would. An event of a fd disarmed that way is dropped, and the fd is disarmed in the kernel then,
+ * so the handlers see the same events in both modes while most arms never make a syscall.
+ */
+class InterestTracker
+{
+public:
+    /**
+     * @brief Construct a new Interest Tracker object
+     * 
+     * @param poller 
+     * @param is_oneshot 
+     * @param max_fd every fd is below, the states are allocated at once since the workers arm in one shot mode
+     */
+    InterestTracker(Poller &poller, bool is_oneshot, int max_fd);
+
+    /**
+     * @brief Register the fd armed with the events.
+     *
+     * @param fd
+     * @param events
+     * @param data
+     * @param is_recv its data comes with its EPOLLIN, see Poller::AddRecvFd
+     * @return true
+     * @return false
+     */
+    bool Add(int fd, int events, void *data, bool is_recv = false);
+
+    /**
+     * @brief Wait for the events on the fd.
+     *
+     * @param fd
+     * @param events with the flags of the mode
+     * @return true
+     * @return false
+     */
+    bool Arm(int fd, int events);
+
+    /**
+     * @brief Hand the fd to another thread, which arms it by a one shot ModFd the tracker never sees, with the
+     * data it was added with.
+     *
+     * @param fd
+     */
+    void Park(int fd);
+
+    bool Del(int fd);
+
+    /**
+     * @brief An event of the fd is delivered, before any handler of the round runs.
+     *
+     * @param fd
+     * @return true the fd was armed, handle the event
+     * @return false drop it
+     */
+    bool Fire(int fd);
+
+    /**
+     * @brief Count an arm made needless, by a response written at once instead of waiting for EPOLLOUT.
+     *
+     */
+    void Save();
+
+    bool IsOneShot() const;
+
+private:
+    struct Interest
+    {
+        int events = 0; // registered in the kernel
+        void *data = nullptr;
+        bool is_armed = false;
+    };
+
+    static constexpr int kDisarmed = EPOLLONESHOT; // nothing but a hangup, reported once
+    static constexpr uint64_t kStatsLogInterval = 1 << 16; // arms saved between two stats logs
+
+private:
+    Interest &Get(int fd);
+    bool Modify(int fd, Interest &interest, int events);
+
+private:
+    Poller &poller_;
+    bool is_oneshot_;
+    std::vector<Interest> interests_; // indexed by fd
+    uint64_t saved_; // epoll_ctl the one shot mode would have made
+    uint64_t made_;
+};
+
+inline bool InterestTracker::IsOneShot() const
+{
+    return is_oneshot_;
+}
+
+inline InterestTracker::Interest &InterestTracker::Get(int fd)
+{
+    return interests_[fd];
+}
+
+} // namespace white
+
+#endif
@@ -0,0 +1,378 @@
+#include "epoll/io_uring_poller.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace white {
+
+IoUringPoller::IoUringPoller(unsigned entries, int max_event) :
+ring_fd_(-1),
+ring_(MAP_FAILED),
+ring_size_(0),
+sqes_(static_cast<io_uring_sqe*>(MAP_FAILED)),
+sqes_size_(0),
+registrations_(1024),
+reactor_(std::thread::id()),
+buf_ring_(nullptr),
+buf_tail_(0),
+is_multishot_accept_(true),
+events_(max_event),
+max_event_(max_event)
+{
+    io_uring_params params{};
+    params.flags = IORING_SETUP_SUBMIT_ALL; // a bad entry never holds back the ones after it
+    ring_fd_ = syscall(__NR_io_uring_setup, entries, &params);
+    if(ring_fd_ < 0 && errno == EINVAL)
+    {
+        params = {};
+        ring_fd_ = syscall(__NR_io_uring_setup, entries, &params);
+    }
+    if(ring_fd_ < 0)
+        return;
+
+    // Wait needs the timeout of EXT_ARG, and no completion may be dropped on overflow
+    unsigned features = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if((params.features & features) == features)
+    {
+        ring_size_ = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                              params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+        ring_ = mmap(nullptr, ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = static_cast<io_uring_sqe*>(mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                                ring_fd_, IORING_OFF_SQES));
+    }
+    if(ring_ == MAP_FAILED || sqes_ == MAP_FAILED)
+    {
+        if(ring_ != MAP_FAILED)
+            munmap(ring_, ring_size_);
+        if(sqes_ != MAP_FAILED)
+            munmap(sqes_, sqes_size_);
+        close(ring_fd_);
+        ring_fd_ = -1;
+        return;
+    }
+
+    char *ring = static_cast<char*>(ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(ring + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(ring + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(ring + params.sq_off.ring_mask);
+    sq_entries_ = params.sq_entries;
+    cq_head_ = reinterpret_cast<unsigned*>(ring + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(ring + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(ring + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(ring + params.cq_off.cqes);
+    // every slot of the ring points to the entry of the same index, set once
+    unsigned *sq_array = reinterpret_cast<unsigned*>(ring + params.sq_off.array);
+    for(unsigned i = 0; i < sq_entries_; ++i)
+        sq_array[i] = i;
+    SetupRecvBufs();
+}
+
+IoUringPoller::~IoUringPoller()
+{
+    if(ring_fd_ < 0)
+        return;
+    munmap(sqes_, sqes_size_);
+    munmap(ring_, ring_size_);
+    close(ring_fd_);
+    if(buf_ring_)
+        munmap(buf_ring_, kRecvBufs * sizeof(io_uring_buf));
+}
+
+bool IoUringPoller::AddFd(int fd, int events, void *data)
+{
+    return Add(fd, events, data, false, false);
+}
+
+bool IoUringPoller::AddListenFd(int fd, int events, void *data)
+{
+    return Add(fd, events, data, true, false);
+}
+
+bool IoUringPoller::AddRecvFd(int fd, int events, void *data)
+{
+    return Add(fd, events, data, false, true);
+}
+
+bool IoUringPoller::ModFd(int fd, int events, void *data)
+{
+    std::lock_guard<std::mutex> locker(mutex_);
+    auto &registration = GetRegistration(fd);
+    if(!registration.is_added)
+    {
+        errno = ENOENT;
+        return false;
+    }
+    // the new request reports what is ready already, nothing is lost by replacing the old one
+    Disarm(fd, registration);
+    registration.events = events;
+    registration.data = data;
+    Arm(fd, registration);
+    SubmitIfNotReactor();
+    return true;
+}
+
+bool IoUringPoller::DelFd(int fd)
+{
+    std::lock_guard<std::mutex> locker(mutex_);
+    auto &registration = GetRegistration(fd);
+    if(!registration.is_added)
+    {
+        errno = ENOENT;
+        return false;
+    }
+    Disarm(fd, registration);
+    registration.is_added = false;
+    registration.is_accept = false;
+    registration.is_recv = false;
+    SubmitIfNotReactor();
+    return true;
+}
+
+int IoUringPoller::Wait(int timeout)
+{
+    reactor_.store(std::this_thread::get_id(), std::memory_order_relaxed);
+    ProvideRecvBufs(); // the data of the last events is handled by now
+    unsigned to_submit = Pending();
+
+    // nothing to submit and completions waiting, no syscall at all
+    if(to_submit > 0 || IsCqEmpty())
+    {
+        __kernel_timespec ts{timeout / 1000, (timeout % 1000) * 1000000LL};
+        io_uring_getevents_arg arg{};
+        arg.ts = timeout >= 0 ? reinterpret_cast<uint64_t>(&ts) : 0;
+        // the entries the kernel does not take stay in the ring for the next enter
+        if(Enter(to_submit, IsCqEmpty() ? 1 : 0, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg)) < 0
+           && errno != ETIME && errno != EBUSY && errno != EAGAIN)
+            return -1;
+    }
+
+    std::lock_guard<std::mutex> locker(mutex_);
+    return Reap();
+}
+
+bool IoUringPoller::Add(int fd, int events, void *data, bool is_accept, bool is_recv)
+{
+    std::lock_guard<std::mutex> locker(mutex_);
+    auto &registration = GetRegistration(fd);
+    if(registration.is_added)
+    {
+        errno = EEXIST;
+        return false;
+    }
+    registration.is_added = true;
+    registration.is_accept = is_accept && is_multishot_accept_;
+    registration.is_recv = is_recv && buf_ring_;
+    registration.events = events;
+    registration.data = data;
+    Arm(fd, registration);
+    SubmitIfNotReactor();
+    return true;
+}
+
+IoUringPoller::Registration &IoUringPoller::GetRegistration(int fd)
+{
+    if(static_cast<std::size_t>(fd) >= registrations_.size())
+        registrations_.resize(std::max<std::size_t>(fd + 1, registrations_.size() * 2));
+    return registrations_[fd];
+}
+
+void IoUringPoller::SetupRecvBufs()
+{
+    std::size_t size = kRecvBufs * sizeof(io_uring_buf);
+    void *buf_ring = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if(buf_ring == MAP_FAILED)
+        return;
+    io_uring_buf_reg reg{};
+    reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring);
+    reg.ring_entries = kRecvBufs;
+    reg.bgid = kRecvBufGroup;
+    if(syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        munmap(buf_ring, size);
+        return;
+    }
+    buf_ring_ = static_cast<io_uring_buf*>(buf_ring);
+    recv_bufs_.resize(static_cast<std::size_t>(kRecvBufs) * kRecvBufSize);
+    used_bufs_.reserve(kRecvBufs);
+    for(unsigned bid = 0; bid < kRecvBufs; ++bid)
+        used_bufs_.push_back(bid);
+    ProvideRecvBufs();
+}
+
+// only the thread of the reactor touches the ring, the kernel takes from its head
+void IoUringPoller::ProvideRecvBufs()
+{
+    if(used_bufs_.empty())
+        return;
+    for(uint16_t bid : used_bufs_)
+    {
+        io_uring_buf &buf = buf_ring_[buf_tail_++ & (kRecvBufs - 1)];
+        buf.addr = reinterpret_cast<uint64_t>(recv_bufs_.data() + static_cast<std::size_t>(bid) * kRecvBufSize);
+        buf.len = kRecvBufSize;
+        buf.bid = bid;
+    }
+    __atomic_store_n(&reinterpret_cast<io_uring_buf_ring*>(buf_ring_)->tail, buf_tail_, __ATOMIC_RELEASE); // over the first entry
+    used_bufs_.clear();
+}
+
+void IoUringPoller::Arm(int fd, Registration &registration)
+{
+    io_uring_sqe sqe{};
+    sqe.opcode = IORING_OP_POLL_ADD;
+    sqe.fd = fd;
+    sqe.user_data = UserData(fd, registration.generation);
+    uint32_t oneshot_in = EPOLLONESHOT | EPOLLIN;
+    if(registration.is_accept)
+    {
+        // every connection is a completion, the reactor never calls accept
+        sqe.opcode = IORING_OP_ACCEPT;
+        sqe.ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe.accept_flags = SOCK_NONBLOCK;
+    }else if(registration.is_recv && (registration.events & (oneshot_in | EPOLLOUT)) == oneshot_in)
+    {
+        // the data comes with the completion, the reactor never calls readv for most requests
+        sqe.opcode = IORING_OP_RECV;
+        sqe.flags = IOSQE_BUFFER_SELECT;
+        sqe.buf_group = kRecvBufGroup;
+        sqe.len = kRecvBufSize;
+    }else if(registration.events & EPOLLONESHOT)
+    {
+        // checks the readiness once armed, as epoll_ctl arming a one shot fd again
+        sqe.poll32_events = registration.events & ~(EPOLLONESHOT | EPOLLET);
+    }else
+    {
+        sqe.len = IORING_POLL_ADD_MULTI;
+        sqe.poll32_events = registration.events;
+    }
+    Push(sqe);
+    registration.is_armed = true;
+    registration.opcode = sqe.opcode;
+}
+
+void IoUringPoller::Disarm(int fd, Registration &registration)
+{
+    if(!registration.is_armed)
+        return;
+    io_uring_sqe sqe{};
+    sqe.opcode = registration.opcode == IORING_OP_POLL_ADD ? IORING_OP_POLL_REMOVE : IORING_OP_ASYNC_CANCEL;
+    sqe.fd = -1;
+    sqe.addr = UserData(fd, registration.generation);
+    sqe.user_data = kRemoveData;
+    Push(sqe);
+    ++registration.generation; // a completion of the old request still on its way is dropped
+    registration.is_armed = false;
+}
+
+void IoUringPoller::Push(const io_uring_sqe &sqe)
+{
+    while(Pending() == sq_entries_)
+    {
+        Submit(); // full, the kernel takes them now
+        if(Pending() == sq_entries_)
+            std::this_thread::yield();
+    }
+    unsigned tail = *sq_tail_;
+    sqes_[tail & sq_mask_] = sqe;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+}
+
+// the kernel takes at most the entries in the ring, so a count also taken by another enter meanwhile is harmless
+void IoUringPoller::Submit()
+{
+    unsigned to_submit = Pending();
+    if(to_submit > 0)
+        Enter(to_submit, 0, 0, nullptr, 0);
+}
+
+void IoUringPoller::SubmitIfNotReactor()
+{
+    if(reactor_.load(std::memory_order_relaxed) != std::this_thread::get_id())
+        Submit();
+}
+
+int IoUringPoller::Reap()
+{
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    int count = 0;
+    for(; head != tail && count < max_event_; ++head)
+    {
+        const io_uring_cqe &cqe = cqes_[head & cq_mask_];
+        if(cqe.user_data == kRemoveData)
+            continue;
+        if(cqe.flags & IORING_CQE_F_BUFFER)
+            used_bufs_.push_back(cqe.flags >> IORING_CQE_BUFFER_SHIFT); // delivered or dropped, back by the next Wait
+        int fd = static_cast<int>(cqe.user_data & 0xffffffff);
+        auto &registration = registrations_[fd];
+        if(!registration.is_added || static_cast<uint32_t>(cqe.user_data >> 32) != registration.generation)
+            continue; // replaced or removed
+        bool is_more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+        if(!is_more)
+            registration.is_armed = false;
+        if(cqe.res == -ECANCELED)
+            continue;
+        Event &event = events_[count];
+        event.event.data.ptr = registration.data;
+        event.accepted_fd = -1;
+        event.received = nullptr;
+        event.received_len = 0;
+        if(registration.opcode == IORING_OP_ACCEPT)
+        {
+            if(!is_more && cqe.res == -EINVAL)
+            {
+                // the kernel lacks multishot accept, the socket is polled and accepted by the reactor
+                is_multishot_accept_ = false;
+                registration.is_accept = false;
+                Arm(fd, registration);
+                continue;
+            }
+            // ended by the kernel, on an error of an accept for one, it is made again
+            if(!is_more)
+                Arm(fd, registration);
+            if(cqe.res < 0)
+                continue;
+            event.event.events = EPOLLIN;
+            event.accepted_fd = cqe.res;
+        }else if(registration.opcode == IORING_OP_RECV)
+        {
+            if(cqe.res > 0 && (cqe.flags & IORING_CQE_F_BUFFER))
+            {
+                event.event.events = EPOLLIN;
+                event.received = recv_bufs_.data() + static_cast<std::size_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT) * kRecvBufSize;
+                event.received_len = cqe.res;
+            }else if(cqe.res == 0)
+                event.event.events = EPOLLIN | EPOLLRDHUP; // closed by the peer
+            else if(cqe.res == -ENOBUFS)
+            {
+                // the ring is empty, wait for the readiness alone this time, the reactor reads the socket itself
+                registration.is_recv = false;
+                Arm(fd, registration);
+                registration.is_recv = true;
+                continue;
+            }else
+                event.event.events = EPOLLERR;
+        }else
+        {
+            event.event.events = cqe.res < 0 ? EPOLLERR : static_cast<uint32_t>(cqe.res);
+            // a multishot request ended by the kernel, on overflow for one, is made again
+            if(!is_more && !(registration.events & EPOLLONESHOT) && cqe.res >= 0)
+                Arm(fd, registration);
+        }
+        ++count;
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    return count;
+}
+
+int IoUringPoller::Enter(unsigned to_submit, unsigned min_complete, unsigned flags, const void *arg, std::size_t arg_size)
+{
+    return syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete, flags, arg, arg_size);
+}
+
+} // namespace white
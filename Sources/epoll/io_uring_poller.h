@@ -0,0 +1,182 @@
+#ifndef WHITEWEBSERVER_EPOLL_IO_URING_POLLER_H_
+#define WHITEWEBSERVER_EPOLL_IO_URING_POLLER_H_
+
+#include "epoll/poller.h"
+
+#include <linux/io_uring.h>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace white {
+
+/**
+ * @brief Poller on io_uring by the raw syscalls. Every fd is watched by a poll request, a one shot one for
+ * EPOLLONESHOT and a multishot one otherwise, so arming a fd again is a submission queue entry instead of an
+ * epoll_ctl. The entries queued by the reactor thread go to the kernel together with the next Wait in a single
+ * io_uring_enter, the ones from other threads right away, since the reactor may be blocked waiting.
+ *
+ * A listening socket is watched by a multishot accept instead, each connection accepted coming as an event. A fd
+ * added by AddRecvFd and armed one shot for EPOLLIN alone is watched by a recv into a buffer the kernel picks from
+ * a ring provided by the poller, the data coming with the event. The buffers delivered by a Wait are given back to
+ * the ring by the next one. Either falls back to a poll request if the kernel lacks it.
+ *
+ * A fd is identified in the completions by its number and a generation bumped whenever its request is replaced,
+ * so the completions of the requests removed, or of a closed fd whose number is reused, are dropped.
+ */
+class IoUringPoller : public Poller
+{
+public:
+    IoUringPoller(unsigned entries = 4096, int max_event = 10000);
+    ~IoUringPoller() override;
+
+    /**
+     * @brief Return true if the ring is set up, false if the kernel lacks io_uring or the features needed.
+     *
+     * @return true
+     * @return false
+     */
+    bool IsValid() const;
+
+    bool AddFd(int fd, int events, void *data) override;
+    bool AddListenFd(int fd, int events, void *data) override;
+    bool AddRecvFd(int fd, int events, void *data) override;
+    bool ModFd(int fd, int events, void *data) override;
+    bool DelFd(int fd) override;
+    int Wait(int timeout = -1) override;
+    void *GetEventData(std::size_t index) const override;
+    int GetEvents(std::size_t index) const override;
+    int GetAcceptedFd(std::size_t index) const override;
+    std::string_view GetReceived(std::size_t index, bool *is_more) const override;
+    bool IsIoUring() const override;
+
+private:
+    struct Registration
+    {
+        uint32_t generation = 0;
+        int events = 0;
+        void *data = nullptr; // handed back with the events
+        bool is_added = false;
+        bool is_accept = false; // a listening socket, accepted by a multishot accept
+        bool is_recv = false; // received by a recv when armed one shot for EPOLLIN alone
+        bool is_armed = false; // a request is in flight or its completion is not reaped yet
+        uint8_t opcode = IORING_OP_POLL_ADD; // of the request armed last
+    };
+
+    struct Event
+    {
+        epoll_event event;
+        int accepted_fd;
+        const char *received;
+        uint32_t received_len;
+    };
+
+    static constexpr uint64_t kRemoveData = ~0ULL; // the completions of the removals, dropped
+    static constexpr unsigned kRecvBufs = 256; // a power of two
+    static constexpr uint32_t kRecvBufSize = 4096; // most requests in one
+    static constexpr uint16_t kRecvBufGroup = 0;
+
+private:
+    bool Add(int fd, int events, void *data, bool is_accept, bool is_recv);
+    Registration &GetRegistration(int fd);
+
+    void SetupRecvBufs();
+    void ProvideRecvBufs(); // give the buffers used back to the ring
+
+    // with mutex_ held
+    void Arm(int fd, Registration &registration);
+    void Disarm(int fd, Registration &registration);
+    void Push(const io_uring_sqe &sqe);
+    void Submit();
+    void SubmitIfNotReactor();
+    int Reap();
+
+    unsigned Pending() const; // entries queued, not taken by the kernel yet
+    bool IsCqEmpty() const;
+    int Enter(unsigned to_submit, unsigned min_complete, unsigned flags, const void *arg, std::size_t arg_size);
+
+    static uint64_t UserData(int fd, uint32_t generation);
+
+private:
+    int ring_fd_;
+    void *ring_;
+    std::size_t ring_size_;
+    io_uring_sqe *sqes_;
+    std::size_t sqes_size_;
+
+    unsigned *sq_head_;
+    unsigned *sq_tail_;
+    unsigned sq_mask_;
+    unsigned sq_entries_;
+    unsigned *cq_head_;
+    unsigned *cq_tail_;
+    unsigned cq_mask_;
+    io_uring_cqe *cqes_;
+
+    std::mutex mutex_; // the tail of the submission queue and the registrations
+    std::vector<Registration> registrations_; // indexed by fd
+    std::atomic<std::thread::id> reactor_; // the thread in Wait
+
+    // of the recv buffers, null if the kernel lacks it. Indexed as the array it is, the bufs member of io_uring_buf_ring
+    // starts past an empty struct, which takes a byte in C++
+    io_uring_buf *buf_ring_;
+    std::vector<char> recv_bufs_;
+    std::vector<uint16_t> used_bufs_; // picked by the kernel since the last Wait, by their ids
+    uint16_t buf_tail_;
+    bool is_multishot_accept_; // cleared if the kernel lacks it
+
+    std::vector<Event> events_;
+    int max_event_;
+};
+
+inline bool IoUringPoller::IsValid() const
+{
+    return ring_fd_ >= 0;
+}
+
+inline void *IoUringPoller::GetEventData(std::size_t index) const
+{
+    return events_[index].event.data.ptr;
+}
+
+inline int IoUringPoller::GetEvents(std::size_t index) const
+{
+    return events_[index].event.events;
+}
+
+inline int IoUringPoller::GetAcceptedFd(std::size_t index) const
+{
+    return events_[index].accepted_fd;
+}
+
+inline std::string_view IoUringPoller::GetReceived(std::size_t index, bool *is_more) const
+{
+    *is_more = events_[index].received_len == kRecvBufSize;
+    return {events_[index].received, events_[index].received_len};
+}
+
+inline bool IoUringPoller::IsIoUring() const
+{
+    return true;
+}
+
+inline uint64_t IoUringPoller::UserData(int fd, uint32_t generation)
+{
+    return (static_cast<uint64_t>(generation) << 32) | static_cast<uint32_t>(fd);
+}
+
+inline unsigned IoUringPoller::Pending() const
+{
+    return __atomic_load_n(sq_tail_, __ATOMIC_ACQUIRE) - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+}
+
+inline bool IoUringPoller::IsCqEmpty() const
+{
+    return *cq_head_ == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+}
+
+} // namespace white
+
+#endif
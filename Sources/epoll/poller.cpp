@@ -0,0 +1,20 @@
+#include "epoll/poller.h"
+#include "epoll/epoll.h"
+#include "epoll/io_uring_poller.h"
+#include "logger/logger.h"
+
+namespace white {
+
+std::unique_ptr<Poller> Poller::Create(bool is_io_uring)
+{
+    if(is_io_uring)
+    {
+        auto poller = std::make_unique<IoUringPoller>();
+        if(poller->IsValid())
+            return poller;
+        LOG_WARN("io_uring unavailable, falling back to epoll");
+    }
+    return std::make_unique<Epoll>();
+}
+
+} // namespace white
@@ -0,0 +1,93 @@
+#ifndef WHITEWEBSERVER_EPOLL_POLLER_H_
+#define WHITEWEBSERVER_EPOLL_POLLER_H_
+
+#include <sys/epoll.h>
+#include <cstddef>
+#include <memory>
+#include <string_view>
+
+namespace white {
+
+/**
+ * @brief The readiness events of the reactors, taking the epoll flags whatever the backend. A fd added with
+ * EPOLLONESHOT reports once, then waits for ModFd to be armed again. Each event carries the data pointer the fd
+ * was last added or modified with, as epoll_event.data.ptr.
+ *
+ * AddFd, ModFd and DelFd may be called from any thread, Wait only from the thread of the reactor.
+ */
+class Poller
+{
+public:
+    virtual ~Poller() = default;
+
+    virtual bool AddFd(int fd, int events, void *data) = 0;
+
+    /**
+     * @brief Add a listening socket. The io_uring poller accepts its connections itself, an event then carries
+     * one of them, see GetAcceptedFd. Epoll reports the socket readable, the caller accepts.
+     *
+     * @param fd
+     * @param events
+     * @param data
+     * @return true
+     * @return false
+     */
+    virtual bool AddListenFd(int fd, int events, void *data) = 0;
+
+    /**
+     * @brief Add a socket whose data the io_uring poller receives along with the EPOLLIN of a one shot arm,
+     * see GetReceived. Epoll only reports the readiness. The data is lost if such an arm is replaced or removed
+     * before its event, so only a fd owned by no thread meanwhile may be armed that way.
+     *
+     * @param fd
+     * @param events
+     * @param data
+     * @return true
+     * @return false
+     */
+    virtual bool AddRecvFd(int fd, int events, void *data) = 0;
+    virtual bool ModFd(int fd, int events, void *data) = 0;
+    virtual bool DelFd(int fd) = 0;
+
+    /**
+     * @brief Wait for the events.
+     *
+     * @param timeout milliseconds, -1 for no timeout
+     * @return int the number of events, -1 on error with errno set
+     */
+    virtual int Wait(int timeout = -1) = 0;
+
+    virtual void *GetEventData(std::size_t index) const = 0;
+    virtual int GetEvents(std::size_t index) const = 0;
+
+    /**
+     * @brief The connection accepted by an event of a listening socket, with SOCK_NONBLOCK.
+     *
+     * @param index
+     * @return int -1 if the socket is only reported readable
+     */
+    virtual int GetAcceptedFd(std::size_t index) const = 0;
+
+    /**
+     * @brief The data received by an EPOLLIN event, valid until the next Wait.
+     *
+     * @param index
+     * @param is_more set if the data filled the buffer, so the socket may hold more
+     * @return std::string_view empty if the socket is only reported readable
+     */
+    virtual std::string_view GetReceived(std::size_t index, bool *is_more) const = 0;
+
+    virtual bool IsIoUring() const = 0;
+
+    /**
+     * @brief Create the poller of a reactor.
+     *
+     * @param is_io_uring io_uring if the kernel supports it, else epoll
+     * @return std::unique_ptr<Poller>
+     */
+    static std::unique_ptr<Poller> Create(bool is_io_uring);
+};
+
+} // namespace white
+
+#endif
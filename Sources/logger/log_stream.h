@@ -2,6 +2,7 @@
 #define WHITEWEBSERVER_LOGGER_LOG_STREAM_H_
 
 #include <string>
+#include <string_view>
 #include <memory>
 #include "buffer/buffer.h"
 #include "logger/noncopyable.h"
@@ -36,6 +37,7 @@ public:
     LogStream& operator<<(char v);
     LogStream& operator<<(const char *v);
     LogStream& operator<<(const std::string &v);
+    LogStream& operator<<(std::string_view v);
     LogStream& operator<<(const Json::Value &v);
 
 private:
@@ -154,6 +156,12 @@ inline LogStream& LogStream::operator<<(const std::string &v)
     return *this;
 }
 
+inline LogStream& LogStream::operator<<(std::string_view v)
+{
+    buffer_.Append(v.data(), v.size());
+    return *this;
+}
+
 inline LogStream& LogStream::operator<<(const Json::Value &v)
 {
     buffer_.Append(fast_writer_.write(v));
@@ -1,6 +1,7 @@
 #include "server/http_server.h"
 #include "config/config_parser.h"
 #include <unistd.h>
+#include <algorithm>
 #include <filesystem>
 #include <sys/wait.h>
 #include <signal.h>
@@ -54,13 +55,26 @@ int main(int argc, char* argv[])
         return 1;
     }
     
-    AddSig(SIGCHLD, HandleChild);
+    // the servers on the same address and port share one process, told apart by the Host header
+    std::vector<std::vector<white::Config>> listeners;
     for(const auto &config : configs)
+    {
+        auto listener = std::find_if(listeners.begin(), listeners.end(), [&config](const std::vector<white::Config> &sites) {
+            return sites.front().Port() == config.Port() && sites.front().Address().s_addr == config.Address().s_addr;
+        });
+        if(listener == listeners.end())
+            listeners.emplace_back(1, config);
+        else
+            listener->push_back(config);
+    }
+
+    AddSig(SIGCHLD, HandleChild);
+    for(const auto &sites : listeners)
     {
         if(fork() == 0)
         {
             prctl(PR_SET_PDEATHSIG, SIGTERM); // kill child when parent exit
-            white::HttpServer server(config);
+            white::HttpServer server(sites);
             server.Run();
             return 0;
         }
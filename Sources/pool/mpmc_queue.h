@@ -0,0 +1,135 @@
+#ifndef WHITEWEBSERVER_POOL_MPMC_QUEUE_H_
+#define WHITEWEBSERVER_POOL_MPMC_QUEUE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace white {
+
+/**
+ * @brief A bounded lock-free multi-producer multi-consumer queue, each cell carries a sequence number
+ * to tell producers and consumers whose turn it is.
+ *
+ * https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+ *
+ * @tparam T
+ */
+template<typename T>
+class MpmcQueue
+{
+public:
+    MpmcQueue(std::size_t capacity = 1024);
+    ~MpmcQueue();
+
+    /**
+     * @brief Return false if the queue is full.
+     *
+     * @param item
+     * @return true
+     * @return false
+     */
+    bool Push(T item);
+
+    /**
+     * @brief Return false if the queue is empty.
+     *
+     * @param item
+     * @return true
+     * @return false
+     */
+    bool Pop(T &item);
+
+    bool Empty() const;
+
+private:
+    struct Cell
+    {
+        std::atomic<std::size_t> sequence;
+        T data;
+    };
+
+private:
+    std::size_t mask_;
+    std::unique_ptr<Cell[]> buffer_;
+    alignas(64) std::atomic<std::size_t> enqueue_pos_;
+    alignas(64) std::atomic<std::size_t> dequeue_pos_;
+};
+
+template<typename T>
+inline MpmcQueue<T>::MpmcQueue(std::size_t capacity) :
+enqueue_pos_(0),
+dequeue_pos_(0)
+{
+    std::size_t real_capacity = 2;
+    while(real_capacity < capacity)
+        real_capacity <<= 1;
+    mask_ = real_capacity - 1;
+    buffer_.reset(new Cell[real_capacity]);
+    for(std::size_t i = 0; i < real_capacity; ++i)
+        buffer_[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+template<typename T>
+inline MpmcQueue<T>::~MpmcQueue()
+{
+
+}
+
+template<typename T>
+inline bool MpmcQueue<T>::Push(T item)
+{
+    Cell *cell;
+    std::size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    while(true)
+    {
+        cell = &buffer_[pos & mask_];
+        std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if(diff == 0)
+        {
+            if(enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }else if(diff < 0) // full
+            return false;
+        else
+            pos = enqueue_pos_.load(std::memory_order_relaxed);
+    }
+    cell->data = item;
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename T>
+inline bool MpmcQueue<T>::Pop(T &item)
+{
+    Cell *cell;
+    std::size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    while(true)
+    {
+        cell = &buffer_[pos & mask_];
+        std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+        if(diff == 0)
+        {
+            if(dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }else if(diff < 0) // empty
+            return false;
+        else
+            pos = dequeue_pos_.load(std::memory_order_relaxed);
+    }
+    item = cell->data;
+    cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename T>
+inline bool MpmcQueue<T>::Empty() const
+{
+    return dequeue_pos_.load(std::memory_order_acquire) >= enqueue_pos_.load(std::memory_order_acquire);
+}
+
+} // namespace white
+
+#endif
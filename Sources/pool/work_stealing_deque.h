@@ -0,0 +1,134 @@
+#ifndef WHITEWEBSERVER_POOL_WORK_STEALING_DEQUE_H_
+#define WHITEWEBSERVER_POOL_WORK_STEALING_DEQUE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace white {
+
+/**
+ * @brief A bounded Chase-Lev deque. The owner thread pushes and pops at the bottom,
+ * other threads steal from the top. No locks are taken on any path.
+ *
+ * Correct and Efficient Work-Stealing for Weak Memory Models (Le et al., PPoPP'13)
+ *
+ * @tparam T must be trivially copyable, usually a pointer.
+ */
+template<typename T>
+class WorkStealingDeque
+{
+public:
+    WorkStealingDeque(std::size_t capacity = 1024);
+    ~WorkStealingDeque();
+
+    /**
+     * @brief Push at the bottom, owner only. Return false if the deque is full.
+     *
+     * @param item
+     * @return true
+     * @return false
+     */
+    bool Push(T item);
+
+    /**
+     * @brief Pop from the bottom, owner only.
+     *
+     * @param item
+     * @return true
+     * @return false
+     */
+    bool Pop(T &item);
+
+    /**
+     * @brief Steal from the top, can be called by any thread.
+     *
+     * @param item
+     * @return true
+     * @return false
+     */
+    bool Steal(T &item);
+
+    bool Empty() const;
+
+private:
+    std::size_t mask_;
+    std::unique_ptr<std::atomic<T>[]> buffer_;
+    alignas(64) std::atomic<int64_t> top_;
+    alignas(64) std::atomic<int64_t> bottom_;
+};
+
+template<typename T>
+inline WorkStealingDeque<T>::WorkStealingDeque(std::size_t capacity) :
+top_(0),
+bottom_(0)
+{
+    std::size_t real_capacity = 1;
+    while(real_capacity < capacity)
+        real_capacity <<= 1;
+    mask_ = real_capacity - 1;
+    buffer_.reset(new std::atomic<T>[real_capacity]);
+}
+
+template<typename T>
+inline WorkStealingDeque<T>::~WorkStealingDeque()
+{
+
+}
+
+template<typename T>
+inline bool WorkStealingDeque<T>::Push(T item)
+{
+    int64_t bottom = bottom_.load(std::memory_order_relaxed);
+    int64_t top = top_.load(std::memory_order_acquire);
+    if(bottom - top > static_cast<int64_t>(mask_))
+        return false;
+    buffer_[bottom & mask_].store(item, std::memory_order_relaxed);
+    bottom_.store(bottom + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename T>
+inline bool WorkStealingDeque<T>::Pop(T &item)
+{
+    int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+    bottom_.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = top_.load(std::memory_order_relaxed);
+    if(top > bottom) // empty
+    {
+        bottom_.store(bottom + 1, std::memory_order_relaxed);
+        return false;
+    }
+    item = buffer_[bottom & mask_].load(std::memory_order_relaxed);
+    if(top == bottom)
+    {
+        // the last one, race with thieves
+        bool won = top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        bottom_.store(bottom + 1, std::memory_order_relaxed);
+        return won;
+    }
+    return true;
+}
+
+template<typename T>
+inline bool WorkStealingDeque<T>::Steal(T &item)
+{
+    int64_t top = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t bottom = bottom_.load(std::memory_order_acquire);
+    if(top >= bottom)
+        return false;
+    item = buffer_[top & mask_].load(std::memory_order_relaxed);
+    return top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+template<typename T>
+inline bool WorkStealingDeque<T>::Empty() const
+{
+    return top_.load(std::memory_order_acquire) >= bottom_.load(std::memory_order_acquire);
+}
+
+} // namespace white
+
+#endif
@@ -0,0 +1,206 @@
+#ifndef WHITEWEBSERVER_POOL_WORK_STEALING_POOL_H_
+#define WHITEWEBSERVER_POOL_WORK_STEALING_POOL_H_
+
+#include "pool/work_stealing_deque.h"
+#include "pool/mpmc_queue.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace white {
+
+/**
+ * @brief A thread pool where every worker owns its own queues, and idle workers steal from the others.
+ *
+ * Tasks added by a worker go to its own Chase-Lev deque, tasks added by other threads (the reactor)
+ * are spread over the workers' inboxes in round robin. A worker parks on its own condition variable
+ * only after finding nothing to do, and AddTask only touches a lock when some worker is parked.
+ */
+class WorkStealingPool
+{
+    using Task = std::function<void()>;
+
+public:
+    WorkStealingPool(std::size_t thread_num = std::thread::hardware_concurrency());
+    ~WorkStealingPool();
+
+    template<typename F> // template for std::forward
+    void AddTask(F &&task);
+
+private:
+    struct alignas(64) Worker
+    {
+        WorkStealingDeque<Task*> local_tasks; // tasks added by the worker itself
+        MpmcQueue<Task*> inbox; // tasks added by other threads
+        std::mutex park_mutex;
+        std::condition_variable park_cond;
+        std::atomic<bool> is_parked{false};
+    };
+
+private:
+    void Run(std::size_t index);
+
+    Task *FindTask(std::size_t index);
+    bool HasTask() const;
+
+    void Park(std::size_t index);
+    void UnparkOne(std::size_t start);
+
+private:
+    static constexpr int kSpinRounds = 64;
+
+    static inline thread_local WorkStealingPool *current_pool_ = nullptr;
+    static inline thread_local std::size_t current_index_ = 0;
+
+private:
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+    std::atomic<std::size_t> next_worker_;
+    std::atomic<int> parked_count_;
+    std::atomic<bool> is_close_;
+};
+
+inline WorkStealingPool::WorkStealingPool(std::size_t thread_num) :
+next_worker_(0),
+parked_count_(0),
+is_close_(false)
+{
+    if(thread_num == 0)
+        thread_num = 1;
+    workers_.reserve(thread_num);
+    for(std::size_t i = 0; i < thread_num; ++i)
+        workers_.emplace_back(new Worker());
+    threads_.reserve(thread_num);
+    for(std::size_t i = 0; i < thread_num; ++i)
+        threads_.emplace_back(&WorkStealingPool::Run, this, i);
+}
+
+inline WorkStealingPool::~WorkStealingPool()
+{
+    is_close_.store(true);
+    for(auto &worker : workers_)
+    {
+        std::lock_guard<std::mutex> locker(worker->park_mutex);
+        worker->is_parked.store(false);
+        worker->park_cond.notify_one();
+    }
+    for(auto &thread : threads_)
+        thread.join();
+    Task *task;
+    for(auto &worker : workers_)
+    {
+        while(worker->local_tasks.Pop(task))
+            delete task;
+        while(worker->inbox.Pop(task))
+            delete task;
+    }
+}
+
+template<typename F>
+inline void WorkStealingPool::AddTask(F &&task)
+{
+    Task *new_task = new Task(std::forward<F>(task));
+    std::size_t start = next_worker_.fetch_add(1, std::memory_order_relaxed);
+    if(!(current_pool_ == this && workers_[current_index_]->local_tasks.Push(new_task)))
+    {
+        std::size_t n = workers_.size();
+        for(std::size_t i = 0; !workers_[(start + i) % n]->inbox.Push(new_task); ++i)
+            if(i % n == n - 1) // every inbox is full
+                std::this_thread::yield();
+    }
+    // pairs with the fence in Park: either the parked worker sees the task, or we see it parked.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(parked_count_.load(std::memory_order_relaxed) > 0)
+        UnparkOne(start);
+}
+
+inline void WorkStealingPool::Run(std::size_t index)
+{
+    current_pool_ = this;
+    current_index_ = index;
+    while(true)
+    {
+        Task *task = FindTask(index);
+        for(int spin = 0; !task && spin < kSpinRounds; ++spin)
+        {
+            std::this_thread::yield();
+            task = FindTask(index);
+        }
+        if(task)
+        {
+            (*task)();
+            delete task;
+            continue;
+        }
+        if(is_close_.load(std::memory_order_acquire))
+            break;
+        Park(index);
+    }
+}
+
+inline WorkStealingPool::Task *WorkStealingPool::FindTask(std::size_t index)
+{
+    Task *task;
+    Worker &self = *workers_[index];
+    if(self.local_tasks.Pop(task) || self.inbox.Pop(task))
+        return task;
+    std::size_t n = workers_.size();
+    for(std::size_t i = 1; i < n; ++i)
+    {
+        Worker &victim = *workers_[(index + i) % n];
+        if(victim.inbox.Pop(task) || victim.local_tasks.Steal(task))
+            return task;
+    }
+    return nullptr;
+}
+
+inline bool WorkStealingPool::HasTask() const
+{
+    for(auto &worker : workers_)
+        if(!worker->inbox.Empty() || !worker->local_tasks.Empty())
+            return true;
+    return false;
+}
+
+inline void WorkStealingPool::Park(std::size_t index)
+{
+    Worker &self = *workers_[index];
+    std::unique_lock<std::mutex> locker(self.park_mutex);
+    self.is_parked.store(true);
+    parked_count_.fetch_add(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(HasTask() || is_close_.load())
+    {
+        if(self.is_parked.exchange(false))
+            parked_count_.fetch_sub(1);
+        return;
+    }
+    self.park_cond.wait(locker, [&self]{ return !self.is_parked.load(); });
+}
+
+inline void WorkStealingPool::UnparkOne(std::size_t start)
+{
+    std::size_t n = workers_.size();
+    for(std::size_t i = 0; i < n; ++i)
+    {
+        Worker &worker = *workers_[(start + i) % n];
+        if(!worker.is_parked.load())
+            continue;
+        std::lock_guard<std::mutex> locker(worker.park_mutex);
+        if(worker.is_parked.exchange(false))
+        {
+            parked_count_.fetch_sub(1);
+            worker.park_cond.notify_one();
+            return;
+        }
+    }
+}
+
+} // namespace white
+
+#endif
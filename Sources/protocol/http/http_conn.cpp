@@ -7,18 +7,41 @@
 #include "logger/logger.h"
 
 #include "fcntl.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <functional>
+#include <sys/sendfile.h>
 
 namespace white {
 
 std::string HttpConn::web_root = "";
 std::atomic_size_t HttpConn::user_count = 0;
+bool HttpConn::is_sendfile = true;
+std::shared_ptr<OpenFileCache> HttpConn::open_file_cache = nullptr;
+std::shared_ptr<HotObjectCache> HttpConn::hot_object_cache = nullptr;
+std::shared_ptr<PipePool> HttpConn::pipe_pool = nullptr;
+std::shared_ptr<ProxyCache> HttpConn::proxy_cache = nullptr;
+thread_local std::vector<std::unique_ptr<HttpConn::Exchange>> HttpConn::free_exchanges_;
 
 HttpConn::HttpConn() : 
 fd_(-1), 
 address_({}), 
 is_close_(true), 
-read_buff_(2048), 
-write_buff_(2048)
+received_(0),
+is_received_more_(false),
+is_keepalive_(false),
+is_upstream_connecting_(false),
+upstream_index_(-1),
+path_hash_(0),
+pipe_bytes_(0),
+upstream_{},
+cache_store_{},
+exchange_(nullptr),
+pending_begin_(0),
+pending_count_(0),
+site_(nullptr),
+location_(nullptr)
 {
 
 }
@@ -28,26 +51,82 @@ HttpConn::~HttpConn()
     Close();
 }
 
-void HttpConn::Init(int fd, const sockaddr_in& addr, int proxt_fd, std::shared_ptr<std::vector<std::string>> index_file)
+void HttpConn::Init(int fd, const sockaddr_in& addr, int proxt_fd, std::shared_ptr<const VirtualHosts> hosts)
 {
     ++user_count;
     address_ = addr;
     fd_ = fd;
     proxy_fd_ = proxt_fd;
     proxy_process_state_ = PROXY_PROCESS_STATE::PENDING_READ_FROM_CLIENT;
+    is_keepalive_ = false;
+    is_upstream_connecting_ = false;
+    upstream_index_ = -1;
+    ClearPending();
     write_buff_.Clear();
-    read_buff_.Clear();
+    proxy_buff_.Clear();
+    upstream_ = {};
     is_close_ = false;
-    index_file_ = index_file;
+    received_ = 0;
+    is_received_more_ = false;
+    hosts_ = std::move(hosts);
+    site_ = &hosts_->Default();
+    location_ = &site_->router->Default();
     LOG_INFO("Client[", fd_, "](",GetIP(), GetPort(), ") connected, current userCount: ", user_count.load());
 }
 
+HttpConn::Exchange::Exchange() : read_buff(kReadBuffSize), pending{}, iov{}
+{
+
+}
+
+HttpConn::Exchange *HttpConn::AcquireExchange()
+{
+    if(free_exchanges_.empty())
+        return new Exchange;
+    Exchange *exchange = free_exchanges_.back().release();
+    free_exchanges_.pop_back();
+    return exchange;
+}
+
+// given back by another thread than the one which took it, an exchange joins the pool of this one
+void HttpConn::ReleaseExchange(Exchange *exchange)
+{
+    if(free_exchanges_.size() >= kMaxFreeExchanges)
+    {
+        delete exchange;
+        return;
+    }
+    exchange->request.Init();
+    exchange->read_buff.Clear();
+    if(exchange->arena.Capacity() > kMaxPooledArena)
+        exchange->arena.Shrink();
+    else
+        exchange->arena.Reset();
+    // a request far larger than the common ones grew the buffer, its memory is not kept for the next one
+    if(exchange->read_buff.WritableBytes() > kMaxPooledReadBuff)
+        exchange->read_buff = Buffer(kReadBuffSize);
+    free_exchanges_.emplace_back(exchange);
+}
+
+void HttpConn::Trim()
+{
+    if(!exchange_ || pending_count_ > 0 || exchange_->read_buff.ReadableBytes() > 0 || pipe_bytes_ > 0
+       || proxy_process_state_ != PROXY_PROCESS_STATE::PENDING_READ_FROM_CLIENT || !cache_store_.flight_key.empty())
+        return;
+    ReleaseExchange(exchange_);
+    exchange_ = nullptr;
+    pending_begin_ = 0;
+    cache_store_ = {}; // the copies kept of the last request stored
+}
+
 ssize_t HttpConn::ReadFromFd(int fd, int *err)
 {
+    if(!exchange_)
+        exchange_ = AcquireExchange();
     ssize_t len;
     do
     {
-        len = read_buff_.ReadFromFd(fd, err);
+        len = exchange_->read_buff.ReadFromFd(fd, err);
         if(len <= 0)
             break;
     } while(true);
@@ -57,87 +136,444 @@ ssize_t HttpConn::ReadFromFd(int fd, int *err)
 ssize_t HttpConn::WriteToFd(int fd, int *err)
 {
     ssize_t len;
-    ssize_t total_len = 0;  
-    do
+    ssize_t total_len = 0;
+    while(pending_count_ > 0)
     {
-        len = writev(fd, iov_, iov_cnt_);
-        total_len += len;
-        if (len <= 0)
+        // gather the heads and the bodies in memory, until a file to be sent by sendfile
+        int iov_cnt = 0;
+        bool is_file_next = false;
+        std::size_t head_offset = 0;
+        for(int i = 0; i < pending_count_ && !is_file_next && iov_cnt < kMaxIovecs; ++i)
         {
-            *err = errno;
-            return len;
+            auto &pending = exchange_->pending[(pending_begin_ + i) % kMaxPipelined];
+            if(pending.head_remain)
+            {
+                std::size_t covered;
+                iov_cnt += write_buff_.Iovecs(exchange_->iov + iov_cnt, kMaxIovecs - iov_cnt, head_offset, pending.head_remain, &covered);
+                head_offset += pending.head_remain;
+                if(covered < pending.head_remain)
+                    break; // the rest goes with the next writev
+            }
+            if(pending.body_remain)
+            {
+                if(iov_cnt == kMaxIovecs)
+                    break;
+                exchange_->iov[iov_cnt].iov_base = const_cast<char*>(pending.body);
+                exchange_->iov[iov_cnt++].iov_len = pending.body_remain;
+            }
+            is_file_next = pending.file_remain > 0;
         }
-        if(iov_[0].iov_len + iov_[1].iov_len == 0) // nothing to write
-            break;
-        else if(static_cast<std::size_t>(len) > iov_[0].iov_len) // the response have been written 
+        if(iov_cnt > 0)
         {
-            // the rest of the file
-            iov_[1].iov_base = iov_[1].iov_base + (len - iov_[0].iov_len);
-            iov_[1].iov_len -= (len - iov_[0].iov_len);
-            if(iov_[0].iov_len)
+            if(is_file_next)
+            {
+                // MSG_MORE keeps the headers from going out alone and waiting for the ack before the file
+                msghdr msg{};
+                msg.msg_iov = exchange_->iov;
+                msg.msg_iovlen = iov_cnt;
+                len = sendmsg(fd, &msg, MSG_MORE);
+            }else
+                len = writev(fd, exchange_->iov, iov_cnt);
+            if (len <= 0)
             {
-                write_buff_.Clear();
-                iov_[0].iov_len = 0;
+                *err = errno;
+                return len;
             }
-        }else
+            total_len += len;
+            ConsumePending(len);
+            continue;
+        }
+        // only the file of the first response remains
+        auto &pending = exchange_->pending[pending_begin_];
+        int file_fd = pending.cache_fd != -1 ? pending.cache_fd : exchange_->responses[pending_begin_].FileFd();
+        len = sendfile(fd, file_fd, &pending.file_offset, pending.file_remain);
+        if(len <= 0)
+        {
+            *err = errno;
+            return len;
+        }
+        total_len += len;
+        pending.file_remain -= len;
+        if(pending.file_remain == 0)
+            PopPending();
+    }
+    // then the body spliced from the upstream
+    while(pipe_bytes_ > 0 && fd == fd_)
+    {
+        len = splice(pipe_.read_fd, nullptr, fd, nullptr, pipe_bytes_, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if(len <= 0)
         {
-            // the rest of the response
-            iov_[0].iov_base = iov_[0].iov_base + len;
-            iov_[0].iov_len -= len;
-            write_buff_.Retrieve(len);
+            *err = errno;
+            return len;
         }
-    } while (true);
+        total_len += len;
+        pipe_bytes_ -= len;
+    }
+    if(pipe_.read_fd != -1 && pipe_bytes_ == 0 && upstream_.is_done)
+        ReleasePipe();
     return total_len;
 }
 
+void HttpConn::ConsumePending(std::size_t len)
+{
+    while(len > 0)
+    {
+        auto &pending = exchange_->pending[pending_begin_];
+        std::size_t n = std::min(len, pending.head_remain);
+        pending.head_remain -= n;
+        write_buff_.Retrieve(n);
+        len -= n;
+        n = std::min(len, pending.body_remain);
+        pending.body += n;
+        pending.body_remain -= n;
+        len -= n;
+        if(pending.head_remain || pending.body_remain || pending.file_remain)
+            break;
+        PopPending();
+    }
+}
+
+int HttpConn::PushPending()
+{
+    int index = (pending_begin_ + pending_count_) % kMaxPipelined;
+    exchange_->pending[index] = {};
+    ++pending_count_;
+    return index;
+}
+
+void HttpConn::PopPending()
+{
+    exchange_->responses[pending_begin_].Close();
+    exchange_->pending[pending_begin_].hot_object.reset();
+    if(exchange_->pending[pending_begin_].cache_fd != -1)
+        close(exchange_->pending[pending_begin_].cache_fd);
+    exchange_->pending[pending_begin_].cache_fd = -1;
+    pending_begin_ = (pending_begin_ + 1) % kMaxPipelined;
+    if(--pending_count_ == 0)
+        exchange_->arena.Reset(); // every request read is answered
+}
+
+void HttpConn::ClearPending()
+{
+    while(pending_count_ > 0)
+        PopPending();
+    pending_begin_ = 0;
+}
+
+void HttpConn::QueueWriteBuffer()
+{
+    std::size_t queued = 0;
+    for(int i = 0; i < pending_count_; ++i)
+        queued += exchange_->pending[(pending_begin_ + i) % kMaxPipelined].head_remain;
+    std::size_t len = write_buff_.ReadableBytes() - queued;
+    // a streamed response is queued piece by piece, join the pieces instead of filling the queue
+    if(pending_count_ > 0)
+    {
+        auto &last = exchange_->pending[(pending_begin_ + pending_count_ - 1) % kMaxPipelined];
+        if(last.body_remain == 0 && last.file_remain == 0)
+        {
+            last.head_remain += len;
+            return;
+        }
+    }
+    exchange_->pending[PushPending()].head_remain = len;
+}
+
 void HttpConn::Close()
 {
-    response_.Close();
+    ClearPending();
+    ReleasePipe();
+    if(proxy_cache)
+        LeaveFlight();
+    cache_store_ = {};
+    if(exchange_)
+    {
+        ReleaseExchange(exchange_);
+        exchange_ = nullptr;
+    }
     if(!is_close_)
     {
         is_close_ = true;
         --user_count;
-        close(fd_);
-        if(proxy_fd_ != -1)
-            close(proxy_fd_);
-        request_.Init();
+        close(fd_); // the connection to the upstream is given back by the server
         LOG_INFO("Client[", fd_, "](",GetIP(), GetPort(), ") disconnected, current userCount: ", user_count.load());
     }
 }
 
+// respond to all the complete requests in the buffer, up to the in-flight limit
 HttpConn::PROCESS_STATE HttpConn::Process()
 {
-    if(request_.IsFinish())
-        request_.Init();
-    if(read_buff_.ReadableBytes() == 0)
-        return PROCESS_STATE::PENDING;
-    auto request_parse_result = request_.Parse(read_buff_);
-    switch(request_parse_result)
+    while(pending_count_ < kMaxPipelined)
     {
-        case HttpRequest::HTTP_CODE::GET_REQUEST:
-            response_.Init(web_root, request_.Path(), index_file_, request_.Version(), request_.IsKeepAlive(), 200);
+        if(exchange_->request.IsFinish())
+            exchange_->request.Init();
+        if(exchange_->read_buff.ReadableBytes() == 0)
             break;
-        case HttpRequest::HTTP_CODE::BAD_REQUEST:
-            response_.Init(web_root, request_.Path(), index_file_, request_.Version(), request_.IsKeepAlive(), 400);
+        auto request_parse_result = exchange_->request.Parse(exchange_->read_buff);
+        if(request_parse_result == HttpRequest::HTTP_CODE::NO_REQUEST)
             break;
-        case HttpRequest::HTTP_CODE::NO_REQUEST:
-            return PROCESS_STATE::PENDING;
+        is_keepalive_ = exchange_->request.IsKeepAlive();
+        if(request_parse_result == HttpRequest::HTTP_CODE::GET_REQUEST && exchange_->request.Method() == "HEAD")
+            request_parse_result = HttpRequest::HTTP_CODE::BAD_REQUEST; // only relayed, a static response always has its body
+        if(request_parse_result == HttpRequest::HTTP_CODE::GET_REQUEST)
+            Route();
+        QueueResponse(request_parse_result);
+        if(request_parse_result != HttpRequest::HTTP_CODE::GET_REQUEST || !is_keepalive_)
+            break; // nothing after it would be answered
+    }
+    return pending_count_ > 0 ? PROCESS_STATE::FINISH : PROCESS_STATE::PENDING;
+}
+
+void HttpConn::QueueResponse(HttpRequest::HTTP_CODE parse_result)
+{
+    int index = PushPending();
+    auto &pending = exchange_->pending[index];
+    auto &response = exchange_->responses[index];
+    std::string_view hot_object_key;
+    switch(parse_result)
+    {
+        case HttpRequest::HTTP_CODE::GET_REQUEST:
+            if(location_->handler == Location::HANDLER::REDIRECT)
+            {
+                std::size_t head_begin = write_buff_.ReadableBytes();
+                QueueRedirect();
+                exchange_->read_buff.Retrieve(exchange_->request.Length());
+                pending.head_remain = write_buff_.ReadableBytes() - head_begin;
+                return;
+            }
+            if(hot_object_cache)
+            {
+                hot_object_key = HotObjectKey();
+                pending.hot_object = hot_object_cache->Get(hot_object_key);
+                if(pending.hot_object)
+                {
+                    exchange_->read_buff.Retrieve(exchange_->request.Length());
+                    QueueHotObject(pending);
+                    return;
+                }
+            }
+            response.Init(exchange_->arena, location_->root, exchange_->request.Path(), site_->index_file, exchange_->request.Version(), exchange_->request.IsKeepAlive(), 200);
             break;
+        case HttpRequest::HTTP_CODE::BAD_REQUEST:
         default:
-            response_.Init(web_root, request_.Path(), index_file_, request_.Version(), request_.IsKeepAlive(), 400);
+            response.Init(exchange_->arena, web_root, exchange_->request.Path(), site_->index_file, exchange_->request.Version(), exchange_->request.IsKeepAlive(), 400);
     }
-    response_.MakeResponse(write_buff_);
-    iov_[0].iov_base = write_buff_.ReadBegin();
-    iov_[0].iov_len = write_buff_.ReadableBytes();
-    iov_cnt_ = 1;
-    if(response_.HasFile())
+    // the response has its own copy of the path, release the request from the buffer, all of it if it is bad
+    if(parse_result == HttpRequest::HTTP_CODE::GET_REQUEST)
+        exchange_->read_buff.Retrieve(exchange_->request.Length());
+    else
+        exchange_->read_buff.Retrieve(exchange_->read_buff.ReadableBytes());
+    std::size_t head_begin = write_buff_.ReadableBytes();
+    response.MakeResponse(write_buff_, is_sendfile, open_file_cache.get());
+    pending.head_remain = write_buff_.ReadableBytes() - head_begin;
+    is_keepalive_ = is_keepalive_ && response.IsKeepAlive(); // closed after an error page
+    if(response.HasFile())
+    {
+        pending.body = response.FileAddr();
+        pending.body_remain = response.FileSize();
+    }else if(response.HasFileFd())
     {
-        iov_[1].iov_base = const_cast<char*>(response_.FileAddr());
-        iov_[1].iov_len = response_.FileSize();
-        iov_cnt_ = 2;
+        pending.file_offset = 0;
+        pending.file_remain = response.FileSize();
     }
-    LOG_DEBUG("File: ", response_.FileSize(), " to be writing");
-    return PROCESS_STATE::FINISH;
+    if(!hot_object_key.empty())
+        CacheHotObject(hot_object_key, response, pending);
+    LOG_DEBUG("File: ", response.FileSize(), " to be writing");
+}
+
+void HttpConn::Route()
+{
+    site_ = &hosts_->Find(exchange_->request.Header("Host"));
+    location_ = &site_->router->Route(exchange_->request.Path());
+}
+
+void HttpConn::QueueRedirect()
+{
+    int code = location_->redirect_code;
+    if(code != 301 && code != 307 && code != 308)
+        code = 302;
+    HttpHeaderBuilder builder(write_buff_);
+    builder.StatusLine(exchange_->request.Version(), code);
+    builder.Date();
+    write_buff_.Append("Location: ", 10);
+    std::string_view target = location_->redirect;
+    for(auto pos = target.find("$uri"); pos != std::string_view::npos; pos = target.find("$uri"))
+    {
+        write_buff_.Append(target.data(), pos);
+        write_buff_.Append(exchange_->request.Path().data(), exchange_->request.Path().size());
+        target.remove_prefix(pos + 4);
+    }
+    write_buff_.Append(target.data(), target.size());
+    write_buff_.Append("\r\n", 2);
+    if(!is_keepalive_)
+        builder.Fragment("Connection: close\r\n");
+    else if(exchange_->request.Version() == "1.0")
+        builder.Fragment("Connection: keep-alive\r\n");
+    builder.ContentLength(0);
+}
+
+std::string_view HttpConn::HotObjectKey() const
+{
+    auto &request = exchange_->request;
+    return exchange_->arena.Join({request.Version(), request.IsKeepAlive() ? " keep-alive " : " close ", location_->root, request.Path()});
+}
+
+void HttpConn::CacheHotObject(std::string_view key, const HttpResponse &response, const PendingResponse &pending)
+{
+    if(!response.IsFileCode() || !(response.HasFile() || response.HasFileFd()))
+        return;
+    std::size_t header_size = pending.head_remain;
+    std::size_t file_size = response.FileSize();
+    if(!hot_object_cache->Admit(key, header_size + file_size))
+        return;
+
+    // the head is the last one in the buffer
+    auto object = std::make_shared<std::string>(header_size + file_size, '\0');
+    write_buff_.Copy(write_buff_.ReadableBytes() - header_size, header_size, &(*object)[0]);
+    if(response.HasFile())
+        memcpy(&(*object)[header_size], response.FileAddr(), file_size);
+    else if(pread(response.FileFd(), &(*object)[header_size], file_size, 0) != static_cast<ssize_t>(file_size))
+        return; // the file changed under us
+    hot_object_cache->Put(key, std::move(object));
+}
+
+// written from the shared copy but the date, which follows the status line
+void HttpConn::QueueHotObject(PendingResponse &pending)
+{
+    const std::string &object = *pending.hot_object;
+    std::size_t date_begin = object.find("\r\n") + 2;
+    std::size_t date_end = date_begin + HttpDate::kLineSize;
+    write_buff_.Append(object.data(), date_begin);
+    HttpHeaderBuilder(write_buff_).Date();
+    pending.head_remain = date_end;
+    pending.body = object.data() + date_end;
+    pending.body_remain = object.size() - date_end;
+}
+
+bool HttpConn::QueueCacheHit()
+{
+    auto request_header = [this](std::string_view name) { return exchange_->request.Header(name); };
+    ProxyCache::Hit hit;
+    if(!ProxyCache::IsCacheableRequest(exchange_->request.Method(), request_header)
+       || !proxy_cache->Lookup(exchange_->request.Method(), exchange_->request.Header("Host"), exchange_->request.Path(), request_header, &hit))
+        return false;
+    int index = PushPending();
+    auto &pending = exchange_->pending[index];
+    std::size_t head_begin = write_buff_.ReadableBytes();
+    write_buff_.Append(hit.head);
+    write_buff_.Append("\r\nAge: " + std::to_string(hit.age) + (hit.is_stale ? "\r\nX-Cache: STALE" : "\r\nX-Cache: HIT"));
+    // the connection headers of the upstream are never stored, they follow the client
+    if(!is_keepalive_)
+        write_buff_.Append("\r\nConnection: close");
+    else if(exchange_->request.Version() == "1.0")
+        write_buff_.Append("\r\nConnection: keep-alive");
+    write_buff_.Append("\r\n\r\n", 4);
+    pending.head_remain = write_buff_.ReadableBytes() - head_begin;
+    if(hit.body)
+    {
+        pending.hot_object = std::move(hit.body);
+        pending.body = pending.hot_object->data();
+        pending.body_remain = hit.body_size;
+    }else
+    {
+        pending.cache_fd = hit.fd;
+        pending.file_offset = 0;
+        pending.file_remain = hit.body_size;
+    }
+    upstream_ = {};
+    upstream_.is_done = true;
+    cache_store_.is_storable = false;
+    cache_store_.is_storing = false;
+    LOG_DEBUG("Proxy cache hit for client[", fd_, "]: ", hit.body_size, " bytes, age ", hit.age);
+    return true;
+}
+
+void HttpConn::PrepareCacheStore(std::size_t request_begin)
+{
+    auto request_header = [this](std::string_view name) { return exchange_->request.Header(name); };
+    cache_store_.is_storing = false;
+    cache_store_.is_storable = ProxyCache::IsStorableRequest(exchange_->request.Method(), request_header);
+    if(!cache_store_.is_storable)
+        return;
+    cache_store_.method = exchange_->request.Method();
+    cache_store_.host = exchange_->request.Header("Host");
+    cache_store_.uri = exchange_->request.Path();
+    cache_store_.request.resize(write_buff_.ReadableBytes() - request_begin);
+    write_buff_.Copy(request_begin, cache_store_.request.size(), &cache_store_.request[0]);
+    // refetched on a connection of its own, read until closed
+    static constexpr std::string_view kKeepAlive = "Connection: keep-alive\r\n";
+    auto connection = cache_store_.request.rfind(kKeepAlive);
+    if(connection != std::string::npos)
+        cache_store_.request.replace(connection, kKeepAlive.size(), "Connection: close\r\n");
+}
+
+void HttpConn::StartCacheStore()
+{
+    cache_store_.is_storing = false;
+    if(upstream_.framing != UpstreamResponse::FRAMING::LENGTH
+       || upstream_.remain - upstream_.head_length > proxy_cache->MaxObjectSize())
+    {
+        LeaveFlight();
+        return;
+    }
+    std::string scratch;
+    std::string_view head = proxy_buff_.Peek(upstream_.head_length - 4, &scratch);
+    cache_store_.policy = proxy_cache->Evaluate(upstream_.status, head);
+    if(!cache_store_.policy.is_cacheable)
+    {
+        LeaveFlight(); // the waiters go to the upstream themselves
+        return;
+    }
+    cache_store_.head.assign(head);
+    cache_store_.body.clear();
+    cache_store_.body.reserve(upstream_.remain - upstream_.head_length);
+    cache_store_.skip = upstream_.head_length;
+    cache_store_.is_storing = true;
+}
+
+void HttpConn::CollectCacheStore(const char *data, std::size_t len)
+{
+    std::size_t skip = std::min(len, cache_store_.skip);
+    cache_store_.skip -= skip;
+    cache_store_.body.append(data + skip, len - skip);
+    if(!upstream_.is_done)
+        return;
+    cache_store_.is_storing = false;
+    std::string_view request = cache_store_.request;
+    proxy_cache->Store(cache_store_.method, cache_store_.host, cache_store_.uri,
+                       [request](std::string_view name) { return ProxyCache::FindHeader(request, name); },
+                       cache_store_.head, cache_store_.body, cache_store_.policy, cache_store_.request);
+    std::string().swap(cache_store_.body); // up to the max object, not kept for the next response
+    LeaveFlight();
+}
+
+bool HttpConn::JoinFlight()
+{
+    auto request_header = [this](std::string_view name) { return exchange_->request.Header(name); };
+    if(!proxy_cache->IsCoalescing() || !ProxyCache::IsCacheableRequest(exchange_->request.Method(), request_header))
+        return false;
+    std::string key = ProxyCache::PrimaryKey(exchange_->request.Method(), exchange_->request.Header("Host"), exchange_->request.Path());
+    cache_store_.is_flight_leader = proxy_cache->BeginFlight(key);
+    cache_store_.is_flight_waiting = !cache_store_.is_flight_leader;
+    cache_store_.flight_key = std::move(key);
+    return cache_store_.is_flight_waiting;
+}
+
+bool HttpConn::WaitFlight(ProxyCache::Waker waker)
+{
+    return proxy_cache->WaitFlight(cache_store_.flight_key, this, std::move(waker));
+}
+
+void HttpConn::LeaveFlight()
+{
+    if(cache_store_.flight_key.empty())
+        return;
+    if(cache_store_.is_flight_leader)
+        proxy_cache->EndFlight(cache_store_.flight_key);
+    else
+        proxy_cache->CancelFlight(cache_store_.flight_key, this);
+    cache_store_.flight_key.clear();
+    cache_store_.is_flight_leader = false;
 }
 
 HttpConn::PROXY_PROCESS_STATE HttpConn::ProcessProxy()
@@ -146,44 +582,410 @@ HttpConn::PROXY_PROCESS_STATE HttpConn::ProcessProxy()
     {
         case PROXY_PROCESS_STATE::PENDING_READ_FROM_CLIENT:
         {
-            if(request_.IsFinish())
-                request_.Init();
-            auto request_parse_result = request_.Parse(read_buff_);
+            if(exchange_->request.IsFinish())
+                exchange_->request.Init();
+            auto request_parse_result = exchange_->request.Parse(exchange_->read_buff);
             switch(request_parse_result)
             {
                 case HttpRequest::HTTP_CODE::MOVED_PERMANENTLY:
                 case HttpRequest::HTTP_CODE::GET_REQUEST:
-                    request_.MakeProxyRequests(write_buff_, inet_ntoa(address_.sin_addr));
-                    iov_[0].iov_base = write_buff_.ReadBegin();
-                    iov_[0].iov_len = write_buff_.ReadableBytes();
-                    iov_cnt_ = 1;
+                {
+                    is_keepalive_ = exchange_->request.IsKeepAlive();
+                    Route();
+                    if(location_->handler != Location::HANDLER::PROXY)
+                    {
+                        // answered here as the static server does, nothing goes upstream
+                        upstream_ = {};
+                        upstream_.is_done = true;
+                        QueueResponse(exchange_->request.Method() == "HEAD" ? HttpRequest::HTTP_CODE::BAD_REQUEST : HttpRequest::HTTP_CODE::GET_REQUEST);
+                        return PROXY_PROCESS_STATE::PENDING_WRITE_TO_CLIENT;
+                    }
+                    if(proxy_cache)
+                    {
+                        // woken by the end of the flight, look up what it stored and never wait twice
+                        bool is_woken = cache_store_.is_flight_waiting;
+                        if(is_woken)
+                            cache_store_.flight_key.clear();
+                        cache_store_.is_flight_waiting = false;
+                        LeaveFlight();
+                        if(QueueCacheHit())
+                        {
+                            exchange_->read_buff.Retrieve(exchange_->request.Length());
+                            return PROXY_PROCESS_STATE::PENDING_WRITE_TO_CLIENT;
+                        }
+                        if(!is_woken && JoinFlight())
+                            return PROXY_PROCESS_STATE::PENDING_WAIT_FLIGHT; // the request stays in the read buffer
+                    }
+                    path_hash_ = std::hash<std::string_view>{}(exchange_->request.Path()); // the request is a view of the read buffer
+                    std::size_t request_begin = write_buff_.ReadableBytes();
+                    exchange_->request.MakeProxyRequests(write_buff_, inet_ntoa(address_.sin_addr));
+                    if(proxy_cache)
+                        PrepareCacheStore(request_begin);
+                    exchange_->read_buff.Retrieve(exchange_->request.Length());
+                    QueueWriteBuffer();
+                    proxy_buff_.Clear();
+                    upstream_ = {};
+                    upstream_.is_head_request = exchange_->request.Method() == "HEAD";
                     proxy_process_state_ = PROXY_PROCESS_STATE::PENDING_READ_FROM_PROXY_SERVER;
                     return PROXY_PROCESS_STATE::PENDING_WRITE_TO_PROXY_SERVER;
                     break;
+                }
                 case HttpRequest::HTTP_CODE::BAD_REQUEST:
-                    response_.Init(web_root, request_.Path(), index_file_, request_.Version(), request_.IsKeepAlive(), 400);
-                    response_.MakeResponse(write_buff_);
-                    iov_[0].iov_base = write_buff_.ReadBegin();
-                    iov_[0].iov_len = write_buff_.ReadableBytes();
-                    iov_cnt_ = 1;
+                {
+                    is_keepalive_ = exchange_->request.IsKeepAlive();
+                    int index = PushPending();
+                    exchange_->responses[index].Init(exchange_->arena, web_root, exchange_->request.Path(), site_->index_file, exchange_->request.Version(), exchange_->request.IsKeepAlive(), 400);
+                    exchange_->read_buff.Retrieve(exchange_->read_buff.ReadableBytes());
+                    exchange_->responses[index].MakeResponse(write_buff_);
+                    exchange_->pending[index].head_remain = write_buff_.ReadableBytes();
                     proxy_process_state_ = PROXY_PROCESS_STATE::PENDING_READ_FROM_CLIENT;
                     return PROXY_PROCESS_STATE::PENDING_WRITE_TO_CLIENT;
                     break;
+                }
+                default:
+                    return PROXY_PROCESS_STATE::PENDING_READ_FROM_CLIENT;
             }
             break;
         }
         case PROXY_PROCESS_STATE::PENDING_READ_FROM_PROXY_SERVER:
-            write_buff_.Swap(read_buff_);
-            iov_[0].iov_base = write_buff_.ReadBegin();
-            iov_[0].iov_len = write_buff_.ReadableBytes();
-            iov_cnt_ = 1;
-            proxy_process_state_ = PROXY_PROCESS_STATE::PENDING_READ_FROM_CLIENT;
+        {
+            if(upstream_.is_splicing)
+            {
+                // the body went into the pipe, only the end of it matters
+                if(upstream_.framing == UpstreamResponse::FRAMING::LENGTH)
+                {
+                    upstream_.is_done = upstream_.remain == 0;
+                    if(!upstream_.is_done && upstream_.is_eof)
+                        return PROXY_PROCESS_STATE::FAIL; // truncated
+                }else
+                    upstream_.is_done = upstream_.is_eof;
+                if(upstream_.is_done)
+                {
+                    proxy_process_state_ = PROXY_PROCESS_STATE::PENDING_READ_FROM_CLIENT;
+                    return PROXY_PROCESS_STATE::PENDING_WRITE_TO_CLIENT;
+                }
+                return pipe_bytes_ == 0 ? PROXY_PROCESS_STATE::PENDING_READ_FROM_PROXY_SERVER : PROXY_PROCESS_STATE::PENDING_WRITE_TO_CLIENT;
+            }
+            // relay what belongs to the response, the head may be preceded by interim ones
+            std::size_t relayed = 0;
+            while(!upstream_.is_done)
+            {
+                if(!upstream_.is_head_parsed)
+                {
+                    if(!ParseUpstreamHead())
+                    {
+                        if(proxy_buff_.ReadableBytes() >= kProxyHighWatermark)
+                        {
+                            LOG_WARN("Upstream response head too large for client[", fd_, "]");
+                            QueueErrorResponse(502);
+                            return PROXY_PROCESS_STATE::PENDING_WRITE_TO_CLIENT;
+                        }
+                        if(!upstream_.is_eof)
+                            break;
+                        LOG_WARN("Upstream closed before responding to client[", fd_, "]");
+                        QueueErrorResponse(502);
+                        return PROXY_PROCESS_STATE::PENDING_WRITE_TO_CLIENT;
+                    }
+                    if(cache_store_.is_storable && !upstream_.is_interim)
+                        StartCacheStore();
+                }
+                // framed chunk by chunk, then the chunks go to write_buff_ as they are
+                std::size_t len = 0;
+                std::size_t covered;
+                int iov_cnt = proxy_buff_.Iovecs(exchange_->iov, kMaxIovecs, 0, proxy_buff_.ReadableBytes(), &covered);
+                for(int i = 0; i < iov_cnt; ++i)
+                {
+                    ssize_t n = FrameUpstreamResponse(static_cast<const char*>(exchange_->iov[i].iov_base), exchange_->iov[i].iov_len);
+                    if(n < 0)
+                    {
+                        LOG_WARN("Malformed chunked response from upstream for client[", fd_, "]");
+                        return PROXY_PROCESS_STATE::FAIL;
+                    }
+                    if(n > 0 && cache_store_.is_storing)
+                        CollectCacheStore(static_cast<const char*>(exchange_->iov[i].iov_base), n);
+                    len += n;
+                    if(static_cast<std::size_t>(n) < exchange_->iov[i].iov_len)
+                        break;
+                }
+                write_buff_.Append(proxy_buff_, len);
+                relayed += len;
+                if(!upstream_.is_done && upstream_.is_eof && upstream_.framing == UpstreamResponse::FRAMING::CLOSE)
+                    upstream_.is_done = true; // the close ends it, even when it comes after the last byte read
+                if(upstream_.is_done && upstream_.is_interim)
+                {
+                    bool is_head_request = upstream_.is_head_request;
+                    upstream_ = {};
+                    upstream_.is_head_request = is_head_request;
+                    continue;
+                }
+                if(!upstream_.is_done && upstream_.is_eof)
+                    return PROXY_PROCESS_STATE::FAIL; // truncated
+                if(!upstream_.is_done && proxy_buff_.ReadableBytes() == 0)
+                    StartSplice();
+                break;
+            }
+            if(relayed > 0)
+                QueueWriteBuffer();
+            if(upstream_.is_done)
+            {
+                if(proxy_buff_.ReadableBytes() > 0)
+                    upstream_.is_close = true; // bytes after the response, never reuse the connection
+                proxy_buff_.Clear();
+                proxy_process_state_ = PROXY_PROCESS_STATE::PENDING_READ_FROM_CLIENT;
+                return PROXY_PROCESS_STATE::PENDING_WRITE_TO_CLIENT;
+            }
+            if(PendingWriteBytes() == 0)
+                return PROXY_PROCESS_STATE::PENDING_READ_FROM_PROXY_SERVER;
             return PROXY_PROCESS_STATE::PENDING_WRITE_TO_CLIENT;
             break;
+        }
         default:
             break;
     }
     return PROXY_PROCESS_STATE::PENDING_WRITE_TO_CLIENT;
 }
 
-} // namespace white
\ No newline at end of file
+void HttpConn::QueueErrorResponse(int code)
+{
+    // drop the request not forwarded yet, it is the only thing queued while waiting for the upstream
+    ClearPending();
+    ReleasePipe();
+    write_buff_.Clear();
+    int index = PushPending();
+    std::size_t head_begin = write_buff_.ReadableBytes();
+    exchange_->responses[index].Init(exchange_->arena, web_root, "", site_->index_file, exchange_->request.Version(), false, code);
+    exchange_->responses[index].MakeResponse(write_buff_);
+    exchange_->pending[index].head_remain = write_buff_.ReadableBytes() - head_begin;
+    is_keepalive_ = false;
+    // nothing more is relayed, the upstream connection is never reused
+    proxy_buff_.Clear();
+    cache_store_.is_storing = false;
+    if(proxy_cache)
+        LeaveFlight();
+    upstream_ = {};
+    upstream_.is_done = true;
+    upstream_.is_close = true;
+    proxy_process_state_ = PROXY_PROCESS_STATE::PENDING_READ_FROM_CLIENT;
+}
+
+bool HttpConn::ParseUpstreamHead()
+{
+    std::string scratch;
+    std::string_view response = proxy_buff_.Peek(proxy_buff_.ReadableBytes(), &scratch);
+    auto head_end = response.find("\r\n\r\n");
+    if(head_end == std::string_view::npos)
+        return false;
+    std::size_t head_len = head_end + 4;
+    auto line_end = response.find("\r\n");
+    std::string_view status_line = response.substr(0, line_end);
+    bool is_keepalive_default = status_line.substr(0, 8) != "HTTP/1.0";
+    int status = 0;
+    auto status_begin = status_line.find(' ');
+    if(status_begin != std::string_view::npos)
+        std::from_chars(status_line.data() + status_begin + 1, status_line.data() + status_line.size(), status);
+    
+    bool is_chunked = false;
+    bool is_close = !is_keepalive_default;
+    std::size_t content_length = 0;
+    bool has_content_length = false;
+    for(auto begin = line_end + 2; begin < head_end; begin = line_end + 2)
+    {
+        line_end = response.find("\r\n", begin);
+        std::string_view line = response.substr(begin, line_end - begin);
+        auto colon = line.find(':');
+        if(colon == std::string_view::npos)
+            continue;
+        std::string_view name = line.substr(0, colon);
+        std::string_view value = line.substr(colon + 1);
+        while(!value.empty() && (value.front() == ' ' || value.front() == '\t'))
+            value.remove_prefix(1);
+        while(!value.empty() && (value.back() == ' ' || value.back() == '\t'))
+            value.remove_suffix(1);
+        if(EqualsIgnoreCase(name, "Content-Length"))
+            has_content_length = std::from_chars(value.data(), value.data() + value.size(), content_length).ec == std::errc();
+        else if(EqualsIgnoreCase(name, "Transfer-Encoding"))
+            is_chunked = true;
+        else if(EqualsIgnoreCase(name, "Connection"))
+            is_close = EqualsIgnoreCase(value, "close") || (is_close && !EqualsIgnoreCase(value, "keep-alive"));
+    }
+
+    upstream_.is_head_parsed = true;
+    upstream_.status = status;
+    upstream_.head_length = head_len;
+    upstream_.is_close = is_close;
+    upstream_.is_interim = status >= 100 && status < 200 && status != 101;
+    if(status == 101)
+        upstream_.framing = UpstreamResponse::FRAMING::CLOSE; // switched to another protocol, relay until closed
+    else if(upstream_.is_interim || status == 204 || status == 304 || upstream_.is_head_request)
+    {
+        upstream_.framing = UpstreamResponse::FRAMING::LENGTH; // no body
+        upstream_.remain = head_len;
+    }else if(is_chunked)
+    {
+        upstream_.framing = UpstreamResponse::FRAMING::CHUNKED;
+        upstream_.remain = head_len; // relayed before the first chunk
+        upstream_.chunk_state = UpstreamResponse::CHUNK_STATE::HEAD;
+    }else if(has_content_length)
+    {
+        upstream_.framing = UpstreamResponse::FRAMING::LENGTH;
+        upstream_.remain = head_len + content_length;
+    }else
+        upstream_.framing = UpstreamResponse::FRAMING::CLOSE;
+    return true;
+}
+
+ssize_t HttpConn::FrameUpstreamResponse(const char *data, std::size_t len)
+{
+    using CHUNK_STATE = UpstreamResponse::CHUNK_STATE;
+    switch(upstream_.framing)
+    {
+        case UpstreamResponse::FRAMING::LENGTH:
+            len = std::min(len, upstream_.remain);
+            upstream_.remain -= len;
+            upstream_.is_done = upstream_.remain == 0;
+            return len;
+        case UpstreamResponse::FRAMING::CLOSE:
+            upstream_.is_done = upstream_.is_eof;
+            return len;
+        default:
+            break;
+    }
+
+    // chunked, only the sizes and the end of the trailers are looked at
+    std::size_t pos = 0;
+    while(pos < len && !upstream_.is_done)
+    {
+        char ch = data[pos];
+        switch(upstream_.chunk_state)
+        {
+            case CHUNK_STATE::HEAD:
+            {
+                std::size_t n = std::min(len - pos, upstream_.remain);
+                pos += n;
+                upstream_.remain -= n;
+                if(upstream_.remain == 0)
+                    upstream_.chunk_state = CHUNK_STATE::SIZE;
+                break;
+            }
+            case CHUNK_STATE::SIZE:
+            {
+                int digit = ch >= '0' && ch <= '9' ? ch - '0' : (ch | 0x20) >= 'a' && (ch | 0x20) <= 'f' ? (ch | 0x20) - 'a' + 10 : -1;
+                if(digit >= 0)
+                {
+                    if(upstream_.remain > (SIZE_MAX >> 4))
+                        return -1;
+                    upstream_.remain = (upstream_.remain << 4) | digit;
+                    ++pos;
+                    break;
+                }
+                upstream_.chunk_state = CHUNK_STATE::EXTENSION;
+                break;
+            }
+            case CHUNK_STATE::EXTENSION:
+                if(ch == '\n')
+                    upstream_.chunk_state = upstream_.remain > 0 ? CHUNK_STATE::DATA : CHUNK_STATE::TRAILER_BEGIN;
+                ++pos;
+                break;
+            case CHUNK_STATE::DATA:
+            {
+                std::size_t n = std::min(len - pos, upstream_.remain);
+                pos += n;
+                upstream_.remain -= n;
+                if(upstream_.remain == 0)
+                    upstream_.chunk_state = CHUNK_STATE::DATA_END;
+                break;
+            }
+            case CHUNK_STATE::DATA_END:
+                if(ch == '\n')
+                    upstream_.chunk_state = CHUNK_STATE::SIZE;
+                else if(ch != '\r')
+                    return -1;
+                ++pos;
+                break;
+            case CHUNK_STATE::TRAILER_BEGIN:
+                if(ch == '\n')
+                    upstream_.is_done = true; // the empty line after the last chunk
+                else if(ch != '\r')
+                    upstream_.chunk_state = CHUNK_STATE::TRAILER;
+                ++pos;
+                break;
+            case CHUNK_STATE::TRAILER:
+                if(ch == '\n')
+                    upstream_.chunk_state = CHUNK_STATE::TRAILER_BEGIN;
+                ++pos;
+                break;
+        }
+    }
+    return pos;
+}
+
+bool HttpConn::StartSplice()
+{
+    if(!pipe_pool || cache_store_.is_storing || upstream_.framing == UpstreamResponse::FRAMING::CHUNKED
+       || (upstream_.framing == UpstreamResponse::FRAMING::LENGTH && upstream_.remain < kProxySpliceMinBytes))
+        return false;
+    if(pipe_.read_fd == -1 && !pipe_pool->Acquire(&pipe_))
+        return false;
+    upstream_.is_splicing = true;
+    return true;
+}
+
+// a full pipe and a drained socket both fail with EAGAIN, so the bytes in the pipe are counted against its capacity
+ssize_t HttpConn::SpliceFromProxy(int *err)
+{
+    ssize_t len = 0;
+    upstream_.is_drained = false;
+    while(pipe_bytes_ < pipe_.capacity)
+    {
+        std::size_t size = pipe_.capacity - pipe_bytes_;
+        if(upstream_.framing == UpstreamResponse::FRAMING::LENGTH)
+        {
+            if(upstream_.remain == 0)
+                break;
+            size = std::min(size, upstream_.remain);
+        }
+        len = splice(proxy_fd_, nullptr, pipe_.write_fd, nullptr, size, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if(len > 0)
+        {
+            pipe_bytes_ += len;
+            if(upstream_.framing == UpstreamResponse::FRAMING::LENGTH)
+                upstream_.remain -= len;
+            continue;
+        }
+        if(len < 0)
+            *err = errno;
+        if(len == 0 || (*err != EAGAIN && *err != EWOULDBLOCK))
+            upstream_.is_eof = true;
+        upstream_.is_drained = true;
+        break;
+    }
+    return len;
+}
+
+void HttpConn::ReleasePipe()
+{
+    if(pipe_.read_fd == -1)
+        return;
+    if(pipe_bytes_ == 0)
+        pipe_pool->Release(pipe_);
+    else
+        PipePool::Discard(pipe_);
+    pipe_ = {};
+    pipe_bytes_ = 0;
+}
+
+bool HttpConn::ShouldReadUpstream() const
+{
+    if(proxy_fd_ == -1 || is_upstream_connecting_ || upstream_.is_done
+       || proxy_process_state_ != PROXY_PROCESS_STATE::PENDING_READ_FROM_PROXY_SERVER)
+        return false;
+    std::size_t pending = PendingWriteBytes();
+    if(pending == 0)
+        return true;
+    if(pending > kProxyLowWatermark)
+        return false;
+    // otherwise keep writing to the client, an idle upstream must not hold back what is already read
+    return !upstream_.is_drained;
+}
+
+} // namespace white
@@ -9,12 +9,22 @@
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <atomic>
+#include <memory>
 #include <string>
+#include <vector>
 
+#include "buffer/arena.h"
 #include "buffer/buffer.h"
+#include "buffer/buffer_chain.h"
+#include "cache/hot_object_cache.h"
+#include "cache/proxy_cache.h"
 #include "logger/logger.h"
+#include "protocol/http/http_header_builder.h"
 #include "protocol/http/http_request.h"
 #include "protocol/http/http_response.h"
+#include "proxy/pipe_pool.h"
+#include "router/virtual_hosts.h"
+#include "timer/timing_wheel.h"
 
 namespace white {
 
@@ -34,6 +44,7 @@ public:
         PENDING_WRITE_TO_PROXY_SERVER,
         PENDING_READ_FROM_PROXY_SERVER,
         PENDING_WRITE_TO_CLIENT,
+        PENDING_WAIT_FLIGHT, // the response is being fetched by an identical request, wait for it
         FINISH,
         FAIL,
     };
@@ -41,31 +52,143 @@ public:
     HttpConn();
     ~HttpConn();
 
-    void Init(int fd, const sockaddr_in& addr, int proxt_fd, std::shared_ptr<std::vector<std::string>> index_file);
+    void Init(int fd, const sockaddr_in& addr, int proxt_fd, std::shared_ptr<const VirtualHosts> hosts);
 
     ssize_t Read(int *err);
     ssize_t Write(int *err);
 
+    /**
+     * @brief Take the data the poller received from the client, which the next Read returns before anything left
+     * in the socket.
+     * 
+     * @param data 
+     * @param is_more the data filled the buffer of the poller, the socket may hold more
+     */
+    void Receive(std::string_view data, bool is_more);
+
     ssize_t SendRequestToProxy(int *err);
     ssize_t ReadResponseFromProxy(int *err);
 
     void Close();
 
-    void ResetProxyFd(int new_proxy_fd);
+    /**
+     * @brief Attach the connection to a server of the upstream group, or detach with -1.
+     * 
+     * @param new_proxy_fd 
+     * @param upstream_index index of the server in the group
+     */
+    void ResetProxyFd(int new_proxy_fd, int upstream_index = -1);
 
     int GetFd() const;
     int GetProxyFd() const;
+    int GetUpstreamIndex() const;
     int GetPort() const;
     const char* GetIP() const;
+    const sockaddr_in &GetAddress() const;
+
+    /**
+     * @brief The location the last request is routed to.
+     * 
+     * @return const Location& 
+     */
+    const Location &GetLocation() const;
+
+    /**
+     * @brief The hash of the path of the request being proxied, for hash_uri.
+     * 
+     * @return std::size_t 
+     */
+    std::size_t GetPathHash() const;
+    TimingWheel::TimerNode &GetTimerNode();
+    TimingWheel::TimerNode &GetConnectTimerNode();
 
     PROCESS_STATE Process();
     PROXY_PROCESS_STATE ProcessProxy();
 
+    /**
+     * @brief Answer the request being proxied with an error instead of the upstream, such as 502 or 504.
+     * 
+     * @param code 
+     */
+    void QueueErrorResponse(int code);
 
-    int PendingWriteBytes() const;
+
+    std::size_t PendingWriteBytes() const;
+
+    /**
+     * @brief Returns true if there are bytes of requests not processed yet, such as pipelined requests
+     * beyond the in-flight limit.
+     * 
+     * @return true 
+     * @return false 
+     */
+    bool HasPendingRequest() const;
 
     bool IsKeepAlive() const;
 
+    /**
+     * @brief Returns true if the response from the upstream has been read completely.
+     * 
+     * @return true 
+     * @return false 
+     */
+    bool IsUpstreamDone() const;
+
+    /**
+     * @brief Returns true if the connection to the upstream can be reused by the next request,
+     * the response is completely read, framed by its length and not followed by a close.
+     * 
+     * @return true 
+     * @return false 
+     */
+    bool IsUpstreamReusable() const;
+
+    /**
+     * @brief Returns true if the rest of the response should be read from the upstream now: the bytes queued
+     * to the client have fallen below the low watermark, and either all of them are written or the last read
+     * of the upstream stopped before draining it.
+     * 
+     * @return true 
+     * @return false 
+     */
+    bool ShouldReadUpstream() const;
+
+    /**
+     * @brief Returns true if the request is ready to be forwarded, but no upstream connection is attached yet.
+     * 
+     * @return true 
+     * @return false 
+     */
+    bool IsWaitingUpstream() const;
+
+    bool IsUpstreamConnecting() const;
+    void SetUpstreamConnecting(bool is_connecting);
+
+    /**
+     * @brief Returns true if the request is waiting for the flight of an identical one, or woken by its end
+     * and to be processed again.
+     * 
+     * @return true 
+     * @return false 
+     */
+    bool IsWaitingFlight() const;
+
+    /**
+     * @brief Wait for the flight after PENDING_WAIT_FLIGHT, the waker arms the client for ProcessProxy.
+     * 
+     * @param waker 
+     * @return true waiting
+     * @return false the flight has ended meanwhile, process the request again now
+     */
+    bool WaitFlight(ProxyCache::Waker waker);
+
+    /**
+     * @brief Give the memory of the requests back to the pool if nothing is in flight, an idle keep-alive
+     * connection keeps only its core until the client sends the next request.
+     * 
+     */
+    void Trim();
+
     /**
      * @brief Returns true if connected.
      * 
@@ -77,11 +200,272 @@ public:
 public:
     static std::string web_root;
     static std::atomic_size_t user_count;
+    static bool is_sendfile; // send files by sendfile, or by mmap and writev
+    static std::shared_ptr<OpenFileCache> open_file_cache; // null if disabled
+    static std::shared_ptr<HotObjectCache> hot_object_cache; // null if disabled
+    static std::shared_ptr<PipePool> pipe_pool; // null if the bodies of proxied responses are copied instead of spliced
+    static std::shared_ptr<ProxyCache> proxy_cache; // null if disabled
 
 private:
+    // a response queued to be written, the heads of all queued responses are stored in order in write_buff_
+    struct PendingResponse
+    {
+        std::size_t head_remain; // status line and headers, or anything else written from write_buff_
+        HotObjectCache::Object hot_object; // the whole response from the hot object cache, or the body from the proxy cache
+        const char *body; // the mapped file or the hot object
+        std::size_t body_remain;
+        off_t file_offset; // the file sent by sendfile
+        std::size_t file_remain;
+        int cache_fd = -1; // the file of a proxy cache hit, sent instead of the file of the response
+    };
+
+    // the response relayed from the upstream
+    struct UpstreamResponse
+    {
+        enum class FRAMING
+        {
+            LENGTH, // by Content-Length, or no body at all
+            CHUNKED,
+            CLOSE, // by the close of the connection
+        };
+
+        enum class CHUNK_STATE
+        {
+            HEAD, // the status line and the headers
+            SIZE,
+            EXTENSION, // the rest of the size line
+            DATA,
+            DATA_END, // CRLF after the data
+            TRAILER_BEGIN,
+            TRAILER,
+        };
+
+        bool is_head_request; // the response never has a body
+        bool is_head_parsed;
+        int status;
+        std::size_t head_length; // with the empty line
+        bool is_interim; // 1xx, the final response follows
+        bool is_splicing; // the rest of the body goes through pipe_, bypassing proxy_buff_
+        FRAMING framing;
+        std::size_t remain; // bytes of the response not relayed yet by LENGTH, of the current chunk by CHUNKED
+        CHUNK_STATE chunk_state;
+        bool is_close; // the upstream will close the connection after it
+        bool is_eof; // the upstream has closed the connection
+        bool is_drained; // the last read of the upstream ended with EAGAIN or the close, not at a watermark
+        bool is_done;
+    };
+
+    // the proxied response being stored into the proxy cache as it is relayed
+    struct CacheStore
+    {
+        bool is_storable; // the request allows the response to be stored
+        bool is_storing; // and the response is cacheable, its body is being collected
+        std::string method;
+        std::string host;
+        std::string uri;
+        std::string request; // as forwarded, asking to close, to refetch the response
+        std::string head;
+        std::string body;
+        std::size_t skip; // bytes of the head still to be relayed before the body
+        ProxyCache::Policy policy;
+        std::string flight_key; // of the flight led or waited for, empty if none
+        bool is_flight_leader;
+        bool is_flight_waiting;
+    };
+
+    static constexpr int kMaxPipelined = 16; // max responses in flight on a connection
+    static constexpr int kMaxIovecs = 64; // pieces gathered into one writev
+
+    // bytes of a proxied response buffered for the client, reading from the upstream stops above the high watermark
+    // and resumes below the low one
+    static constexpr std::size_t kProxyHighWatermark = 64 * 1024;
+    static constexpr std::size_t kProxyLowWatermark = 16 * 1024;
+    static constexpr std::size_t kProxySpliceMinBytes = 32 * 1024; // smaller bodies are copied, not worth a pipe
+
+    static constexpr int kReadBuffSize = 2048;
+    static constexpr std::size_t kMaxPooledReadBuff = 16 * 1024; // a larger read buffer is freed, not pooled
+    static constexpr std::size_t kMaxPooledArena = 16 * 1024; // the blocks beyond are freed
+    static constexpr std::size_t kMaxFreeExchanges = 64; // kept by the pool of each thread
+
+    // what a connection needs only while a request or its responses are in flight, most of its memory. Taken from
+    // the pool of the thread when the client sends something, given back once everything is answered.
+    struct Exchange
+    {
+        Exchange();
+
+        Buffer read_buff; // contiguous for the parser
+        HttpRequest request;
+        Arena arena; // for the strings of the responses, reset once all of them are written
+        // a ring of the responses in flight, from pending_begin_
+        HttpResponse responses[kMaxPipelined];
+        PendingResponse pending[kMaxPipelined];
+        iovec iov[kMaxIovecs];
+    };
+
+private:
+    static Exchange *AcquireExchange();
+    static void ReleaseExchange(Exchange *exchange);
+
     ssize_t ReadFromFd(int fd, int *err);
+
+    /**
+     * @brief Write the queued responses in order, gathering as many as possible into one writev.
+     * 
+     * @param fd 
+     * @param err 
+     * @return ssize_t 
+     */
     ssize_t WriteToFd(int fd, int *err);
 
+    /**
+     * @brief Route the request just parsed to its site by the Host header, then to its location by the path.
+     * 
+     */
+    void Route();
+
+    /**
+     * @brief Queue the redirect of the location to the request just parsed.
+     * 
+     */
+    void QueueRedirect();
+
+    /**
+     * @brief Make the response of the request just parsed and queue it, routed to a static or redirect location.
+     * A bad request is answered from the root of the default server.
+     * 
+     * @param parse_result 
+     */
+    void QueueResponse(HttpRequest::HTTP_CODE parse_result);
+
+    /**
+     * @brief Queue the bytes of write_buff_ which do not belong to any queued response.
+     * 
+     */
+    void QueueWriteBuffer();
+
+    /**
+     * @brief Get a new slot at the back of the queue.
+     * 
+     * @return int index of the slot in pending_ and responses_
+     */
+    int PushPending();
+    void PopPending();
+    void ClearPending();
+
+    /**
+     * @brief Mark len bytes written from the front of the queue.
+     * 
+     * @param len 
+     */
+    void ConsumePending(std::size_t len);
+
+    /**
+     * @brief The key of the rendered response, which depends on the root of the location, the path, version and connection.
+     * 
+     * @return std::string_view in the arena
+     */
+    std::string_view HotObjectKey() const;
+
+    /**
+     * @brief Parse the status line and the headers of the upstream response in proxy_buff_ for its framing.
+     * Returns false if they are incomplete.
+     * 
+     * @return true 
+     * @return false 
+     */
+    bool ParseUpstreamHead();
+
+    /**
+     * @brief Find how many of the len bytes from data belong to the upstream response being relayed,
+     * marking it done at its end.
+     * 
+     * @param data 
+     * @param len 
+     * @return ssize_t -1 if the chunked body is malformed
+     */
+    ssize_t FrameUpstreamResponse(const char *data, std::size_t len);
+
+    /**
+     * @brief Relay the rest of the body by splice if it is framed by length or close, and large enough.
+     * 
+     * @return true splicing
+     * @return false copy it
+     */
+    bool StartSplice();
+
+    /**
+     * @brief Splice the body from the upstream into the pipe until the pipe is full.
+     * 
+     * @param err 
+     * @return ssize_t 
+     */
+    ssize_t SpliceFromProxy(int *err);
+
+    /**
+     * @brief Give the pipe back to the pool, or close it if it still holds bytes.
+     * 
+     */
+    void ReleasePipe();
+
+    /**
+     * @brief Answer the request just parsed from the proxy cache if it has the response.
+     * 
+     * @return true queued
+     * @return false missed, forward it
+     */
+    bool QueueCacheHit();
+
+    /**
+     * @brief Lead the flight of the request just missed, or wait for the identical one in flight.
+     * 
+     * @return true waiting
+     * @return false go to the upstream
+     */
+    bool JoinFlight();
+
+    /**
+     * @brief End the flight led, waking its waiters, or stop waiting.
+     * 
+     */
+    void LeaveFlight();
+
+    /**
+     * @brief Keep a copy of the forwarded request if its response may be stored, it begins at request_begin
+     * of write_buff_.
+     * 
+     * @param request_begin 
+     */
+    void PrepareCacheStore(std::size_t request_begin);
+
+    /**
+     * @brief Collect the response whose head is just parsed if it is cacheable, which must be framed by its length.
+     * 
+     */
+    void StartCacheStore();
+
+    /**
+     * @brief Collect the bytes relayed of the response being stored, and store it at its end.
+     * 
+     * @param data 
+     * @param len 
+     */
+    void CollectCacheStore(const char *data, std::size_t len);
+
+    /**
+     * @brief Put the response just made into the hot object cache if it is small and admitted,
+     * then send the cached copy instead.
+     * 
+     * @param key 
+     */
+    void CacheHotObject(std::string_view key, const HttpResponse &response, const PendingResponse &pending);
+
+    /**
+     * @brief Queue the hot object of the pending response with the Date header of now.
+     * 
+     * @param pending 
+     */
+    void QueueHotObject(PendingResponse &pending);
+
 private:
     int fd_;
     int proxy_fd_;
@@ -90,23 +474,53 @@ private:
     PROXY_PROCESS_STATE proxy_process_state_;
 
     bool is_close_;
-
-    int iov_cnt_;
-    iovec iov_[2];
-
-    Buffer read_buff_;
-    Buffer write_buff_;
-
-    HttpRequest request_;
-    HttpResponse response_;
-    std::shared_ptr<std::vector<std::string>> index_file_;
+    std::size_t received_; // bytes given by Receive since the last Read
+    bool is_received_more_; // the socket may hold more than received
+    bool is_keepalive_; // of the last request parsed
+    bool is_upstream_connecting_; // the attached upstream connection is in progress
+    int upstream_index_; // server of the attached upstream connection
+    std::size_t path_hash_;
+
+    BufferChain write_buff_;
+    BufferChain proxy_buff_; // read from the upstream, its chunks are handed to write_buff_ as relayed
+    PipePool::Pipe pipe_; // from the upstream to the client, written after everything queued
+    std::size_t pipe_bytes_;
+
+    UpstreamResponse upstream_;
+    CacheStore cache_store_;
+
+    Exchange *exchange_; // null while idle
+    static thread_local std::vector<std::unique_ptr<Exchange>> free_exchanges_; // the pool of each thread
+    int pending_begin_; // of the ring of the exchange
+    int pending_count_;
+    std::shared_ptr<const VirtualHosts> hosts_;
+    const Site *site_; // of the last request
+    const Location *location_;
+
+    TimingWheel::TimerNode timer_node_;
+    TimingWheel::TimerNode connect_timer_node_;
 
 };
 
 // response is small enough for a buffer to read
 inline ssize_t HttpConn::Read(int *err)
 {
-    return ReadFromFd(fd_, err);
+    ssize_t received = received_;
+    received_ = 0;
+    if(received > 0 && !is_received_more_)
+        return received; // the socket held no more, no readv to find it drained
+    ssize_t len = ReadFromFd(fd_, err);
+    return received > 0 && len <= 0 ? received : len;
+}
+
+// called by the reactor, no worker touches the connection until its read is dispatched
+inline void HttpConn::Receive(std::string_view data, bool is_more)
+{
+    if(!exchange_)
+        exchange_ = AcquireExchange();
+    exchange_->read_buff.Append(data.data(), data.size());
+    received_ += data.size();
+    is_received_more_ = is_more;
 }
 
 inline ssize_t HttpConn::Write(int *err)
@@ -119,9 +533,24 @@ inline ssize_t HttpConn::SendRequestToProxy(int *err)
     return WriteToFd(proxy_fd_, err);
 }
 
+// stops at the high watermark, the rest stays in the socket until the client catches up
 inline ssize_t HttpConn::ReadResponseFromProxy(int *err)
 {
-    return ReadFromFd(proxy_fd_, err);
+    if(upstream_.is_splicing)
+        return SpliceFromProxy(err);
+    ssize_t len = 0;
+    upstream_.is_drained = false;
+    while(PendingWriteBytes() + proxy_buff_.ReadableBytes() < kProxyHighWatermark)
+    {
+        len = proxy_buff_.ReadFromFd(proxy_fd_, err);
+        if(len > 0)
+            continue;
+        if(len == 0 || (*err != EAGAIN && *err != EWOULDBLOCK))
+            upstream_.is_eof = true; // nothing more from it, either closed or broken
+        upstream_.is_drained = true;
+        break;
+    }
+    return len;
 }
 
 inline int HttpConn::GetFd() const
@@ -134,6 +563,26 @@ inline int HttpConn::GetProxyFd() const
     return proxy_fd_;
 }
 
+inline const Location &HttpConn::GetLocation() const
+{
+    return *location_;
+}
+
+inline int HttpConn::GetUpstreamIndex() const
+{
+    return upstream_index_;
+}
+
+inline TimingWheel::TimerNode &HttpConn::GetTimerNode()
+{
+    return timer_node_;
+}
+
+inline TimingWheel::TimerNode &HttpConn::GetConnectTimerNode()
+{
+    return connect_timer_node_;
+}
+
 inline int HttpConn::GetPort() const
 {
     return address_.sin_port;
@@ -144,14 +593,65 @@ inline const char* HttpConn::GetIP() const
     return inet_ntoa(address_.sin_addr);
 }
 
-inline int HttpConn::PendingWriteBytes() const
+inline const sockaddr_in &HttpConn::GetAddress() const
 {
-    return iov_[0].iov_len + iov_[1].iov_len;
+    return address_;
+}
+
+inline std::size_t HttpConn::GetPathHash() const
+{
+    return path_hash_;
+}
+
+inline std::size_t HttpConn::PendingWriteBytes() const
+{
+    std::size_t bytes = 0;
+    for(int i = 0; i < pending_count_; ++i)
+    {
+        auto &pending = exchange_->pending[(pending_begin_ + i) % kMaxPipelined];
+        bytes += pending.head_remain + pending.body_remain + pending.file_remain;
+    }
+    return bytes + pipe_bytes_;
+}
+
+inline bool HttpConn::HasPendingRequest() const
+{
+    return exchange_ && exchange_->read_buff.ReadableBytes() > 0;
 }
 
 inline bool HttpConn::IsKeepAlive() const
 {
-    return request_.IsKeepAlive();
+    return is_keepalive_;
+}
+
+inline bool HttpConn::IsUpstreamDone() const
+{
+    return upstream_.is_done;
+}
+
+inline bool HttpConn::IsUpstreamReusable() const
+{
+    return upstream_.is_done && upstream_.framing != UpstreamResponse::FRAMING::CLOSE && !upstream_.is_close && !upstream_.is_eof;
+}
+
+inline bool HttpConn::IsWaitingUpstream() const
+{
+    return proxy_fd_ == -1 && proxy_process_state_ == PROXY_PROCESS_STATE::PENDING_READ_FROM_PROXY_SERVER;
+}
+
+inline bool HttpConn::IsWaitingFlight() const
+{
+    return cache_store_.is_flight_waiting;
+}
+
+inline bool HttpConn::IsUpstreamConnecting() const
+{
+    return is_upstream_connecting_;
+}
+
+inline void HttpConn::SetUpstreamConnecting(bool is_connecting)
+{
+    is_upstream_connecting_ = is_connecting;
 }
 
 inline bool HttpConn::IsConnected() const
@@ -159,9 +659,10 @@ inline bool HttpConn::IsConnected() const
     return !is_close_;
 }
 
-inline void HttpConn::ResetProxyFd(int new_proxy_fd)
+inline void HttpConn::ResetProxyFd(int new_proxy_fd, int upstream_index)
 {
     proxy_fd_ = new_proxy_fd;
+    upstream_index_ = upstream_index;
 }
 
 } // namespace white
@@ -0,0 +1,96 @@
+#include "protocol/http/http_header_builder.h"
+
+#include <cstring>
+
+namespace white
+{
+
+namespace {
+
+constexpr const char kWeekDays[7][4] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+constexpr const char kMonths[12][4] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+inline char *PutTwoDigits(char *dest, int value)
+{
+    *dest++ = static_cast<char>('0' + value / 10);
+    *dest++ = static_cast<char>('0' + value % 10);
+    return dest;
+}
+
+} // namespace
+
+thread_local HttpDate::Cache HttpDate::cache_;
+
+// the IMF-fixdate of RFC 7231, rendered by hand since strftime() follows the locale
+void HttpDate::Refresh(Cache &cache, std::time_t now)
+{
+    std::tm tm;
+    gmtime_r(&now, &tm);
+    char *dest = cache.line;
+    memcpy(dest, "Date: ", 6);
+    dest += 6;
+    memcpy(dest, kWeekDays[tm.tm_wday], 3);
+    dest += 3;
+    *dest++ = ',';
+    *dest++ = ' ';
+    dest = PutTwoDigits(dest, tm.tm_mday);
+    *dest++ = ' ';
+    memcpy(dest, kMonths[tm.tm_mon], 3);
+    dest += 3;
+    *dest++ = ' ';
+    int year = tm.tm_year + 1900;
+    dest = PutTwoDigits(dest, year / 100 % 100);
+    dest = PutTwoDigits(dest, year % 100);
+    *dest++ = ' ';
+    dest = PutTwoDigits(dest, tm.tm_hour);
+    *dest++ = ':';
+    dest = PutTwoDigits(dest, tm.tm_min);
+    *dest++ = ':';
+    dest = PutTwoDigits(dest, tm.tm_sec);
+    memcpy(dest, " GMT\r\n", 6);
+    cache.second = now;
+}
+
+constexpr HttpHeaderBuilder::StatusIndex HttpHeaderBuilder::MakeStatusIndex()
+{
+    StatusIndex index{};
+    for(auto &slot : index)
+        slot = kNone;
+    for(std::size_t i = 0; i < sizeof(kStatus) / sizeof(kStatus[0]); ++i)
+        index[kStatus[i].code - kMinStatus] = static_cast<std::uint8_t>(i);
+    return index;
+}
+
+constexpr std::uint32_t HttpHeaderBuilder::FindMimeSeed()
+{
+    for(std::uint32_t seed = 1; seed < 4096; ++seed)
+    {
+        bool is_used[kMimeSlotCount] = {};
+        bool is_perfect = true;
+        for(std::size_t i = 0; i < sizeof(kMime) / sizeof(kMime[0]) && is_perfect; ++i)
+        {
+            auto slot = HashExtension(kMime[i].extension, seed) & (kMimeSlotCount - 1);
+            is_perfect = !is_used[slot];
+            is_used[slot] = true;
+        }
+        if(is_perfect)
+            return seed;
+    }
+    throw "No perfect hash for the extensions of kMime!"; // fails the build, it is evaluated at compile time
+}
+
+constexpr HttpHeaderBuilder::MimeSlots HttpHeaderBuilder::MakeMimeSlots(std::uint32_t seed)
+{
+    MimeSlots slots{};
+    for(auto &slot : slots)
+        slot = kNone;
+    for(std::size_t i = 0; i < sizeof(kMime) / sizeof(kMime[0]); ++i)
+        slots[HashExtension(kMime[i].extension, seed) & (kMimeSlotCount - 1)] = static_cast<std::uint8_t>(i);
+    return slots;
+}
+
+constexpr HttpHeaderBuilder::StatusIndex HttpHeaderBuilder::kStatusIndex = MakeStatusIndex();
+constexpr std::uint32_t HttpHeaderBuilder::kMimeSeed = FindMimeSeed();
+constexpr HttpHeaderBuilder::MimeSlots HttpHeaderBuilder::kMimeSlots = MakeMimeSlots(kMimeSeed);
+
+} // namespace white
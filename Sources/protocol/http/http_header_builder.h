@@ -0,0 +1,331 @@
+#ifndef WHITEWEBSERVER_PROTOCOL_HTTP_HTTP_HEADER_BUILDER_H_
+#define WHITEWEBSERVER_PROTOCOL_HTTP_HTTP_HEADER_BUILDER_H_
+
+#include "buffer/buffer_chain.h"
+
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <string_view>
+
+namespace white
+{
+
+/**
+ * @brief The Date header of the responses, rendered once a second by each thread. The event loop refreshes it
+ * once per tick, a thread without a loop, such as a worker of the pool, checks the clock when it asks for it.
+ */
+class HttpDate
+{
+public:
+    /**
+     * @brief Render the header again if the second changed since the last tick of this thread.
+     *
+     */
+    static void Tick();
+
+    /**
+     * @brief "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n", always kLineSize bytes.
+     *
+     * @return std::string_view
+     */
+    static std::string_view Line();
+
+public:
+    static constexpr std::size_t kLineSize = 37;
+
+private:
+    struct Cache
+    {
+        std::time_t second = -1;
+        bool is_ticked = false; // by an event loop, the clock is not read by Line()
+        char line[kLineSize];
+    };
+
+private:
+    static void Refresh(Cache &cache, std::time_t now);
+
+private:
+    static thread_local Cache cache_;
+};
+
+/**
+ * @brief Writes the head of a response straight into the output buffer. The status lines and the Content-type
+ * lines are rendered at compile time, the type is found by a perfect hash on the extension of the path.
+ */
+class HttpHeaderBuilder
+{
+public:
+    explicit HttpHeaderBuilder(BufferChain &buff);
+
+    /**
+     * @brief False for a code without a status line.
+     *
+     * @param code
+     * @return true
+     * @return false
+     */
+    static bool IsKnownStatus(int code);
+
+    /**
+     * @brief "Not Found" for 404, empty for a code unknown.
+     *
+     * @param code
+     * @return std::string_view
+     */
+    static std::string_view ReasonPhrase(int code);
+
+    /**
+     * @brief Get the mime type by the suffix of the path, "text/plain" if it is unknown.
+     *
+     * @param path
+     * @return std::string_view
+     */
+    static std::string_view MimeType(std::string_view path);
+
+    /**
+     * @brief The status line for the version "1.0" or "1.1" of the request, the code must be known.
+     *
+     * @param version
+     * @param code
+     */
+    void StatusLine(std::string_view version, int code);
+    void Date();
+    void ContentType(std::string_view path);
+    void Header(std::string_view name, std::string_view value);
+
+    /**
+     * @brief Header lines rendered beforehand, each one ended by CRLF.
+     *
+     * @param lines
+     */
+    void Fragment(std::string_view lines);
+
+    /**
+     * @brief The last header, followed by the empty line.
+     *
+     * @param len
+     */
+    void ContentLength(std::size_t len);
+
+public:
+    // the headers common to the responses, whole lines
+    static constexpr std::string_view kConnectionClose = "Connection: Close\r\n";
+    static constexpr std::string_view kConnectionKeepAlive = "Connection: keep-alive\r\nkeep-alive: max=6, timeout=120\r\n";
+    static constexpr std::string_view kCacheControl = "Cache-Control: max-age=31536000\r\n";
+    static constexpr std::string_view kServer = "Server: WhiteWebServer\r\n";
+
+private:
+    struct Status
+    {
+        int code;
+        std::string_view line; // of HTTP/1.1
+    };
+
+    struct Mime
+    {
+        std::string_view extension; // without the dot
+        std::string_view line; // the Content-type header
+    };
+
+    static constexpr std::string_view kVersionPrefix = "HTTP/1.1";
+    static constexpr std::string_view kContentTypePrefix = "Content-type: ";
+    static constexpr std::string_view kPlainTextLine = "Content-type: text/plain\r\n";
+
+    static constexpr Status kStatus[] = {
+        { 200, "HTTP/1.1 200 OK\r\n" },
+        { 204, "HTTP/1.1 204 No Content\r\n" },
+        { 206, "HTTP/1.1 206 Partial Content\r\n" },
+        { 301, "HTTP/1.1 301 Moved Permanently\r\n" },
+        { 302, "HTTP/1.1 302 Found\r\n" },
+        { 303, "HTTP/1.1 303 See Other\r\n" },
+        { 304, "HTTP/1.1 304 Not Modified\r\n" },
+        { 307, "HTTP/1.1 307 Temporary Redirect\r\n" },
+        { 308, "HTTP/1.1 308 Permanent Redirect\r\n" },
+        { 400, "HTTP/1.1 400 Bad Request\r\n" },
+        { 401, "HTTP/1.1 401 Unauthorized\r\n" },
+        { 403, "HTTP/1.1 403 Forbidden\r\n" },
+        { 404, "HTTP/1.1 404 Not Found\r\n" },
+        { 500, "HTTP/1.1 500 Internal Server Error\r\n" },
+        { 502, "HTTP/1.1 502 Bad Gateway\r\n" },
+        { 503, "HTTP/1.1 503 Service Unavailable\r\n" },
+        { 504, "HTTP/1.1 504 Gateway Timeout\r\n" },
+    };
+
+    static constexpr Mime kMime[] = {
+        { "html",  "Content-type: text/html\r\n" },
+        { "xml",   "Content-type: text/xml\r\n" },
+        { "xhtml", "Content-type: application/xhtml+xml\r\n" },
+        { "txt",   "Content-type: text/plain\r\n" },
+        { "rtf",   "Content-type: application/rtf\r\n" },
+        { "pdf",   "Content-type: application/pdf\r\n" },
+        { "word",  "Content-type: application/nsword\r\n" },
+        { "png",   "Content-type: image/png\r\n" },
+        { "gif",   "Content-type: image/gif\r\n" },
+        { "jpg",   "Content-type: image/jpeg\r\n" },
+        { "jpeg",  "Content-type: image/jpeg\r\n" },
+        { "au",    "Content-type: audio/basic\r\n" },
+        { "mpeg",  "Content-type: video/mpeg\r\n" },
+        { "mpg",   "Content-type: video/mpeg\r\n" },
+        { "avi",   "Content-type: video/x-msvideo\r\n" },
+        { "gz",    "Content-type: application/x-gzip\r\n" },
+        { "tar",   "Content-type: application/x-tar\r\n" },
+        { "css",   "Content-type: text/css\r\n" },
+        { "js",    "Content-type: text/javascript\r\n" },
+    };
+
+    static constexpr int kMinStatus = 100;
+    static constexpr int kMaxStatus = 599;
+    static constexpr std::uint8_t kNone = 0xff;
+    static constexpr std::size_t kMimeSlotCount = 64; // a power of two
+    static constexpr std::size_t kMaxExtension = 5;
+
+    using StatusIndex = std::array<std::uint8_t, kMaxStatus - kMinStatus + 1>;
+    using MimeSlots = std::array<std::uint8_t, kMimeSlotCount>;
+
+private:
+    static constexpr StatusIndex MakeStatusIndex();
+    static constexpr std::uint32_t HashExtension(std::string_view extension, std::uint32_t seed);
+
+    /**
+     * @brief Try the seeds one by one until the extensions known fall into distinct slots.
+     *
+     * @return std::uint32_t
+     */
+    static constexpr std::uint32_t FindMimeSeed();
+    static constexpr MimeSlots MakeMimeSlots(std::uint32_t seed);
+    static std::string_view ContentTypeLine(std::string_view path);
+
+private:
+    // made at compile time from kStatus and kMime
+    static const StatusIndex kStatusIndex;
+    static const std::uint32_t kMimeSeed;
+    static const MimeSlots kMimeSlots;
+
+    BufferChain &buff_;
+};
+
+inline void HttpDate::Tick()
+{
+    cache_.is_ticked = true;
+    std::time_t now = std::time(nullptr);
+    if(now != cache_.second)
+        Refresh(cache_, now);
+}
+
+inline std::string_view HttpDate::Line()
+{
+    if(!cache_.is_ticked)
+    {
+        std::time_t now = std::time(nullptr);
+        if(now != cache_.second)
+            Refresh(cache_, now);
+    }
+    return std::string_view(cache_.line, kLineSize);
+}
+
+inline HttpHeaderBuilder::HttpHeaderBuilder(BufferChain &buff) : buff_(buff)
+{
+
+}
+
+inline bool HttpHeaderBuilder::IsKnownStatus(int code)
+{
+    return code >= kMinStatus && code <= kMaxStatus && kStatusIndex[code - kMinStatus] != kNone;
+}
+
+inline std::string_view HttpHeaderBuilder::ReasonPhrase(int code)
+{
+    if(!IsKnownStatus(code))
+        return {};
+    auto line = kStatus[kStatusIndex[code - kMinStatus]].line;
+    return line.substr(13, line.size() - 15); // "HTTP/1.1 200 " and CRLF
+}
+
+inline std::string_view HttpHeaderBuilder::MimeType(std::string_view path)
+{
+    auto line = ContentTypeLine(path);
+    return line.substr(kContentTypePrefix.size(), line.size() - kContentTypePrefix.size() - 2);
+}
+
+inline void HttpHeaderBuilder::StatusLine(std::string_view version, int code)
+{
+    auto line = kStatus[kStatusIndex[code - kMinStatus]].line;
+    if(version == "1.1")
+    {
+        buff_.Append(line);
+        return;
+    }
+    buff_.Append("HTTP/", 5);
+    buff_.Append(version);
+    buff_.Append(line.substr(kVersionPrefix.size()));
+}
+
+inline void HttpHeaderBuilder::Date()
+{
+    buff_.Append(HttpDate::Line());
+}
+
+inline void HttpHeaderBuilder::ContentType(std::string_view path)
+{
+    buff_.Append(ContentTypeLine(path));
+}
+
+inline void HttpHeaderBuilder::Header(std::string_view name, std::string_view value)
+{
+    buff_.Append(name);
+    buff_.Append(": ", 2);
+    buff_.Append(value);
+    buff_.Append("\r\n", 2);
+}
+
+inline void HttpHeaderBuilder::Fragment(std::string_view lines)
+{
+    buff_.Append(lines);
+}
+
+inline void HttpHeaderBuilder::ContentLength(std::size_t len)
+{
+    static constexpr std::string_view kName = "Content-Length: ";
+    char line[kName.size() + 24 + 4];
+    kName.copy(line, kName.size());
+    char *end = std::to_chars(line + kName.size(), line + sizeof(line), len).ptr;
+    *end++ = '\r';
+    *end++ = '\n';
+    *end++ = '\r';
+    *end++ = '\n';
+    buff_.Append(line, end - line);
+}
+
+// the suffixes are matched as they are, case included
+inline std::string_view HttpHeaderBuilder::ContentTypeLine(std::string_view path)
+{
+    auto idx = path.find_last_of('.');
+    if(idx == std::string_view::npos)
+        return kPlainTextLine;
+    auto extension = path.substr(idx + 1);
+    if(extension.empty() || extension.size() > kMaxExtension)
+        return kPlainTextLine;
+    auto slot = kMimeSlots[HashExtension(extension, kMimeSeed) & (kMimeSlotCount - 1)];
+    if(slot == kNone || kMime[slot].extension != extension)
+        return kPlainTextLine;
+    return kMime[slot].line;
+}
+
+// FNV-1a from the seed
+constexpr std::uint32_t HttpHeaderBuilder::HashExtension(std::string_view extension, std::uint32_t seed)
+{
+    std::uint32_t hash = 2166136261u ^ seed;
+    for(char ch : extension)
+    {
+        hash ^= static_cast<unsigned char>(ch);
+        hash *= 16777619u;
+    }
+    return hash ^ (hash >> 15);
+}
+
+} // namespace white
+
+#endif
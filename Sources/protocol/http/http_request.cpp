@@ -5,6 +5,7 @@
  */ 
 #include <protocol/http/http_request.h>
 
+#include <charconv>
 #include <tuple>
 #include <cctype>
 
@@ -43,13 +44,17 @@ inline std::string ConvertPercentEncoding(const std::string &str, int begin, int
 namespace white
 {
 
-inline void AddCustomHeader(Buffer &buff, const std::string& header_fields, const std::string& value)
+inline void AddCustomHeader(BufferChain &buff, std::string_view header_fields, std::string_view value)
 {
-    buff.Append(header_fields + ": " + value + "\r\n");
+    buff.Append(header_fields);
+    buff.Append(": ", 2);
+    buff.Append(value);
+    buff.Append("\r\n", 2);
 }
 
 HttpRequest::HttpRequest()
 {
+    header_.reserve(kReservedHeaders);
     Init();
 }
 
@@ -60,204 +65,216 @@ HttpRequest::~HttpRequest()
 
 void HttpRequest::Init()
 {
-    method_ = path_ = body_ = "";
+    method_ = body_ = "";
     version_ = "1.1";
+    path_ = {0, 0};
+    base_ = nullptr;
+    parsed_ = 0;
+    is_keepalive_ = false;
     state_ = PARSE_STATE::REQUEST_LINE;
+    line_scan_.Reset();
     header_.clear();
     post_.clear();
 }
 
-// parse one line each time.
-std::pair<HttpRequest::LINE_STATUS, std::size_t> HttpRequest::ParseLine(Buffer &buff)
+// parse one line each time, the bytes scanned before are never scanned again.
+std::pair<HttpRequest::LINE_STATUS, std::size_t> HttpRequest::ParseLine(const Buffer &buff)
 {
-    if(state_ == PARSE_STATE::BODY) // if only body remain to be parsed, return immediately
-        return {LINE_STATUS::LINE_OK, buff.ReadableBytes()};
-    char *begin = buff.ReadBegin();
-    char *end = buff.WriteBegin();
-    std::size_t line_len = 0;
-    for (; begin != end; ++begin)
+    const char *begin = base_ + parsed_;
+    std::size_t len = buff.ReadableBytes() - parsed_;
+    ScanLine(begin, len, line_scan_);
+    std::size_t line_end = line_scan_.line_end;
+    if(line_end == LineScan::npos)
+        return {LINE_STATUS::LINE_OPEN, 0};
+    if(begin[line_end] == '\n') // without '\r' before
+        return {LINE_STATUS::LINE_BAD, 0};
+    if(line_end + 1 == len)
     {
-        ++line_len;
-        if (*begin == '\r')
-        {
-            if(begin + 1 == end)
-                return {LINE_STATUS::LINE_OPEN, 0};
-            else if(*(begin + 1) == '\n')
-            {
-                *(begin) = *(begin + 1) = '\0';
-                return {LINE_STATUS::LINE_OK, line_len + 1};
-            }
-        }else if(*begin == '\n') // before
-        {
-            if(*(begin - 1) == '\r')
-            {
-                *(begin) = *(begin - 1) = '\0';
-                return {LINE_STATUS::LINE_OK, line_len + 1};
-            }
-            return {LINE_STATUS::LINE_BAD, 0};
-        }
+        line_scan_.line_end = LineScan::npos; // wait for the '\n'
+        return {LINE_STATUS::LINE_OPEN, 0};
     }
-    return {LINE_STATUS::LINE_OPEN, 0};
+    if(begin[line_end + 1] != '\n')
+        return {LINE_STATUS::LINE_BAD, 0};
+    return {LINE_STATUS::LINE_OK, line_end + 2};
 }
 
-// unable to handling incomplete request
-HttpRequest::HTTP_CODE HttpRequest::Parse(Buffer &buff)
+// continue from where the last call stopped, the buffer may have been moved since then
+HttpRequest::HTTP_CODE HttpRequest::Parse(const Buffer &buff)
 {
     if(buff.ReadableBytes() == 0)
         return HTTP_CODE::NO_REQUEST;
+    base_ = buff.ReadBeginConst();
     LINE_STATUS line_state;
     std::size_t line_len;
-    while (buff.ReadableBytes())
+    while (state_ != PARSE_STATE::FINISH)
     {
+        if(state_ == PARSE_STATE::BODY)
+        {
+            if(!ParseBody(buff))
+                return HTTP_CODE::NO_REQUEST;
+            continue;
+        }
         std::tie(line_state, line_len) = ParseLine(buff);
-        if(line_state != LINE_STATUS::LINE_OK)
+        if(line_state == LINE_STATUS::LINE_OPEN)
             return HTTP_CODE::NO_REQUEST;
-        LOG_DEBUG("got a new line: ", buff.ReadBegin());
-        switch (state_)
+        const char *line = base_ + parsed_;
+        if(line_state == LINE_STATUS::LINE_BAD
+           || !(state_ == PARSE_STATE::REQUEST_LINE ? ParseRequestLine(line) : ParseHeader(line)))
         {
-            case PARSE_STATE::REQUEST_LINE:
-                if(!ParseRequestLine(buff))
-                {
-                    state_ = PARSE_STATE::FINISH;
-                    return HTTP_CODE::BAD_REQUEST;
-                }
-                break;
-            case PARSE_STATE::HEADERS:
-                if(!ParseHeader(buff))
-                {
-                    state_ = PARSE_STATE::FINISH;
-                    return HTTP_CODE::BAD_REQUEST;
-                }
-                break;
-            case PARSE_STATE::BODY:
-                if(!ParseBody(buff))
-                    return HTTP_CODE::NO_REQUEST;
-                break;
-            default:
-                break;
+            Finish();
+            return HTTP_CODE::BAD_REQUEST;
         }
-        buff.Retrieve(line_len); // this line has been parsed
-    }
-    // state_ == finish
-    if(state_ == PARSE_STATE::FINISH)
-    {
-        LOG_DEBUG("method: [", method_.c_str(), "] path: [", path_.c_str(), "] version: [", version_.c_str(), "]");
-        return HTTP_CODE::GET_REQUEST;
+        LOG_DEBUG("got a new line: ", std::string_view(line, line_scan_.line_end));
+        parsed_ += line_len; // this line has been parsed
+        line_scan_.Reset();
     }
-    return HTTP_CODE::NO_REQUEST;
+    LOG_DEBUG("method: [", method_, "] path: [", Path(), "] version: [", version_, "]");
+    return HTTP_CODE::GET_REQUEST;
 }
 
-void HttpRequest::MakeProxyRequests(Buffer &buff, const std::string &origin_ip)
+void HttpRequest::Finish()
 {
-    buff.Append(method_ + " " + path_ + " HTTP/" + version_ + "\r\n");
-    for(auto& [key, value] : header_)
-        AddCustomHeader(buff, key, value);
+    state_ = PARSE_STATE::FINISH;
+    // enable by default in http1.1
+    auto connection = Header("Connection");
+    if(connection.empty())
+        is_keepalive_ = version_ == "1.1";
+    else
+        is_keepalive_ = EqualsIgnoreCase(connection, "keep-alive");
+}
+
+// written piece by piece, the path and the headers are still in the read buffer
+void HttpRequest::MakeProxyRequests(BufferChain &buff, std::string_view origin_ip)
+{
+    auto host = Header("Host");
+    buff.Append(method_);
+    buff.Append(" ", 1);
+    buff.Append(Path());
+    buff.Append(" HTTP/", 6);
+    buff.Append(version_);
+    buff.Append("\r\n", 2);
+    for(auto &field : header_)
+    {
+        auto name = View(field.name);
+        auto value = View(field.value);
+        // hop-by-hop, the connection to the upstream is kept alive regardless of the client
+        if(EqualsIgnoreCase(name, "Connection") || EqualsIgnoreCase(name, "Keep-Alive") || EqualsIgnoreCase(name, "Proxy-Connection"))
+            continue;
+        buff.Append(name.data(), name.size());
+        buff.Append(": ", 2);
+        buff.Append(value.data(), value.size());
+        buff.Append("\r\n", 2);
+    }
     AddCustomHeader(buff, "X-Forwarded-For", origin_ip);
-    AddCustomHeader(buff, "X-Forwarded-Host", header_["HOST"]);
+    AddCustomHeader(buff, "X-Forwarded-Host", host);
     AddCustomHeader(buff, "X-Forwarded-Proto", "http");
-    AddCustomHeader(buff, "Forwarded", "for=" + origin_ip + ";host=" + header_["HOST"] + ";proto=http"); // https://www.nginx.com/resources/wiki/start/topics/examples/forwarded/
+    // https://www.nginx.com/resources/wiki/start/topics/examples/forwarded/
+    buff.Append("Forwarded: for=");
+    buff.Append(origin_ip);
+    buff.Append(";host=");
+    buff.Append(host);
+    buff.Append(";proto=http\r\n");
     AddCustomHeader(buff, "via", "WhiteWebServer_Proxy");
+    AddCustomHeader(buff, "Connection", "keep-alive");
     buff.Append("\r\n");
     if(!body_.empty())
         buff.Append(body_);
 }
 
-bool HttpRequest::ParsePath()
+// the method ends at the first delimiter and the version begins after the last one
+bool HttpRequest::ParseRequestLine(const char *line)
 {
-    if(path_ == "/")
-    {
-        path_ = "/index.html";
-        return true;
-    }
-    return false;
-}
-
-bool HttpRequest::ParseRequestLine(Buffer &buff)
-{
-    auto line_begin = buff.ReadBegin();
-    auto url = strpbrk(line_begin, " \t");
-    if (!url)
+    std::size_t method_end = line_scan_.first_delimiter;
+    std::size_t version_begin = line_scan_.last_delimiter;
+    if(method_end == LineScan::npos || method_end == version_begin
+       || line[method_end] == ':' || line[version_begin] == ':')
         return false;
-    *url++ = '\0';
-    char *method = line_begin;
-    if(strcasecmp(method, "GET") == 0)
+    std::string_view method(line, method_end);
+    if(EqualsIgnoreCase(method, "GET"))
         method_ = "GET";
-    else if(strcasecmp(method, "POST") == 0)
+    else if(EqualsIgnoreCase(method, "POST"))
         method_ = "POST";
+    else if(EqualsIgnoreCase(method, "HEAD"))
+        method_ = "HEAD";
     else
         return false;
-    url += strspn(url, " \t"); // skip space
-    auto version = strpbrk(url, " \t");
-    if(!version)
-        return false;     
-    *version++ = '\0';
-    version += strspn(version, " \t");
-    if (strcasecmp(version, "HTTP/1.1") == 0)
+    std::string_view version(line + version_begin + 1, line_scan_.line_end - version_begin - 1);
+    if (EqualsIgnoreCase(version, "HTTP/1.1"))
         version_ = "1.1";
-    else if(strcasecmp(version, "HTTP/1.0") == 0)
+    else if(EqualsIgnoreCase(version, "HTTP/1.0"))
         version_ = "1.0";
     else
         return false;
 
-    if (strncasecmp(url, "http://", 7) == 0)
-    {
-        url += 7;
-        url = strchr(url, '/'); // skip domain
-    }
+    // skip space
+    const char *url_begin = line + method_end + 1;
+    const char *url_end = line + version_begin;
+    while(url_begin < url_end && (*url_begin == ' ' || *url_begin == '\t'))
+        ++url_begin;
+    while(url_end > url_begin && (url_end[-1] == ' ' || url_end[-1] == '\t'))
+        --url_end;
+    std::string_view url(url_begin, url_end - url_begin);
 
-    if (strncasecmp(url, "https://", 8) == 0)
+    std::size_t scheme_len = 0;
+    if (url.size() >= 7 && EqualsIgnoreCase(url.substr(0, 7), "http://"))
+        scheme_len = 7;
+    else if (url.size() >= 8 && EqualsIgnoreCase(url.substr(0, 8), "https://"))
+        scheme_len = 8;
+    if(scheme_len)
     {
-        url += 8;
-        url = strchr(url, '/');
+        auto path_begin = url.find('/', scheme_len); // skip domain
+        if(path_begin == std::string_view::npos)
+            return false;
+        url.remove_prefix(path_begin);
     }
-    if(!url || url[0] != '/')
+    if(url.empty() || url[0] != '/')
         return false;
-    path_ = std::string(url);
+    path_ = MakeField(url.data(), url.size());
     state_ = PARSE_STATE::HEADERS;
     return true;
 }
 
-bool HttpRequest::ParseHeader(Buffer &buff)
+bool HttpRequest::ParseHeader(const char *line)
 {
-    auto line_begin = buff.ReadBegin();
-    if (*line_begin == '\0')
+    if (line_scan_.line_end == 0)
     {
-        if(header_.count("CONTENT-LENGTH"))
+        if(!Header("Content-Length").empty())
             state_ = PARSE_STATE::BODY;
         else
-            state_ = PARSE_STATE::FINISH;
+            Finish();
         return true;
     }
-    char* value = strpbrk(line_begin, ": \t");
-    if(!value)
+    std::size_t key_end = line_scan_.first_delimiter;
+    if(key_end == LineScan::npos || key_end == 0)
         return false;
-    *value++ = '\0';
-    value += strspn(value, ": \t");
-    if(!value)
-        return false;
-    std::string key(line_begin);
-    header_[StrToupper(key)] = std::string(value);
+    const char *line_end = line + line_scan_.line_end;
+    const char *value = line + key_end + 1;
+    while(value < line_end && (*value == ':' || *value == ' ' || *value == '\t'))
+        ++value;
+    header_.push_back({MakeField(line, key_end), MakeField(value, line_end - value)});
     return true;
 }
 
 // It may be necessary to continue for the case of not reading all at once
 bool HttpRequest::ParseBody(const Buffer &buff)
 {
-    if(buff.ReadableBytes() >= std::stoi(header_["CONTENT-LENGTH"]))
-    {
-        body_ = std::string(buff.ReadBeginConst());
-        ParsePost();
-        state_ = PARSE_STATE::FINISH;
-        return true;
-    }
-    return false;
+    std::size_t content_length = 0;
+    auto value = Header("Content-Length");
+    std::from_chars(value.data(), value.data() + value.size(), content_length);
+    if(buff.ReadableBytes() - parsed_ < content_length)
+        return false;
+    body_.assign(base_ + parsed_, content_length);
+    parsed_ += content_length;
+    ParsePost();
+    Finish();
+    return true;
 }
 
 // remain
 void HttpRequest::ParsePost()
 {
-    const std::string &content_type = header_["CONTENT-TYPE"];
-    if(strncasecmp(content_type.c_str(), "application/x-www-form-urlencoded", 33) == 0)
+    auto content_type = Header("Content-Type");
+    if(content_type.size() >= 33 && strncasecmp(content_type.data(), "application/x-www-form-urlencoded", 33) == 0)
     {
         std::size_t n = body_.size();
         int begin = 0;
@@ -276,7 +293,7 @@ void HttpRequest::ParsePost()
         post_[std::move(key)] = std::move(value);
         LOG_DEBUG(post_);
 
-    }else if(strncasecmp(content_type.c_str(), "application/json", 16) == 0)
+    }else if(content_type.size() >= 16 && strncasecmp(content_type.data(), "application/json", 16) == 0)
     {
         Json::Reader reader;
         if(!reader.parse(body_, post_))
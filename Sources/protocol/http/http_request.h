@@ -8,8 +8,14 @@
 
 #include "logger/logger.h"
 #include "buffer/buffer.h"
+#include "buffer/buffer_chain.h"
+#include "protocol/http/http_scanner.h"
 
+#include <cstdint>
 #include <string>
+#include <string_view>
+#include <strings.h>
+#include <vector>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
@@ -60,50 +66,95 @@ protected:
     ~HttpRequest();
 
     void Init();
-    HTTP_CODE Parse(Buffer &buff);
 
-    void MakeProxyRequests(Buffer &buff, const std::string &origin_ip);
+    /**
+     * @brief Parse the request at the beginning of the buffer without consuming it, the path and the headers
+     * are views into the buffer, so retrieve Length() bytes only after the response is produced.
+     * 
+     * @param buff 
+     * @return HTTP_CODE 
+     */
+    HTTP_CODE Parse(const Buffer &buff);
+
+    void MakeProxyRequests(BufferChain &buff, std::string_view origin_ip);
 
-    const std::string& Path() const;
+    std::string_view Path() const;
     const std::string& Method() const;
     const std::string& Version() const;
+
+    /**
+     * @brief Get the value of the header, the name is case-insensitive. Empty if missing.
+     * 
+     * @param name 
+     * @return std::string_view 
+     */
+    std::string_view Header(std::string_view name) const;
     Json::Value GetPost(const std::string &key) const;
 
+    /**
+     * @brief Bytes of the request parsed so far.
+     * 
+     * @return std::size_t 
+     */
+    std::size_t Length() const;
+
     bool IsFinish() const;
     bool IsKeepAlive() const;
 
+private:
+    // a piece of the request, by offset from the beginning of the request
+    struct Field
+    {
+        uint32_t begin;
+        uint32_t len;
+    };
+
+    struct HeaderField
+    {
+        Field name;
+        Field value;
+    };
+
+private:
+    static constexpr std::size_t kReservedHeaders = 32;
+
 private:
     /**
-     * @brief Parsing status, if the parsing is successful, the second parameter is the length of the current line, including the trailing '\0'。
+     * @brief Parsing status, if the parsing is successful, the second parameter is the length of the current line, including the trailing CRLF.
      * 
      * @param buff 
      * @return std::pair<LINE_STATUS, std::size_t> 
      */
-    std::pair<LINE_STATUS, std::size_t> ParseLine(Buffer &buff);
+    std::pair<LINE_STATUS, std::size_t> ParseLine(const Buffer &buff);
 
-    bool ParseRequestLine(Buffer &buff);
-    bool ParseHeader(Buffer &buff);
+    bool ParseRequestLine(const char *line);
+    bool ParseHeader(const char *line);
     bool ParseBody(const Buffer &buff);
-
-    /**
-     * @brief Return true is path changed.
-     * 
-     * @return true 
-     * @return false 
-     */
-    bool ParsePath();
     void ParsePost();
+    void Finish();
+
+    std::string_view View(Field field) const;
+    Field MakeField(const char *begin, std::size_t len) const;
 
     PARSE_STATE state_;
+    LineScan line_scan_; // the delimiters of the line being parsed
+    const char *base_; // the beginning of the request in the read buffer, refreshed by every Parse()
+    std::size_t parsed_; // bytes parsed from base_
     std::string method_;
-    std::string path_;
+    Field path_;
     std::string version_;
+    bool is_keepalive_;
     std::string body_;
-    std::unordered_map<std::string, std::string> header_;
+    std::vector<HeaderField> header_; // reserved once, no allocation for the common requests
     Json::Value post_;
 
 };
 
+inline bool EqualsIgnoreCase(std::string_view lhs, std::string_view rhs)
+{
+    return lhs.size() == rhs.size() && strncasecmp(lhs.data(), rhs.data(), lhs.size()) == 0;
+}
+
 inline bool HttpRequest::IsFinish() const
 {
     return state_ == PARSE_STATE::FINISH;
@@ -111,15 +162,35 @@ inline bool HttpRequest::IsFinish() const
 
 inline bool HttpRequest::IsKeepAlive() const
 {
-    // enable by default in http1.1
-    if(!header_.count("CONNECTION"))
-        return version_ == "1.1";
-    return strcasecmp(header_.find("CONNECTION")->second.c_str(), "KEEP-ALIVE") == 0;
+    return is_keepalive_;
+}
+
+inline std::string_view HttpRequest::Path() const
+{
+    return View(path_);
+}
+
+inline std::size_t HttpRequest::Length() const
+{
+    return parsed_;
+}
+
+inline std::string_view HttpRequest::Header(std::string_view name) const
+{
+    for(auto &field : header_)
+        if(EqualsIgnoreCase(View(field.name), name))
+            return View(field.value);
+    return {};
+}
+
+inline std::string_view HttpRequest::View(Field field) const
+{
+    return {base_ + field.begin, field.len};
 }
 
-inline const std::string &HttpRequest::Path() const
+inline HttpRequest::Field HttpRequest::MakeField(const char *begin, std::size_t len) const
 {
-    return path_;
+    return {static_cast<uint32_t>(begin - base_), static_cast<uint32_t>(len)};
 }
 
 inline const std::string &HttpRequest::Method() const
@@ -5,10 +5,9 @@
  */ 
 #include "protocol/http/http_response.h"
 
+#include <charconv>
 #include <string>
 
-#include <unordered_map>
-#include <unordered_set>
 #include <sys/mman.h>
 #include <fcntl.h>
 #include "logger/logger.h"
@@ -17,51 +16,13 @@
 
 namespace white {
 
-const std::unordered_map<std::string, std::string> HttpResponse::kSuffixType = {
-    { ".html",  "text/html" },
-    { ".xml",   "text/xml" },
-    { ".xhtml", "application/xhtml+xml" },
-    { ".txt",   "text/plain" },
-    { ".rtf",   "application/rtf" },
-    { ".pdf",   "application/pdf" },
-    { ".word",  "application/nsword" },
-    { ".png",   "image/png" },
-    { ".gif",   "image/gif" },
-    { ".jpg",   "image/jpeg" },
-    { ".jpeg",  "image/jpeg" },
-    { ".au",    "audio/basic" },
-    { ".mpeg",  "video/mpeg" },
-    { ".mpg",   "video/mpeg" },
-    { ".avi",   "video/x-msvideo" },
-    { ".gz",    "application/x-gzip" },
-    { ".tar",   "application/x-tar" },
-    { ".css",   "text/css "},
-    { ".js",    "text/javascript "},
-};
-
-const std::unordered_map<int, std::string> HttpResponse::kCodeStatus = {
-    { 200, "OK" },
-    { 204, "No Content"},
-    { 206, "Partial Content"},
-    { 301, "Moved Permanently"},
-    { 302, "Found"},
-    { 303, "See Other"},
-    { 304, "Not Modified"},
-    { 307, "Temporary redirect"},
-    { 401, "Unauthorized"},
-    { 400, "Bad Request" },
-    { 403, "Forbidden" },
-    { 404, "Not Found" },
-    { 500, "Internal Server Error"},
-    { 503, "Service Unavailable"},
-};
-
 HttpResponse::HttpResponse() :
 response_code_(-1),
-path_(""),
-src_dir_(""),
 is_keepalive_(true),
-file_address_(nullptr)
+arena_(nullptr),
+file_address_(nullptr),
+file_fd_(-1),
+is_sendfile_(false)
 {
 
 }
@@ -69,9 +30,10 @@ file_address_(nullptr)
 HttpResponse::~HttpResponse()
 {
     Unmap();
+    CloseFile();
 }
 
-void HttpResponse::Init(const std::string& src_dir, const std::string& path, std::shared_ptr<std::vector<std::string>> index_file, const std::string& version, bool is_keepalive, int response_code)
+void HttpResponse::Init(Arena &arena, std::string_view src_dir, std::string_view path, std::shared_ptr<std::vector<std::string>> index_file, std::string_view version, bool is_keepalive, int response_code)
 {
     if(src_dir.empty())
         throw "Source directory can not be empty!";
@@ -81,16 +43,20 @@ void HttpResponse::Init(const std::string& src_dir, const std::string& path, std
         file_address_ = nullptr;
         file_stat_ = {};
     }
-    src_dir_ = src_dir;
-    path_ = path;
-    version_ = version;
+    CloseFile();
+    arena_ = &arena;
+    src_dir_ = arena.Copy(src_dir);
+    path_ = arena.Copy(path);
+    version_ = arena.Copy(version);
+    file_path_ = {};
     is_keepalive_ = is_keepalive;
     response_code_ = response_code;
     index_file_ = index_file;
 }
 
-void HttpResponse::MakeResponse(Buffer& buff)
+void HttpResponse::MakeResponse(BufferChain& buff, bool is_sendfile, OpenFileCache *file_cache)
 {
+    is_sendfile_ = is_sendfile;
     switch(response_code_)
     {
         case 301: // moved permanetly
@@ -99,21 +65,33 @@ void HttpResponse::MakeResponse(Buffer& buff)
         case 304: // move modified
         case 200:
         {
-            LOG_DEBUG("Requested file: ", (src_dir_ + path_).c_str());
+            file_path_ = arena_->Join({src_dir_, path_});
+            LOG_DEBUG("Requested file: ", file_path_);
             if(path_.back() == '/')
             {
                 for(auto &file : *index_file_)
-                    if(access((src_dir_ + path_ + file).c_str(), F_OK) == 0)
+                {
+                    auto index_path = arena_->Join({file_path_, file});
+                    if(file_cache ? file_cache->Get(index_path)->Exists() : access(index_path.data(), F_OK) == 0)
                     {
-                        path_ += file;
+                        path_ = arena_->Join({path_, file});
+                        file_path_ = index_path;
                         response_code_ = 301;
                         break;
                     }
+                }
+            }
+            if(file_cache)
+            {
+                file_entry_ = file_cache->Get(file_path_);
+                file_stat_ = file_entry_->file_stat;
             }
-            if (stat((src_dir_ + path_).c_str(), &file_stat_) < 0 || S_ISDIR(file_stat_.st_mode))
+            if ((file_entry_ ? !file_entry_->Exists() : stat(file_path_.data(), &file_stat_) < 0) || S_ISDIR(file_stat_.st_mode))
                 response_code_ = 404;
             else if(!(file_stat_.st_mode & S_IROTH))    
                 response_code_ = 403;
+            else if(file_entry_ && file_entry_->fd < 0)
+                response_code_ = 500;
             else if(response_code_ == -1)
                 response_code_ = 200;
             break;
@@ -124,33 +102,34 @@ void HttpResponse::MakeResponse(Buffer& buff)
     LOG_DEBUG("Response code: ", response_code_);
     AddStateLine(buff);
     AddHeader(buff);
-    AddContent(buff);
+    if(file_entry_ && IsFileCode())
+        AddContentFromCache(buff);
+    else
+        AddContent(buff);
 }
 
-void HttpResponse::GenerateErrorContent(Buffer& buff, const std::string& message)
+void HttpResponse::GenerateErrorContent(BufferChain& buff, std::string_view message)
 {
-    std::string status;
-    if(kCodeStatus.count(response_code_))
-        status = kCodeStatus.find(response_code_)->second;
-    else
-        status = "Bad Request";
-    auto response_msg = std::to_string(response_code_) + " " + status;
-    std::string body{"<html><head><title>"
-                    + response_msg
-                    + "</title></head><body><center><h1>"
-                    + response_msg
-                    + "</h1><p>"
-                    + message
-                    + "</p></center><hr><em><center>"
-                    + "WhiteWebServer "
-                    + kServerVersion
-                    + "</center></em></body></html>"};
-
-    AddCustomHeader(buff, "Content-Length", std::to_string(body.size()) + "\r\n");
+    auto status_text = HttpHeaderBuilder::ReasonPhrase(response_code_);
+    char code[16];
+    char *code_end = std::to_chars(code, code + sizeof(code), response_code_).ptr;
+    auto response_msg = arena_->Join({std::string_view(code, code_end - code), " ", status_text});
+    auto body = arena_->Join({"<html><head><title>",
+                              response_msg,
+                              "</title></head><body><center><h1>",
+                              response_msg,
+                              "</h1><p>",
+                              message,
+                              "</p></center><hr><em><center>",
+                              "WhiteWebServer ",
+                              kServerVersion,
+                              "</center></em></body></html>"});
+
+    AddContentLength(buff, body.size());
     buff.Append(body);
 }
 
-void HttpResponse::AddContent(Buffer& buff)
+void HttpResponse::AddContent(BufferChain& buff)
 {
     switch(response_code_)
     {
@@ -164,7 +143,7 @@ void HttpResponse::AddContent(Buffer& buff)
             GenerateErrorContent(buff, "Cannot open specific file");
             return;
     }
-    int fd = open((src_dir_ + path_).c_str(), O_RDONLY);
+    int fd = open(file_path_.data(), O_RDONLY);
     if(fd < 0)
     {
         response_code_ = 500;
@@ -172,6 +151,14 @@ void HttpResponse::AddContent(Buffer& buff)
         return;
     }
 
+    if(is_sendfile_)
+    {
+        // the body goes from the page cache to the socket directly, nothing mapped into this process
+        file_fd_ = fd;
+        AddContentLength(buff, file_stat_.st_size);
+        return;
+    }
+
     auto mmap_temp_pt = mmap(0, file_stat_.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
     if(mmap_temp_pt == MAP_FAILED)
     {
@@ -182,8 +169,27 @@ void HttpResponse::AddContent(Buffer& buff)
     }
     file_address_ = (char*)mmap_temp_pt;
     close(fd);
-    AddCustomHeader(buff, "Content-Length", std::to_string(file_stat_.st_size) + "\r\n");
+    AddContentLength(buff, file_stat_.st_size);
 }
 
 
-} // namespace white
\ No newline at end of file
+void HttpResponse::AddContentFromCache(BufferChain& buff)
+{
+    if(is_sendfile_)
+        file_fd_ = file_entry_->fd;
+    else
+    {
+        auto mmap_temp_pt = mmap(0, file_stat_.st_size, PROT_READ, MAP_PRIVATE, file_entry_->fd, 0);
+        if(mmap_temp_pt == MAP_FAILED)
+        {
+            response_code_ = 500;
+            GenerateErrorContent(buff, "Cannot map specific file");
+            return;
+        }
+        file_address_ = (char*)mmap_temp_pt;
+    }
+    buff.Append(file_entry_->header_block);
+    buff.Append("\r\n");
+}
+
+} // namespace white
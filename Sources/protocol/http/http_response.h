@@ -6,38 +6,53 @@
 #ifndef WHITEWEBSERVER_PROTOCOL_HTTP_HTTP_RESPONSE_H
 #define WHITEWEBSERVER_PROTOCOL_HTTP_HTTP_RESPONSE_H
 
-#include "buffer/buffer.h"
+#include "buffer/arena.h"
+#include "buffer/buffer_chain.h"
+#include "cache/open_file_cache.h"
+#include "protocol/http/http_header_builder.h"
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
 #include <sys/stat.h>
 #include <sys/mman.h>
-#include <unordered_map>
+#include <unistd.h>
 
 namespace white {
 
-inline void AddCustomHeader(Buffer &buff, const std::string& header_fields, const std::string& value)
-{
-    buff.Append(header_fields + ": " + value + "\r\n");
-}
-
 class HttpResponse
 {
 
 friend class HttpConn;
 
+public:
+    /**
+     * @brief Get the mime type by the suffix of the path.
+     * 
+     * @param path 
+     * @return std::string_view 
+     */
+    static std::string_view GetMimeType(std::string_view path);
+
 protected:
     HttpResponse();
     ~HttpResponse();
 
-    void Init(const std::string& src_dir, const std::string& path, std::shared_ptr<std::vector<std::string>> index_file, const std::string& version = "1.1", bool is_keepalive = true, int response_code = -1);
+    /**
+     * @brief Reset for a new response, its strings are copied into the arena, which must not be reset before
+     * MakeResponse() returns.
+     * 
+     */
+    void Init(Arena &arena, std::string_view src_dir, std::string_view path, std::shared_ptr<std::vector<std::string>> index_file, std::string_view version = "1.1", bool is_keepalive = true, int response_code = -1);
 
     /**
      * @brief Generate response information and put it into the buffer.
      * 
      * @param buff buffer
+     * @param is_sendfile if true, keep the file open to be sent by sendfile instead of mapping it.
+     * @param file_cache if not null, get the file and its metadata from it.
      */
-    void MakeResponse(Buffer &buff);
+    void MakeResponse(BufferChain &buff, bool is_sendfile = false, OpenFileCache *file_cache = nullptr);
     void Close();
     /**
      * @brief If response contain file, return true
@@ -49,10 +64,29 @@ protected:
     const char* FileAddr() const;
     const int FileSize() const;
 
+    /**
+     * @brief If the file is to be sent by sendfile, return true
+     * 
+     * @return true 
+     * @return false 
+     */
+    bool HasFileFd() const;
+    int FileFd() const;
+
+    /**
+     * @brief False if the connection is to be closed after this response.
+     * 
+     * @return true 
+     * @return false 
+     */
+    bool IsKeepAlive() const;
+
 private:
-    void AddStateLine(Buffer &buff);
-    void AddHeader(Buffer &buff);
-    void AddContent(Buffer &buff);
+    void AddStateLine(BufferChain &buff);
+    void AddHeader(BufferChain &buff);
+    void AddContent(BufferChain &buff);
+    void AddContentFromCache(BufferChain &buff);
+    bool IsFileCode() const;
 
     /**
      * @brief If error happened, generate a page to display error.
@@ -60,37 +94,67 @@ private:
      * @param buff 
      * @param message error message
      */
-    void GenerateErrorContent(Buffer &buff, const std::string &message);
+    void GenerateErrorContent(BufferChain &buff, std::string_view message);
 
     /**
-     * @brief Select the html file corresponding to the response code
+     * @brief The last header, followed by the empty line.
      * 
+     * @param buff 
+     * @param len 
      */
-    void GenerateErrorHtml();
-    std::string GetFileType();
+    void AddContentLength(BufferChain &buff, std::size_t len);
+    bool IsErrorPageCode() const;
     void Unmap();
+    void CloseFile();
 
 private:
     int response_code_;
     bool is_keepalive_;
 
-    std::string path_;
-    std::string src_dir_;
-    std::string version_;
+    Arena *arena_;
+    std::string_view path_; // the strings are in the arena
+    std::string_view src_dir_;
+    std::string_view version_;
+    std::string_view file_path_; // src_dir_ and path_, '\0' terminated
     std::shared_ptr<std::vector<std::string>> index_file_;
 
     char *file_address_;
+    int file_fd_;
+    bool is_sendfile_;
     struct stat file_stat_;
 
-    static const std::unordered_map<std::string, std::string> kSuffixType;
-    static const std::unordered_map<int, std::string> kCodeStatus;
-    static const std::unordered_map<int, std::string> kCodePath;
+    OpenFileCache::EntryPtr file_entry_; // the fd in it is shared, never closed here
 
 };
 
 inline void HttpResponse::Close()
 {
     Unmap();
+    CloseFile();
+}
+
+inline void HttpResponse::CloseFile()
+{
+    if(file_fd_ >= 0 && !file_entry_)
+        close(file_fd_);
+    file_fd_ = -1;
+    file_entry_.reset();
+}
+
+// the codes whose body is the requested file
+inline bool HttpResponse::IsFileCode() const
+{
+    switch(response_code_)
+    {
+        case 301: // moved permanetly
+        case 302: // found
+        case 303: // see other
+        case 304: // not modified
+        case 200:
+            return true;
+        default:
+            return false;
+    }
 }
 
 inline void HttpResponse::Unmap()
@@ -102,63 +166,60 @@ inline void HttpResponse::Unmap()
     }
 }
 
-inline void HttpResponse::AddStateLine(Buffer& buff)
+inline void HttpResponse::AddStateLine(BufferChain& buff)
 {
-    if(!kCodeStatus.count(response_code_))
+    if(!HttpHeaderBuilder::IsKnownStatus(response_code_))
         response_code_ = 400;
-    std::string status{kCodeStatus.find(response_code_)->second};
-    buff.Append("HTTP/" + version_ + " " + std::to_string(response_code_) + " " + status + "\r\n");
+    HttpHeaderBuilder builder(buff);
+    builder.StatusLine(version_, response_code_);
+    builder.Date(); // right after the status line, where a hot object has it replaced
 }
 
-inline void HttpResponse::AddHeader(Buffer& buff)
+inline void HttpResponse::AddHeader(BufferChain& buff)
 {
+    HttpHeaderBuilder builder(buff);
     // add content-type
     switch(response_code_)
     {
         case 404:
+        case 502: // bad gateway
+        case 504: // gateway timeout
             is_keepalive_ = false;
-            AddCustomHeader(buff, "Connection", "Close");
+            builder.Fragment(HttpHeaderBuilder::kConnectionClose);
             break;
         case 301:
-            AddCustomHeader(buff, "Location", path_);
+            builder.Header("Location", path_);
         case 302: // found
         case 303: // see other
         case 304: // move modified
         case 200:
             // add connection
             if(!(version_ == "1.1" && is_keepalive_))
-            {
-                if(is_keepalive_)
-                {
-                    AddCustomHeader(buff, "Connection", "keep-alive");
-                    AddCustomHeader(buff, "keep-alive", "max=6, timeout=120");
-                }
-                else
-                    AddCustomHeader(buff, "Connection", "Close");
-            }
+                builder.Fragment(is_keepalive_ ? HttpHeaderBuilder::kConnectionKeepAlive : HttpHeaderBuilder::kConnectionClose);
             break;
         default:
             break;
     }
 
-    AddCustomHeader(buff, "Content-type", GetFileType());
-    if(version_ == "1.1")
+    if(!(file_entry_ && IsFileCode())) // the cached header block carries it
     {
-        AddCustomHeader(buff, "Cache-Control", "max-age=31536000");
+        if(IsErrorPageCode())
+            builder.Fragment("Content-type: text/html\r\n");
+        else
+            builder.ContentType(path_);
     }
-    AddCustomHeader(buff, "Server", "WhiteWebServer");
+    if(version_ == "1.1")
+        builder.Fragment(HttpHeaderBuilder::kCacheControl);
+    builder.Fragment(HttpHeaderBuilder::kServer);
 }
 
-inline void HttpResponse::GenerateErrorHtml()
+inline void HttpResponse::AddContentLength(BufferChain &buff, std::size_t len)
 {
-    if(kCodePath.count(response_code_))
-    {
-        path_ = kCodePath.find(response_code_)->second;
-        stat((src_dir_ + path_).data(), &file_stat_);
-    }
+    HttpHeaderBuilder(buff).ContentLength(len);
 }
 
-inline std::string HttpResponse::GetFileType()
+// the codes answered with an error page
+inline bool HttpResponse::IsErrorPageCode() const
 {
     switch(response_code_)
     {
@@ -169,17 +230,15 @@ inline std::string HttpResponse::GetFileType()
         case 502:
         case 400:
         case 404:
-            return "text/html";
+            return true;
         default:
-            break;
+            return false;
     }
-    auto idx = path_.find_last_of('.');
-    if(idx == std::string::npos)
-        return "text/plain";
-    std::string suffix = path_.substr(idx);
-    if(kSuffixType.count(suffix))
-        return kSuffixType.find(suffix)->second;
-    return "text/plain";
+}
+
+inline std::string_view HttpResponse::GetMimeType(std::string_view path)
+{
+    return HttpHeaderBuilder::MimeType(path);
 }
 
 inline bool HttpResponse::HasFile() const
@@ -197,6 +256,21 @@ inline const int HttpResponse::FileSize() const
     return file_stat_.st_size;
 }
 
+inline bool HttpResponse::HasFileFd() const
+{
+    return file_fd_ >= 0;
+}
+
+inline int HttpResponse::FileFd() const
+{
+    return file_fd_;
+}
+
+inline bool HttpResponse::IsKeepAlive() const
+{
+    return is_keepalive_;
+}
+
 } // namespace white
 
 #endif
\ No newline at end of file
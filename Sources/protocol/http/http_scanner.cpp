@@ -0,0 +1,140 @@
+#include "protocol/http/http_scanner.h"
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define WHITEWEBSERVER_SCANNER_X86
+#endif
+
+namespace {
+
+using white::LineScan;
+
+// '\r', '\n' end the line, ':', ' ', '\t' split the request line and the headers
+struct DelimiterTable
+{
+    constexpr DelimiterTable() : is_delimiter{}
+    {
+        is_delimiter[static_cast<unsigned char>('\r')] = true;
+        is_delimiter[static_cast<unsigned char>('\n')] = true;
+        is_delimiter[static_cast<unsigned char>(':')] = true;
+        is_delimiter[static_cast<unsigned char>(' ')] = true;
+        is_delimiter[static_cast<unsigned char>('\t')] = true;
+    }
+
+    bool is_delimiter[256];
+};
+
+constexpr DelimiterTable kDelimiterTable;
+
+// return true if the line end is found
+inline bool Consume(const char *line, std::size_t pos, LineScan &scan)
+{
+    if(line[pos] == '\r' || line[pos] == '\n')
+    {
+        scan.line_end = scan.scanned = pos;
+        return true;
+    }
+    if(scan.first_delimiter == LineScan::npos)
+        scan.first_delimiter = pos;
+    scan.last_delimiter = pos;
+    return false;
+}
+
+// every set bit is a delimiter at base + bit
+inline bool ConsumeMask(const char *line, std::size_t base, uint32_t mask, LineScan &scan)
+{
+    for(; mask; mask &= mask - 1)
+        if(Consume(line, base + __builtin_ctz(mask), scan))
+            return true;
+    return false;
+}
+
+void ScanLineScalar(const char *line, std::size_t len, LineScan &scan)
+{
+    for(std::size_t pos = scan.scanned; pos < len; ++pos)
+        if(kDelimiterTable.is_delimiter[static_cast<unsigned char>(line[pos])] && Consume(line, pos, scan))
+            return;
+    scan.scanned = len;
+}
+
+#ifdef WHITEWEBSERVER_SCANNER_X86
+
+__attribute__((target("sse4.2")))
+void ScanLineSse42(const char *line, std::size_t len, LineScan &scan)
+{
+    const __m128i delimiters = _mm_setr_epi8('\r', '\n', ':', ' ', '\t', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    std::size_t pos = scan.scanned;
+    for(; pos + 16 <= len; pos += 16)
+    {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(line + pos));
+        __m128i hits = _mm_cmpestrm(delimiters, 5, block, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_BIT_MASK);
+        uint32_t mask = static_cast<uint32_t>(_mm_cvtsi128_si32(hits));
+        if(mask && ConsumeMask(line, pos, mask, scan))
+            return;
+    }
+    scan.scanned = pos;
+    ScanLineScalar(line, len, scan);
+}
+
+__attribute__((target("avx2")))
+void ScanLineAvx2(const char *line, std::size_t len, LineScan &scan)
+{
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    std::size_t pos = scan.scanned;
+    for(; pos + 32 <= len; pos += 32)
+    {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(line + pos));
+        __m256i hits = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, cr), _mm256_cmpeq_epi8(block, lf)),
+                                       _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, colon), _mm256_cmpeq_epi8(block, space)),
+                                                       _mm256_cmpeq_epi8(block, tab)));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(hits));
+        if(mask && ConsumeMask(line, pos, mask, scan))
+            return;
+    }
+    scan.scanned = pos;
+    ScanLineScalar(line, len, scan);
+}
+
+#endif
+
+struct Scanner
+{
+    void (*scan)(const char *line, std::size_t len, LineScan &scan);
+    const char *name;
+};
+
+Scanner SelectScanner()
+{
+#ifdef WHITEWEBSERVER_SCANNER_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return {&ScanLineAvx2, "avx2"};
+    if(__builtin_cpu_supports("sse4.2"))
+        return {&ScanLineSse42, "sse4.2"};
+#endif
+    return {&ScanLineScalar, "scalar"};
+}
+
+const Scanner kScanner = SelectScanner();
+
+} // namespace
+
+namespace white {
+
+void ScanLine(const char *line, std::size_t len, LineScan &scan)
+{
+    kScanner.scan(line, len, scan);
+}
+
+const char *ScannerName()
+{
+    return kScanner.name;
+}
+
+} // namespace white
@@ -0,0 +1,51 @@
+#ifndef WHITEWEBSERVER_PROTOCOL_HTTP_HTTP_SCANNER_H_
+#define WHITEWEBSERVER_PROTOCOL_HTTP_HTTP_SCANNER_H_
+
+#include <cstddef>
+#include <string>
+
+namespace white {
+
+/**
+ * @brief Result of scanning one line of a request, all offsets are from the beginning of the line.
+ *
+ * A line can be scanned in several calls when it arrives in pieces, scanned_ remembers where to go on.
+ */
+struct LineScan
+{
+    static constexpr std::size_t npos = std::string::npos;
+
+    void Reset();
+
+    std::size_t line_end = npos; // the '\r' or '\n' ending the line
+    std::size_t first_delimiter = npos; // the first ':', ' ' or '\t'
+    std::size_t last_delimiter = npos; // the last ':', ' ' or '\t' before the line end
+    std::size_t scanned = 0;
+};
+
+/**
+ * @brief Find the line end and the header delimiters in one pass, with AVX2 or SSE4.2 if the cpu supports,
+ * which is checked only once.
+ *
+ * @param line the beginning of the line
+ * @param len bytes available from the beginning of the line
+ * @param scan continue from scan.scanned, stop at the line end
+ */
+void ScanLine(const char *line, std::size_t len, LineScan &scan);
+
+/**
+ * @brief Name of the implementation selected for this cpu, "avx2", "sse4.2" or "scalar".
+ *
+ * @return const char*
+ */
+const char *ScannerName();
+
+inline void LineScan::Reset()
+{
+    line_end = first_delimiter = last_delimiter = npos;
+    scanned = 0;
+}
+
+} // namespace white
+
+#endif
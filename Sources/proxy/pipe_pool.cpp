@@ -0,0 +1,66 @@
+#include "proxy/pipe_pool.h"
+#include "logger/logger.h"
+
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace white {
+
+PipePool::PipePool(std::size_t max_idle) :
+max_idle_(max_idle)
+{
+
+}
+
+PipePool::~PipePool()
+{
+    for(auto &pipe : idle_)
+        Discard(pipe);
+}
+
+bool PipePool::Acquire(Pipe *pipe)
+{
+    {
+        std::lock_guard<std::mutex> locker(mutex_);
+        if(!idle_.empty())
+        {
+            *pipe = idle_.back();
+            idle_.pop_back();
+            return true;
+        }
+    }
+    int fds[2];
+    if(pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0)
+    {
+        LOG_WARN("Fail to create pipe: ", strerror(errno));
+        return false;
+    }
+    pipe->read_fd = fds[0];
+    pipe->write_fd = fds[1];
+    int capacity = fcntl(fds[1], F_GETPIPE_SZ);
+    pipe->capacity = capacity > 0 ? capacity : 65536;
+    return true;
+}
+
+void PipePool::Release(const Pipe &pipe)
+{
+    {
+        std::lock_guard<std::mutex> locker(mutex_);
+        if(idle_.size() < max_idle_)
+        {
+            idle_.push_back(pipe);
+            return;
+        }
+    }
+    Discard(pipe);
+}
+
+void PipePool::Discard(const Pipe &pipe)
+{
+    close(pipe.read_fd);
+    close(pipe.write_fd);
+}
+
+} // namespace white
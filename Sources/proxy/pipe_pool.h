@@ -0,0 +1,64 @@
+#ifndef WHITEWEBSERVER_PROXY_PIPE_POOL_H_
+#define WHITEWEBSERVER_PROXY_PIPE_POOL_H_
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace white {
+
+/**
+ * @brief Pipes to splice the bodies of proxied responses through, shared by all the clients and reactors.
+ *
+ * A pipe is borrowed by a connection for one response and given back once it is empty again,
+ * so a keep-alive connection waiting for its next request holds none.
+ */
+class PipePool
+{
+public:
+    struct Pipe
+    {
+        int read_fd = -1;
+        int write_fd = -1;
+        std::size_t capacity = 0; // bytes it holds before splicing into it would block
+    };
+
+public:
+    PipePool(std::size_t max_idle = kMaxIdle);
+    ~PipePool();
+
+    /**
+     * @brief Get an idle pipe, or create a new one if none.
+     *
+     * @param pipe
+     * @return true
+     * @return false unable to create a pipe, such as running out of fds
+     */
+    bool Acquire(Pipe *pipe);
+
+    /**
+     * @brief Give back an empty pipe, it is closed if enough are idle.
+     *
+     * @param pipe
+     */
+    void Release(const Pipe &pipe);
+
+    /**
+     * @brief Close a pipe still holding bytes, which can never be reused.
+     *
+     * @param pipe
+     */
+    static void Discard(const Pipe &pipe);
+
+private:
+    static constexpr std::size_t kMaxIdle = 64;
+
+private:
+    std::size_t max_idle_;
+    std::vector<Pipe> idle_;
+    std::mutex mutex_;
+};
+
+} // namespace white
+
+#endif
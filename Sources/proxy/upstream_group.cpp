@@ -0,0 +1,272 @@
+#include "proxy/upstream_group.h"
+#include "logger/logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <errno.h>
+#include <functional>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace white {
+
+UpstreamGroup::UpstreamGroup(const ProxyConfig &config) :
+balance_(config.balance_),
+next_(0),
+health_check_interval_(config.health_check_interval_),
+health_check_timeout_(config.health_check_timeout_),
+health_check_fails_(config.health_check_fails_),
+health_check_passes_(config.health_check_passes_),
+health_check_path_(config.health_check_path_),
+is_stop_(false)
+{
+    for(auto &upstream : config.servers_)
+    {
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr = upstream.addr_;
+        address.sin_port = upstream.port_;
+        auto server = std::make_unique<Server>();
+        server->pool = std::make_unique<UpstreamPool>(address, config.keepalive_, config.keepalive_timeout_);
+        server->host = upstream.host_;
+        server->name = upstream.host_ + ":" + std::to_string(ntohs(upstream.port_));
+        servers_.push_back(std::move(server));
+    }
+
+    if(balance_ == ProxyBalance::HASH_IP || balance_ == ProxyBalance::HASH_URI)
+    {
+        ring_.reserve(servers_.size() * kVirtualNodes);
+        for(int i = 0; i < static_cast<int>(servers_.size()); ++i)
+            for(int j = 0; j < kVirtualNodes; ++j)
+                ring_.emplace_back(Mix(std::hash<std::string>{}(servers_[i]->name + "#" + std::to_string(j))), i);
+        std::sort(ring_.begin(), ring_.end());
+    }
+
+    if(health_check_interval_ > 0)
+        health_checker_ = std::thread(&UpstreamGroup::HealthCheckLoop, this);
+}
+
+UpstreamGroup::~UpstreamGroup()
+{
+    {
+        std::lock_guard<std::mutex> locker(mutex_);
+        is_stop_ = true;
+    }
+    stop_cv_.notify_all();
+    if(health_checker_.joinable())
+        health_checker_.join();
+}
+
+int UpstreamGroup::Select(uint64_t key)
+{
+    switch(balance_)
+    {
+        case ProxyBalance::LEAST_CONN:
+            return SelectLeastConn();
+        case ProxyBalance::HASH_IP:
+        case ProxyBalance::HASH_URI:
+            return SelectHash(key);
+        case ProxyBalance::ROUND_ROBIN:
+        default:
+            return SelectRoundRobin();
+    }
+}
+
+int UpstreamGroup::SelectRoundRobin()
+{
+    std::size_t size = servers_.size();
+    std::size_t start = next_.fetch_add(1, std::memory_order_relaxed);
+    for(std::size_t i = 0; i < size; ++i)
+    {
+        int index = (start + i) % size;
+        if(IsAvailable(*servers_[index]))
+            return index;
+    }
+    return -1;
+}
+
+// ties go to the server after the last one picked, so idle servers share the load
+int UpstreamGroup::SelectLeastConn()
+{
+    std::size_t size = servers_.size();
+    std::size_t start = next_.fetch_add(1, std::memory_order_relaxed);
+    int selected = -1;
+    int min_active = 0;
+    for(std::size_t i = 0; i < size; ++i)
+    {
+        int index = (start + i) % size;
+        auto &server = *servers_[index];
+        int active = server.active.load(std::memory_order_relaxed);
+        if((selected == -1 || active < min_active) && IsAvailable(server))
+        {
+            selected = index;
+            min_active = active;
+        }
+    }
+    return selected;
+}
+
+// the first point clockwise from the key, the keys of an unavailable server move on to the next servers on the ring
+int UpstreamGroup::SelectHash(uint64_t key)
+{
+    auto point = std::lower_bound(ring_.begin(), ring_.end(), std::make_pair(Mix(key), 0));
+    for(std::size_t i = 0; i < ring_.size(); ++i, ++point)
+    {
+        if(point == ring_.end())
+            point = ring_.begin();
+        if(IsAvailable(*servers_[point->second]))
+            return point->second;
+    }
+    return -1;
+}
+
+std::size_t UpstreamGroup::TestConnect(int timeout)
+{
+    std::size_t reachable = 0;
+    for(auto &server : servers_)
+    {
+        bool is_connecting;
+        int fd = server->pool->Acquire(&is_connecting);
+        if(fd != -1 && (!is_connecting || UpstreamPool::WaitConnected(fd, timeout)))
+        {
+            server->pool->Release(fd);
+            ++reachable;
+            continue;
+        }
+        if(fd != -1)
+        {
+            server->pool->Discard(fd);
+            server->pool->ReportConnect(false);
+        }
+        LOG_WARN("Upstream ", server->name, " unavailable");
+    }
+    return reachable;
+}
+
+void UpstreamGroup::Prewarm(std::size_t count, int timeout)
+{
+    for(auto &server : servers_)
+        server->pool->Prewarm(count, timeout);
+}
+
+bool UpstreamGroup::Fetch(uint64_t key, const std::string &request, std::string *response, int timeout)
+{
+    int index = Select(key);
+    if(index == -1)
+        return false;
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0)
+        return false;
+    auto &address = servers_[index]->pool->Address();
+    bool is_connected = (connect(fd, (const sockaddr*)&address, sizeof(address)) == 0 || errno == EINPROGRESS)
+                        && UpstreamPool::WaitConnected(fd, timeout);
+    if(!is_connected)
+    {
+        close(fd);
+        return false;
+    }
+    OnAttach(index);
+    std::size_t sent = 0;
+    pollfd poll_fd{fd, POLLOUT, 0};
+    while(sent < request.size() && poll(&poll_fd, 1, timeout) == 1)
+    {
+        ssize_t len = send(fd, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+        if(len < 0 && errno != EAGAIN && errno != EINTR)
+            break;
+        sent += std::max<ssize_t>(len, 0);
+    }
+    bool is_done = false;
+    poll_fd.events = POLLIN;
+    char buff[16384];
+    response->clear();
+    while(sent == request.size() && poll(&poll_fd, 1, timeout) == 1)
+    {
+        ssize_t len = recv(fd, buff, sizeof(buff), 0);
+        if(len == 0)
+        {
+            is_done = true;
+            break;
+        }
+        if(len < 0 && errno != EAGAIN && errno != EINTR)
+            break;
+        response->append(buff, std::max<ssize_t>(len, 0));
+    }
+    OnDetach(index);
+    close(fd);
+    return is_done;
+}
+
+void UpstreamGroup::HealthCheckLoop()
+{
+    std::unique_lock<std::mutex> locker(mutex_);
+    while(!stop_cv_.wait_for(locker, std::chrono::milliseconds(health_check_interval_), [this]{ return is_stop_; }))
+    {
+        locker.unlock();
+        for(auto &server : servers_)
+        {
+            if(Check(*server))
+            {
+                server->fails = 0;
+                if(!server->is_healthy.load(std::memory_order_relaxed) && ++server->passes >= health_check_passes_)
+                {
+                    server->pool->ReportConnect(true); // no backoff from the failures before
+                    server->is_healthy.store(true, std::memory_order_relaxed);
+                    LOG_INFO("Upstream ", server->name, " is healthy again");
+                }
+            }else
+            {
+                server->passes = 0;
+                if(server->is_healthy.load(std::memory_order_relaxed) && ++server->fails >= health_check_fails_)
+                {
+                    server->is_healthy.store(false, std::memory_order_relaxed);
+                    LOG_WARN("Upstream ", server->name, " failed ", server->fails, " health checks, ejected");
+                }
+            }
+        }
+        locker.lock();
+    }
+}
+
+bool UpstreamGroup::Check(const Server &server) const
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0)
+        return false;
+    auto &address = server.pool->Address();
+    bool is_passed = (connect(fd, (const sockaddr*)&address, sizeof(address)) == 0 || errno == EINPROGRESS)
+                     && UpstreamPool::WaitConnected(fd, health_check_timeout_);
+    if(is_passed && !health_check_path_.empty())
+    {
+        std::string request = "GET " + health_check_path_ + " HTTP/1.1\r\nHost: " + server.host
+                              + "\r\nConnection: close\r\nUser-Agent: WhiteWebServer_HealthCheck\r\n\r\n";
+        char status_line[16] = {};
+        std::size_t received = 0;
+        pollfd poll_fd{fd, POLLIN, 0};
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(health_check_timeout_);
+        // a short request always fits in the send buffer of a new connection
+        is_passed = send(fd, request.data(), request.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(request.size());
+        // "HTTP/1.1 200", which may come in more than one segment
+        while(is_passed && received < 12)
+        {
+            auto remain = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+            if(remain <= 0 || poll(&poll_fd, 1, remain) != 1)
+            {
+                is_passed = false;
+                break;
+            }
+            ssize_t len = recv(fd, status_line + received, 12 - received, 0);
+            if(len == 0 || (len < 0 && errno != EAGAIN && errno != EINTR))
+                is_passed = false;
+            received += std::max<ssize_t>(len, 0);
+        }
+        is_passed = is_passed
+                    && strncmp(status_line, "HTTP/1.", 7) == 0
+                    && (status_line[9] == '2' || status_line[9] == '3');
+    }
+    close(fd);
+    return is_passed;
+}
+
+} // namespace white
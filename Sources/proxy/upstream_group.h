@@ -0,0 +1,191 @@
+#ifndef WHITEWEBSERVER_PROXY_UPSTREAM_GROUP_H_
+#define WHITEWEBSERVER_PROXY_UPSTREAM_GROUP_H_
+
+#include "config/config.h"
+#include "proxy/upstream_pool.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace white {
+
+/**
+ * @brief The servers of proxy_pass, each with its own connection pool. Every request picks a server by the balance,
+ * skipping the servers ejected by the health checks and the ones backing off after failed connections.
+ *
+ * The active health checks run in a thread of their own, so a slow server never blocks the reactors.
+ */
+class UpstreamGroup
+{
+public:
+    UpstreamGroup(const ProxyConfig &config);
+    ~UpstreamGroup();
+
+    /**
+     * @brief Pick a server for a request, -1 if none is available.
+     *
+     * @param key the hash of the client address or the path for the hash balances, ignored by the others
+     * @return int index of the server
+     */
+    int Select(uint64_t key);
+
+    /**
+     * @brief Count the requests in flight on the server, for least_conn.
+     *
+     * @param index
+     */
+    void OnAttach(int index);
+    void OnDetach(int index);
+
+    UpstreamPool &Pool(int index);
+    const std::string &Name(int index) const;
+    std::size_t Size() const;
+    ProxyBalance Balance() const;
+    const char *BalanceName() const;
+
+    /**
+     * @brief Connect to every server once, and keep the connections for the first requests.
+     *
+     * @param timeout milliseconds for each server
+     * @return std::size_t servers reachable
+     */
+    std::size_t TestConnect(int timeout);
+
+    void Prewarm(std::size_t count, int timeout);
+
+    /**
+     * @brief Send a request asking to close the connection to a server, and read the response until the server
+     * closes it. Blocks, only for the threads out of the reactors.
+     *
+     * @param key as Select
+     * @param request
+     * @param response
+     * @param timeout milliseconds to connect, and between two reads
+     * @return true
+     * @return false no server available, or failed
+     */
+    bool Fetch(uint64_t key, const std::string &request, std::string *response, int timeout);
+
+private:
+    struct Server
+    {
+        std::unique_ptr<UpstreamPool> pool;
+        std::string name; // host:port
+        std::string host;
+        std::atomic<int> active{0}; // requests in flight
+        std::atomic<bool> is_healthy{true};
+        int fails = 0; // consecutive, only touched by the health checker
+        int passes = 0;
+    };
+
+    static constexpr int kVirtualNodes = 160; // points of every server on the hash ring
+
+private:
+    bool IsAvailable(const Server &server) const;
+
+    int SelectRoundRobin();
+    int SelectLeastConn();
+    int SelectHash(uint64_t key);
+
+    void HealthCheckLoop();
+
+    /**
+     * @brief Connect to the server, and GET the health check path if set.
+     *
+     * @param server
+     * @return true passed
+     * @return false
+     */
+    bool Check(const Server &server) const;
+
+    static uint64_t Mix(uint64_t key);
+
+private:
+    std::vector<std::unique_ptr<Server>> servers_;
+    ProxyBalance balance_;
+    std::atomic<std::size_t> next_; // for round robin, and where least_conn starts
+    std::vector<std::pair<uint64_t, int>> ring_; // sorted points of the servers
+
+    int health_check_interval_;
+    int health_check_timeout_;
+    int health_check_fails_;
+    int health_check_passes_;
+    std::string health_check_path_;
+
+    std::thread health_checker_;
+    std::mutex mutex_;
+    std::condition_variable stop_cv_;
+    bool is_stop_;
+};
+
+inline void UpstreamGroup::OnAttach(int index)
+{
+    servers_[index]->active.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void UpstreamGroup::OnDetach(int index)
+{
+    servers_[index]->active.fetch_sub(1, std::memory_order_relaxed);
+}
+
+inline UpstreamPool &UpstreamGroup::Pool(int index)
+{
+    return *servers_[index]->pool;
+}
+
+inline const std::string &UpstreamGroup::Name(int index) const
+{
+    return servers_[index]->name;
+}
+
+inline std::size_t UpstreamGroup::Size() const
+{
+    return servers_.size();
+}
+
+inline ProxyBalance UpstreamGroup::Balance() const
+{
+    return balance_;
+}
+
+inline const char *UpstreamGroup::BalanceName() const
+{
+    switch(balance_)
+    {
+        case ProxyBalance::LEAST_CONN:
+            return "least_conn";
+        case ProxyBalance::HASH_IP:
+            return "hash_ip";
+        case ProxyBalance::HASH_URI:
+            return "hash_uri";
+        default:
+            return "round_robin";
+    }
+}
+
+inline bool UpstreamGroup::IsAvailable(const Server &server) const
+{
+    return server.is_healthy.load(std::memory_order_relaxed) && !server.pool->IsBackingOff();
+}
+
+// the finalizer of MurmurHash3, spreads similar keys over the ring
+inline uint64_t UpstreamGroup::Mix(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+} // namespace white
+
+#endif
@@ -0,0 +1,163 @@
+#include "proxy/upstream_pool.h"
+#include "logger/logger.h"
+
+#include <algorithm>
+#include <cstring>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace white {
+
+UpstreamPool::UpstreamPool(const sockaddr_in &address, std::size_t max_idle, int idle_timeout) :
+address_(address),
+max_idle_(max_idle),
+idle_timeout_(idle_timeout),
+failures_(0)
+{
+
+}
+
+UpstreamPool::~UpstreamPool()
+{
+    for(auto &connection : idle_)
+        close(connection.fd);
+}
+
+int UpstreamPool::Acquire(bool *is_connecting)
+{
+    *is_connecting = false;
+    while(true)
+    {
+        int fd;
+        {
+            std::lock_guard<std::mutex> locker(mutex_);
+            ExpireIdle(Clock::now());
+            if(idle_.empty())
+                break;
+            fd = idle_.back().fd;
+            idle_.pop_back();
+        }
+        if(IsReusable(fd))
+            return fd;
+        close(fd); // closed by the server while idle
+    }
+    if(IsBackingOff())
+        return -1;
+    return Connect(is_connecting);
+}
+
+void UpstreamPool::ReportConnect(bool is_success)
+{
+    std::lock_guard<std::mutex> locker(mutex_);
+    if(is_success)
+    {
+        failures_ = 0;
+        return;
+    }
+    int backoff = std::min(kMaxBackoff, kMinBackoff << std::min(failures_, 16));
+    ++failures_;
+    retry_at_ = Clock::now() + std::chrono::milliseconds(backoff);
+    LOG_WARN("Fail to connect to upstream ", failures_, " times, retry after ", backoff, "ms");
+}
+
+void UpstreamPool::Release(int fd)
+{
+    {
+        std::lock_guard<std::mutex> locker(mutex_);
+        auto now = Clock::now();
+        ExpireIdle(now);
+        if(idle_.size() < max_idle_)
+        {
+            idle_.push_back({fd, now});
+            return;
+        }
+    }
+    close(fd);
+}
+
+void UpstreamPool::Discard(int fd)
+{
+    close(fd);
+}
+
+bool UpstreamPool::IsBackingOff()
+{
+    std::lock_guard<std::mutex> locker(mutex_);
+    return failures_ > 0 && Clock::now() < retry_at_;
+}
+
+std::size_t UpstreamPool::Prewarm(std::size_t count, int timeout)
+{
+    std::size_t opened = 0;
+    for(count = std::min(count, max_idle_); IdleCount() < count; ++opened)
+    {
+        bool is_connecting;
+        int fd = Connect(&is_connecting);
+        if(fd < 0)
+            break;
+        if(is_connecting && !WaitConnected(fd, timeout))
+        {
+            close(fd);
+            break;
+        }
+        Release(fd);
+    }
+    return opened;
+}
+
+bool UpstreamPool::WaitConnected(int fd, int timeout)
+{
+    pollfd poll_fd{fd, POLLOUT, 0};
+    if(poll(&poll_fd, 1, timeout) != 1)
+        return false;
+    int error = 0;
+    socklen_t len = sizeof(error);
+    return getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == 0 && error == 0;
+}
+
+std::size_t UpstreamPool::IdleCount()
+{
+    std::lock_guard<std::mutex> locker(mutex_);
+    return idle_.size();
+}
+
+// never blocks, the connection is usually still in progress when it returns
+int UpstreamPool::Connect(bool *is_connecting)
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0)
+        return -1;
+    if(connect(fd, (const sockaddr*)&address_, sizeof(address_)) == 0)
+        *is_connecting = false;
+    else if(errno == EINPROGRESS)
+        *is_connecting = true;
+    else
+    {
+        LOG_WARN("Fail to connect to upstream: ", strerror(errno));
+        close(fd);
+        ReportConnect(false);
+        return -1;
+    }
+    LOG_DEBUG("Connect to upstream: ", fd);
+    return fd;
+}
+
+// the oldest are at front
+void UpstreamPool::ExpireIdle(TimeStamp now)
+{
+    while(!idle_.empty() && now - idle_.front().released >= idle_timeout_)
+    {
+        close(idle_.front().fd);
+        idle_.pop_front();
+    }
+}
+
+bool UpstreamPool::IsReusable(int fd)
+{
+    char byte;
+    return recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+} // namespace white
@@ -0,0 +1,138 @@
+#ifndef WHITEWEBSERVER_PROXY_UPSTREAM_POOL_H_
+#define WHITEWEBSERVER_PROXY_UPSTREAM_POOL_H_
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+namespace white {
+
+/**
+ * @brief Keep-alive connections to one upstream server, shared by all the clients and reactors.
+ *
+ * A connection is borrowed for one request and given back once its response has been read completely.
+ * At most max_idle connections are kept idle, the most recently used one is reused first, and the ones
+ * idle longer than the idle timeout are closed.
+ */
+class UpstreamPool
+{
+    using Clock = std::chrono::steady_clock;
+    using TimeStamp = std::chrono::steady_clock::time_point;
+
+public:
+    /**
+     * @brief Construct a new Upstream Pool object
+     *
+     * @param address address of the upstream server
+     * @param max_idle max number of the idle connections
+     * @param idle_timeout milliseconds before an idle connection is closed
+     */
+    UpstreamPool(const sockaddr_in &address, std::size_t max_idle, int idle_timeout);
+    ~UpstreamPool();
+
+    /**
+     * @brief Get an idle connection, or start connecting a new one if none. Return -1 if unable to connect,
+     * or the upstream is backing off after failures.
+     *
+     * @param is_connecting set to true if the connection is still in progress, it becomes writable once connected
+     * @return int
+     */
+    int Acquire(bool *is_connecting);
+
+    /**
+     * @brief Report the result of a connection in progress. After failures new connections are refused
+     * for a backoff doubled on every failure, so a dead upstream is not hammered on every request.
+     *
+     * @param is_success
+     */
+    void ReportConnect(bool is_success);
+
+    /**
+     * @brief Returns true if new connections are refused after failures.
+     *
+     * @return true
+     * @return false
+     */
+    bool IsBackingOff();
+
+    /**
+     * @brief Give back a connection whose response has been read completely.
+     *
+     * @param fd
+     */
+    void Release(int fd);
+
+    /**
+     * @brief Close a connection which can not be reused.
+     *
+     * @param fd
+     */
+    void Discard(int fd);
+
+    /**
+     * @brief Open connections in advance until count connections are idle, so the first requests need no handshake.
+     *
+     * @param count
+     * @param timeout milliseconds to wait for each connection
+     * @return std::size_t connections opened
+     */
+    std::size_t Prewarm(std::size_t count, int timeout);
+
+    /**
+     * @brief Block until the connection in progress is established, only for the startup.
+     *
+     * @param fd
+     * @param timeout milliseconds
+     * @return true
+     * @return false failed or timed out
+     */
+    static bool WaitConnected(int fd, int timeout);
+
+    std::size_t IdleCount();
+    const sockaddr_in &Address() const;
+
+private:
+    struct IdleConnection
+    {
+        int fd;
+        TimeStamp released;
+    };
+
+private:
+    static constexpr int kMinBackoff = 100; // milliseconds
+    static constexpr int kMaxBackoff = 10000;
+
+private:
+    int Connect(bool *is_connecting);
+    void ExpireIdle(TimeStamp now);
+
+    /**
+     * @brief Returns true if the idle connection is neither closed by the server nor holding unexpected bytes.
+     *
+     * @param fd
+     * @return true
+     * @return false
+     */
+    static bool IsReusable(int fd);
+
+private:
+    sockaddr_in address_;
+    std::size_t max_idle_;
+    std::chrono::milliseconds idle_timeout_;
+
+    std::mutex mutex_;
+    std::deque<IdleConnection> idle_; // the most recently released at back
+    int failures_; // consecutive failed connections
+    TimeStamp retry_at_; // no new connection before it after failures
+};
+
+inline const sockaddr_in &UpstreamPool::Address() const
+{
+    return address_;
+}
+
+} // namespace white
+
+#endif
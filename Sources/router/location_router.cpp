@@ -0,0 +1,66 @@
+#include "router/location_router.h"
+
+namespace white {
+
+LocationRouter::LocationRouter(Location default_location) :
+nodes_(1)
+{
+    locations_.push_back(std::make_unique<Location>(std::move(default_location)));
+}
+
+bool LocationRouter::Add(LocationMatch match, const std::string &pattern, Location location)
+{
+    int index = locations_.size();
+    if(match == LocationMatch::REGEX)
+    {
+        try
+        {
+            regexes_.emplace_back(std::regex(pattern, std::regex::ECMAScript | std::regex::optimize), index);
+        }catch(const std::regex_error &)
+        {
+            return false;
+        }
+        locations_.push_back(std::make_unique<Location>(std::move(location)));
+        return true;
+    }
+
+    uint32_t node = 0;
+    for(char ch : pattern)
+    {
+        uint32_t child = Child(node, ch);
+        if(child == 0)
+        {
+            child = nodes_.size();
+            nodes_[node].children.emplace_back(ch, child);
+            nodes_.emplace_back();
+        }
+        node = child;
+    }
+    (match == LocationMatch::EXACT ? nodes_[node].exact : nodes_[node].prefix) = index;
+    locations_.push_back(std::make_unique<Location>(std::move(location)));
+    return true;
+}
+
+const Location &LocationRouter::Route(std::string_view path) const
+{
+    path = path.substr(0, path.find('?'));
+    int prefix = nodes_[0].prefix;
+    uint32_t node = 0;
+    std::size_t matched = 0;
+    for(; matched < path.size(); ++matched)
+    {
+        node = Child(node, path[matched]);
+        if(node == 0)
+            break;
+        if(nodes_[node].prefix != -1)
+            prefix = nodes_[node].prefix;
+    }
+    if(matched == path.size() && nodes_[node].exact != -1)
+        return *locations_[nodes_[node].exact];
+    for(auto &regex : regexes_)
+        if(std::regex_search(path.begin(), path.end(), regex.first))
+            return *locations_[regex.second];
+    return *locations_[prefix == -1 ? 0 : prefix];
+}
+
+} // namespace white
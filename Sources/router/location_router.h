@@ -0,0 +1,107 @@
+#ifndef WHITEWEBSERVER_ROUTER_LOCATION_ROUTER_H_
+#define WHITEWEBSERVER_ROUTER_LOCATION_ROUTER_H_
+
+#include "config/config.h"
+#include "proxy/upstream_group.h"
+
+#include <cstdint>
+#include <memory>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace white {
+
+// how the requests routed to a location are answered
+struct Location
+{
+    enum class HANDLER
+    {
+        STATIC,
+        PROXY,
+        REDIRECT,
+    };
+
+    HANDLER handler;
+    std::string name; // the match and the pattern, for the logs
+    std::string root; // STATIC
+    std::shared_ptr<UpstreamGroup> upstream; // PROXY
+    std::string redirect; // REDIRECT, $uri is replaced by the uri of the request
+    int redirect_code;
+};
+
+/**
+ * @brief Route the path of a request to its location, the exact ones first, then the regexes in the order
+ * they are added, then the longest prefix, or the default location of the server if none matches.
+ *
+ * The exact and prefix patterns are compiled into one trie, walked once along the path, which finds both
+ * the exact match and the longest prefix. The query string is never matched.
+ */
+class LocationRouter
+{
+public:
+    LocationRouter(Location default_location);
+
+    /**
+     * @brief Add a location, a later one with the same exact or prefix pattern replaces the earlier one.
+     *
+     * @param match
+     * @param pattern a path, or an ECMAScript regex searched in the path
+     * @param location
+     * @return true
+     * @return false the regex is invalid
+     */
+    bool Add(LocationMatch match, const std::string &pattern, Location location);
+
+    const Location &Route(std::string_view path) const;
+
+    const Location &Default() const;
+
+    /**
+     * @brief All the locations, for walking their upstream groups.
+     *
+     * @return const std::vector<std::unique_ptr<Location>>&
+     */
+    const std::vector<std::unique_ptr<Location>> &Locations() const;
+
+private:
+    struct Node
+    {
+        std::vector<std::pair<char, uint32_t>> children; // few, scanned in order
+        int exact = -1; // index of the location
+        int prefix = -1;
+    };
+
+private:
+    uint32_t Child(uint32_t node, char ch) const;
+
+private:
+    std::vector<Node> nodes_; // the root at 0
+    std::vector<std::pair<std::regex, int>> regexes_;
+    std::vector<std::unique_ptr<Location>> locations_; // the default at 0, never moved once routed to
+};
+
+inline const Location &LocationRouter::Default() const
+{
+    return *locations_[0];
+}
+
+inline const std::vector<std::unique_ptr<Location>> &LocationRouter::Locations() const
+{
+    return locations_;
+}
+
+// 0 if none, the root is never a child
+inline uint32_t LocationRouter::Child(uint32_t node, char ch) const
+{
+    for(auto &child : nodes_[node].children)
+        if(child.first == ch)
+            return child.second;
+    return 0;
+}
+
+} // namespace white
+
+#endif
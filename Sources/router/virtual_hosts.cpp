@@ -0,0 +1,75 @@
+#include "router/virtual_hosts.h"
+
+#include <algorithm>
+#include <strings.h>
+
+namespace white {
+
+VirtualHosts::VirtualHosts() :
+slots_(16),
+used_(0),
+default_(0)
+{
+
+}
+
+std::vector<std::string> VirtualHosts::Add(std::unique_ptr<Site> site, bool is_default)
+{
+    std::vector<std::string> ignored;
+    int index = sites_.size();
+    for(auto &name : site->names)
+    {
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        std::string_view host = HostName(name);
+        uint64_t hash = Hash(host);
+        bool is_taken = false;
+        for(std::size_t i = hash & (slots_.size() - 1); slots_[i].site != -1 && !is_taken; i = (i + 1) & (slots_.size() - 1))
+            is_taken = slots_[i].hash == hash && slots_[i].name == host;
+        if(is_taken)
+        {
+            ignored.push_back(name);
+            continue;
+        }
+        Insert(hash, index, std::string(host));
+    }
+    if(is_default)
+        default_ = index;
+    sites_.push_back(std::move(site));
+    return ignored;
+}
+
+const Site &VirtualHosts::Find(std::string_view host) const
+{
+    host = HostName(host);
+    uint64_t hash = Hash(host);
+    for(std::size_t i = hash & (slots_.size() - 1); slots_[i].site != -1; i = (i + 1) & (slots_.size() - 1))
+    {
+        auto &slot = slots_[i];
+        if(slot.hash == hash && slot.name.size() == host.size() && strncasecmp(slot.name.data(), host.data(), host.size()) == 0)
+            return *sites_[slot.site];
+    }
+    return Default();
+}
+
+void VirtualHosts::Insert(uint64_t hash, int site, std::string name)
+{
+    if((used_ + 1) * 2 > slots_.size())
+        Grow();
+    std::size_t i = hash & (slots_.size() - 1);
+    while(slots_[i].site != -1)
+        i = (i + 1) & (slots_.size() - 1);
+    slots_[i] = {hash, site, std::move(name)};
+    ++used_;
+}
+
+void VirtualHosts::Grow()
+{
+    std::vector<Slot> slots(slots_.size() * 2);
+    slots.swap(slots_);
+    used_ = 0;
+    for(auto &slot : slots)
+        if(slot.site != -1)
+            Insert(slot.hash, slot.site, std::move(slot.name));
+}
+
+} // namespace white
@@ -0,0 +1,108 @@
+#ifndef WHITEWEBSERVER_ROUTER_VIRTUAL_HOSTS_H_
+#define WHITEWEBSERVER_ROUTER_VIRTUAL_HOSTS_H_
+
+#include "router/location_router.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace white {
+
+// one server of the config, sharing the listener and the workers with the others on its address and port
+struct Site
+{
+    std::vector<std::string> names; // lowercase, for the logs
+    std::string root;
+    std::shared_ptr<std::vector<std::string>> index_file;
+    std::unique_ptr<LocationRouter> router;
+};
+
+/**
+ * @brief Pick the site of a request by its Host header, or the default site if no name matches.
+ *
+ * The names are hashed once into an open addressing table when the sites are added, a lookup hashes the host
+ * without copying it, ignoring the case, the port and a trailing dot, and compares only the names with the
+ * same hash.
+ */
+class VirtualHosts
+{
+public:
+    VirtualHosts();
+
+    /**
+     * @brief Add a site, a name already taken by an earlier site is ignored as nginx does.
+     *
+     * @param site
+     * @param is_default also answers the requests matching no name, the first site added if none is
+     * @return std::vector<std::string> the names ignored
+     */
+    std::vector<std::string> Add(std::unique_ptr<Site> site, bool is_default);
+
+    const Site &Find(std::string_view host) const;
+
+    const Site &Default() const;
+
+    const std::vector<std::unique_ptr<Site>> &Sites() const;
+
+private:
+    struct Slot
+    {
+        uint64_t hash = 0;
+        int site = -1; // empty if -1
+        std::string name;
+    };
+
+private:
+    void Insert(uint64_t hash, int site, std::string name);
+    void Grow();
+
+    static std::string_view HostName(std::string_view host);
+    static uint64_t Hash(std::string_view name);
+
+private:
+    std::vector<Slot> slots_; // the size is a power of 2, at most half full
+    std::size_t used_;
+    std::vector<std::unique_ptr<Site>> sites_;
+    int default_;
+};
+
+inline const Site &VirtualHosts::Default() const
+{
+    return *sites_[default_];
+}
+
+inline const std::vector<std::unique_ptr<Site>> &VirtualHosts::Sites() const
+{
+    return sites_;
+}
+
+// the name without the port and the trailing dot
+inline std::string_view VirtualHosts::HostName(std::string_view host)
+{
+    if(host.empty())
+        return host;
+    std::size_t end = host.front() == '[' ? host.find(']') + 1 : host.find(':'); // a literal IPv6 address has colons
+    host = host.substr(0, end);
+    if(!host.empty() && host.back() == '.')
+        host.remove_suffix(1);
+    return host;
+}
+
+// FNV-1a of the lowercase name
+inline uint64_t VirtualHosts::Hash(std::string_view name)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for(char ch : name)
+    {
+        hash ^= static_cast<unsigned char>(ch >= 'A' && ch <= 'Z' ? ch - 'A' + 'a' : ch);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+} // namespace white
+
+#endif
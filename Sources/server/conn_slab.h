@@ -0,0 +1,81 @@
+#ifndef WHITEWEBSERVER_SERVER_CONN_SLAB_H_
+#define WHITEWEBSERVER_SERVER_CONN_SLAB_H_
+
+#include "protocol/http/http_conn.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace white {
+
+/**
+ * @brief What a reactor knows of a fd, a client connection or an upstream one. A slot never moves once created,
+ * so the poller hands it back with each event and the reactor looks nothing up.
+ */
+struct alignas(64) ConnSlot
+{
+    HttpConn conn; // the client, unused on the slot of an upstream connection
+    int fd = -1;
+    std::atomic<uint32_t> generation{0}; // bumped when the fd is closed, the events and timers of the older one are stale
+    std::atomic<ConnSlot*> client{nullptr}; // set on the slot of an upstream connection, the client it serves
+};
+
+/**
+ * @brief The slots of a reactor indexed by fd. The table of chunks is allocated once for every fd below the limit,
+ * a chunk of slots when the first fd falls in it. A slot holds only the core of a connection, the buffers and the
+ * responses are taken while requests are in flight.
+ */
+class ConnSlab
+{
+public:
+    explicit ConnSlab(int max_fd);
+
+    /**
+     * @brief Get the slot of the fd, created if it is the first one of its chunk. Only the reactor thread creates
+     * slots, the others get the slots of the connections handed to them.
+     *
+     * @param fd below max_fd
+     * @return ConnSlot&
+     */
+    ConnSlot &operator[](int fd);
+
+    bool Contains(int fd) const;
+
+private:
+    static constexpr int kChunkShift = 6; // 64 slots a chunk
+    static constexpr int kChunkMask = (1 << kChunkShift) - 1;
+
+private:
+    std::unique_ptr<std::unique_ptr<ConnSlot[]>[]> chunks_;
+    int max_fd_;
+};
+
+inline ConnSlab::ConnSlab(int max_fd) :
+chunks_(new std::unique_ptr<ConnSlot[]>[(max_fd + kChunkMask) >> kChunkShift]),
+max_fd_(max_fd)
+{
+
+}
+
+inline ConnSlot &ConnSlab::operator[](int fd)
+{
+    auto &chunk = chunks_[fd >> kChunkShift];
+    if(!chunk)
+    {
+        chunk.reset(new ConnSlot[kChunkMask + 1]);
+        int first = fd & ~kChunkMask;
+        for(int i = 0; i <= kChunkMask; ++i)
+            chunk[i].fd = first + i;
+    }
+    return chunk[fd & kChunkMask];
+}
+
+inline bool ConnSlab::Contains(int fd) const
+{
+    return fd >= 0 && fd < max_fd_;
+}
+
+} // namespace white
+
+#endif
@@ -10,46 +10,97 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include <functional>
+#include <thread>
 
 namespace white
 {
 
 const int HttpServer::kMaxFd = 65536;
 
-HttpServer::HttpServer(const Config &config) : 
+HttpServer::HttpServer(const std::vector<Config> &configs) :
+HttpServer(DefaultServer(configs), configs)
+{
+
+}
+
+HttpServer::HttpServer(const Config &config, const std::vector<Config> &configs) : 
 port_(ntohs(config.Port())),
 web_root_(config.WebRoot()),
 timeout_(config.Timeout()),
 enable_linger_(true),
+listenfd_(-1),
 is_close_(false),
-timer_(new HeapTimer()),
-pool_(new ThreadPool()),
-epoll_(Epoll()),
+is_reuse_port_(false),
+thread_num_(config.ThreadNum()),
+timer_(config.IsTimingWheel() ? nullptr : new HeapTimer()),
+timing_wheel_(config.IsTimingWheel() ? new TimingWheel() : nullptr),
+pool_((config.IsMultiReactor() || config.IsWorkStealing()) ? nullptr : new ThreadPool(config.ThreadNum())),
+work_stealing_pool_((!config.IsMultiReactor() && config.IsWorkStealing()) ? new WorkStealingPool(config.ThreadNum()) : nullptr),
+users_(kMaxFd),
 is_set_proxy_(false),
-index_file_(std::make_shared<std::vector<std::string>>(config.IndexFile()))
+proxy_config_(config.GetProxyConfig())
 {
     LOG_INIT(config.LogDir(), kLogLevelDebug);
-    if(config.IsProxy())
-    {
-        is_set_proxy_ = true;
-        proxy_config_ = config.GetProxyConfig();
-        OnProcess = std::bind(&HttpServer::OnProcessProxy, this, std::placeholders::_1);
+    poller_ = Poller::Create(config.IsIoUring());
+    auto hosts = std::make_shared<VirtualHosts>();
+    for(auto &site_config : configs)
+        for(auto &name : hosts->Add(MakeSite(site_config), &site_config == &config))
+            LOG_WARN("Conflicting server name ", name, " on port ", port_, ", ignored");
+    hosts_ = hosts;
 
-        int proxy_fd = socket(AF_INET, SOCK_STREAM, 0);
-        bzero(&proxy_address_, sizeof(proxy_address_));
-        proxy_address_.sin_addr = proxy_config_.addr_;
-        proxy_address_.sin_family = AF_INET;
-        proxy_address_.sin_port = proxy_config_.port_;
+    for(auto &site : hosts_->Sites())
+    {
+        for(auto &location : site->router->Locations())
+        {
+            if(location->handler != Location::HANDLER::PROXY)
+                continue;
+            is_set_proxy_ = true;
+            // Test proxy, the connections are kept for the first requests
+            if(location->upstream->TestConnect(proxy_config_.connect_timeout_) == 0)
+            {
+                LOG_ERROR("Proxy destination address unavailable for location ", location->name);
+                exit(2);
+            }
+            location->upstream->Prewarm(proxy_config_.prewarm_, proxy_config_.connect_timeout_);
+        }
+    }
 
-        // Test proxy
-        if(connect(proxy_fd, (sockaddr*)&proxy_address_, sizeof(proxy_address_)) == -1)
+    if(is_set_proxy_)
+    {
+        OnProcess = std::bind(&HttpServer::OnProcessProxy, this, std::placeholders::_1);
+        if(proxy_config_.splice_)
+            HttpConn::pipe_pool = std::make_shared<PipePool>();
+        if(proxy_config_.cache_)
         {
-            LOG_ERROR("Proxy destination address unavailable");
-            exit(2);
+            HttpConn::proxy_cache = std::make_shared<ProxyCache>(ProxyCache::Config{
+                proxy_config_.cache_memory_, proxy_config_.cache_memory_max_object_, proxy_config_.cache_max_object_,
+                proxy_config_.cache_path_, proxy_config_.cache_disk_, proxy_config_.cache_stale_while_revalidate_,
+                proxy_config_.cache_coalesce_});
+            // the revalidations go to any available server of the location, the hash balances do not matter for them
+            HttpConn::proxy_cache->SetFetcher([hosts = hosts_, timeout = proxy_config_.connect_timeout_](const std::string &request, std::string *response) {
+                std::size_t begin = request.find(' ') + 1;
+                std::size_t end = request.find(' ', begin);
+                auto &site = hosts->Find(ProxyCache::FindHeader(request, "Host"));
+                auto &location = site.router->Route(std::string_view(request).substr(begin, end - begin));
+                return location.upstream && location.upstream->Fetch(0, request, response, timeout);
+            });
         }
-        close(proxy_fd);
         LOG_INFO("========== Proxy Init Successfully ==========");
-        LOG_INFO("[proxy dest]: ", inet_ntoa(proxy_config_.addr_), " [proxy port]: ", ntohs(proxy_config_.port_));
+        for(auto &site : hosts_->Sites())
+        {
+            for(auto &location : site->router->Locations())
+            {
+                if(location->handler != Location::HANDLER::PROXY)
+                    continue;
+                auto &group = *location->upstream;
+                for(std::size_t i = 0; i < group.Size(); ++i)
+                    LOG_INFO("[site] ", site->names.empty() ? "" : site->names.front(), " [location] ", location->name,
+                             " [proxy dest]: ", group.Name(i), " [idle upstream] ", group.Pool(i).IdleCount());
+                LOG_INFO("[location] ", location->name, " [balance] ", group.BalanceName());
+            }
+        }
+        LOG_INFO("[keepalive] ", proxy_config_.keepalive_, " [splice] ", proxy_config_.splice_,
+                 " [health check interval] ", proxy_config_.health_check_interval_, " [cache] ", proxy_config_.cache_);
     }else
         OnProcess = std::bind(&HttpServer::OnProcessStatic, this, std::placeholders::_1);
 
@@ -60,10 +111,27 @@ index_file_(std::make_shared<std::vector<std::string>>(config.IndexFile()))
 
     HttpConn::user_count = 0;
     HttpConn::web_root = config.WebRoot();
+    HttpConn::is_sendfile = config.IsSendfile();
+    if(config.OpenFileCacheSize() > 0)
+        HttpConn::open_file_cache = std::make_shared<OpenFileCache>(config.OpenFileCacheSize(), config.OpenFileCacheValid(), &HttpResponse::GetMimeType);
+    if(config.HotObjectCacheMemory() > 0)
+        HttpConn::hot_object_cache = std::make_shared<HotObjectCache>(config.HotObjectCacheMemory(), config.HotObjectCacheMaxObject(), config.HotObjectCacheValid());
 
-    InitEventMode();
-    if(!InitSocket())
-        is_close_ = true;
+    if(config.IsMultiReactor())
+    {
+        // every sub reactor listens on its own SO_REUSEPORT socket, so a connection never leaves the thread accepted it
+        for(int i = 0; i < thread_num_; ++i)
+        {
+            sub_reactors_.emplace_back(new HttpServer(this));
+            if(sub_reactors_.back()->is_close_)
+                is_close_ = true;
+        }
+    }else
+    {
+        InitEventMode();
+        if(!InitSocket())
+            is_close_ = true;
+    }
 
     if(is_close_)
     {
@@ -72,40 +140,172 @@ index_file_(std::make_shared<std::vector<std::string>>(config.IndexFile()))
     else
     {
         LOG_INFO("========== Server Init Successfully ==========");
-        LOG_INFO("[Port] ", port_, " [Log path] ", config.LogDir(), " [web root] ", HttpConn::web_root);
+        LOG_INFO("[Port] ", port_, " [Log path] ", config.LogDir(), " [web root] ", HttpConn::web_root, " [sites] ", hosts_->Sites().size());
+        LOG_INFO("[Reactor mode] ", sub_reactors_.empty() ? "single" : "multi", " [threads] ", thread_num_,
+                 " [thread pool] ", work_stealing_pool_ ? "work stealing" : (pool_ ? "shared queue" : "none"),
+                 " [timer] ", timing_wheel_ ? "wheel" : "heap", " [events] ", poller_->IsIoUring() ? "io_uring" : "epoll",
+                 " [file transmission] ", HttpConn::is_sendfile ? "sendfile" : "mmap",
+                 " [open file cache] ", config.OpenFileCacheSize(), " [hot object cache] ", config.HotObjectCacheMemory(),
+                 " [request scanner] ", ScannerName());
     }
 }
 
+HttpServer::HttpServer(HttpServer *main_reactor) :
+port_(main_reactor->port_),
+web_root_(main_reactor->web_root_),
+timeout_(main_reactor->timeout_),
+enable_linger_(main_reactor->enable_linger_),
+listenfd_(-1),
+is_close_(false),
+is_reuse_port_(true),
+thread_num_(1),
+timer_(main_reactor->timing_wheel_ ? nullptr : new HeapTimer()),
+timing_wheel_(main_reactor->timing_wheel_ ? new TimingWheel() : nullptr),
+pool_(nullptr),
+work_stealing_pool_(nullptr),
+poller_(Poller::Create(main_reactor->poller_->IsIoUring())),
+users_(kMaxFd),
+is_set_proxy_(main_reactor->is_set_proxy_),
+proxy_config_(main_reactor->proxy_config_),
+hosts_(main_reactor->hosts_)
+{
+    if(is_set_proxy_)
+        OnProcess = std::bind(&HttpServer::OnProcessProxy, this, std::placeholders::_1);
+    else
+        OnProcess = std::bind(&HttpServer::OnProcessStatic, this, std::placeholders::_1);
+    address_ = main_reactor->address_;
+
+    InitEventMode();
+    if(!InitSocket())
+        is_close_ = true;
+}
+
+const Config &HttpServer::DefaultServer(const std::vector<Config> &configs)
+{
+    for(auto &config : configs)
+        if(config.IsDefaultServer())
+            return config;
+    return configs.front();
+}
+
+std::unique_ptr<Site> HttpServer::MakeSite(const Config &config)
+{
+    Location default_location{};
+    if(config.IsProxy())
+    {
+        default_location.handler = Location::HANDLER::PROXY;
+        default_location.upstream = std::make_shared<UpstreamGroup>(config.GetProxyConfig());
+    }else
+    {
+        default_location.handler = Location::HANDLER::STATIC;
+        default_location.root = config.WebRoot();
+    }
+    default_location.name = "default";
+
+    auto site = std::make_unique<Site>();
+    site->names = config.ServerNames();
+    site->root = config.WebRoot();
+    site->index_file = std::make_shared<std::vector<std::string>>(config.IndexFile());
+    site->router = std::make_unique<LocationRouter>(std::move(default_location));
+    for(auto &location_config : config.Locations())
+    {
+        Location location{};
+        // as nginx writes them
+        location.name = (location_config.match_ == LocationMatch::EXACT ? "= " : location_config.match_ == LocationMatch::REGEX ? "~ " : "")
+                        + location_config.pattern_;
+        if(!location_config.proxy_config_.servers_.empty())
+        {
+            location.handler = Location::HANDLER::PROXY;
+            location.upstream = std::make_shared<UpstreamGroup>(location_config.proxy_config_);
+        }else if(!location_config.redirect_.empty())
+        {
+            location.handler = Location::HANDLER::REDIRECT;
+            location.redirect = location_config.redirect_;
+            location.redirect_code = location_config.redirect_code_;
+        }else
+        {
+            location.handler = Location::HANDLER::STATIC;
+            location.root = location_config.root_.empty() ? config.WebRoot() : location_config.root_;
+        }
+        if(!site->router->Add(location_config.match_, location_config.pattern_, std::move(location)))
+        {
+            LOG_ERROR("Invalid location regex: ", location_config.pattern_);
+            exit(2);
+        }
+    }
+    return site;
+}
+
 HttpServer::~HttpServer()
 {
-    close(listenfd_);
+    if(listenfd_ >= 0)
+        close(listenfd_);
     is_close_ = true;
 }
 
 void HttpServer::Run()
 {
-    int time_epoll = -1;
     if(!is_close_)
     {
         LOG_INFO("==========    Server   running    ==========");
     }
+    if(sub_reactors_.empty())
+    {
+        RunLoop();
+        return;
+    }
+    std::vector<std::thread> reactor_threads;
+    reactor_threads.reserve(sub_reactors_.size());
+    for(auto &reactor : sub_reactors_)
+        reactor_threads.emplace_back(&HttpServer::RunLoop, reactor.get());
+    for(auto &reactor_thread : reactor_threads)
+        reactor_thread.join();
+}
+
+void HttpServer::RunLoop()
+{
+    int time_epoll = -1;
     while(!is_close_)
     {
-        if(timeout_ > 0)
-            time_epoll = timer_->NextTickTime(); // Handle the timeout connection, get the next timeout point, and prevent epoll from waiting.
-        int epoll_event_cnt = epoll_.Wait(time_epoll);
+        if(timeout_ > 0 || is_set_proxy_) // the upstream connect timeouts are on the timer too
+            time_epoll = NextTickTime(); // Handle the timeout connection, get the next timeout point, and prevent epoll from waiting.
+        int epoll_event_cnt = poller_->Wait(time_epoll);
+        HttpDate::Tick(); // the Date of the responses made by this round
+        if(timing_wheel_)
+            timing_wheel_->Update(); // the base of the timeouts refreshed by this round of events
+        // every event delivered disarms its fd before any handler of the round arms it again, as one shot does,
+        // and an event of a fd closed by an earlier handler of the round is dropped
+        if(epoll_event_cnt > 0 && round_.size() < static_cast<std::size_t>(epoll_event_cnt))
+            round_.resize(epoll_event_cnt);
+        for (int i = 0; i < epoll_event_cnt; ++i)
+        {
+            auto &event = round_[i];
+            event.slot = static_cast<ConnSlot*>(poller_->GetEventData(i)); // none for the listen socket
+            event.generation = event.slot ? event.slot->generation.load(std::memory_order_relaxed) : 0;
+            event.is_wanted = !event.slot || interest_->Fire(event.slot->fd);
+        }
         for (int i = 0; i < epoll_event_cnt; ++i)
         {
-            int cur_event_fd = epoll_.GetEventFd(i);
-            auto events = epoll_.GetEvents(i);
-            if(cur_event_fd == listenfd_)
-                DealListen();
+            auto &event = round_[i];
+            if(!event.is_wanted)
+                continue;
+            auto events = poller_->GetEvents(i);
+            if(!event.slot)
+                DealListen(poller_->GetAcceptedFd(i));
+            else if(event.slot->generation.load(std::memory_order_relaxed) != event.generation)
+                continue;
             else if(events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
-                DealDisconnect(cur_event_fd);
+                DealDisconnect(*event.slot);
             else if(events & EPOLLIN)
-                DealRead(cur_event_fd);
+            {
+                bool is_more;
+                std::string_view received = poller_->GetReceived(i, &is_more);
+                if(!received.empty())
+                    event.slot->conn.Receive(received, is_more); // copied before the next Wait reuses the buffer
+                DealRead(*event.slot);
+            }
             else if(events & EPOLLOUT)
-                DealWrite(cur_event_fd);
+                DealWrite(*event.slot);
             else
                 LOG_ERROR("Unknown event happened: ", events);
         }
@@ -144,6 +344,14 @@ bool HttpServer::InitSocket()
         return false;
     }
 
+    // each sub reactor binds its own socket to the same port, the kernel balances connections among them.
+    if(is_reuse_port_ && setsockopt(listenfd_, SOL_SOCKET, SO_REUSEPORT, &opt_reuse, sizeof(opt_reuse)) < 0)
+    {
+        LOG_ERROR("set reuse port error: ", strerror(errno));
+        close(listenfd_);
+        return false;
+    }
+
     if(bind(listenfd_, (sockaddr*)&address_, sizeof(address_)) < 0)
     {
         LOG_ERROR("Bind error: ", strerror(errno));
@@ -151,14 +359,15 @@ bool HttpServer::InitSocket()
         return false;
     }
 
-    if(listen(listenfd_, 5) < 0)
+    // a short backlog drops the handshakes of a burst of clients, which wait for the retransmission
+    if(listen(listenfd_, SOMAXCONN) < 0)
     {
         LOG_ERROR("listen error: ", strerror(errno));
         close(listenfd_);
         return false;
     }
 
-    if(!epoll_.AddFd(listenfd_, listen_event_ | EPOLLIN))
+    if(!poller_->AddListenFd(listenfd_, listen_event_ | EPOLLIN, nullptr))
     {
         LOG_ERROR("Epoll add listenfd error: ", strerror(errno));
         close(listenfd_);
@@ -171,76 +380,59 @@ bool HttpServer::InitSocket()
 void HttpServer::InitEventMode()
 {
     listen_event_ = EPOLLRDHUP; // tcp connection closed by peer.
-    conn_event_ = EPOLLONESHOT | EPOLLRDHUP;
     // set direct to et
     listen_event_ |= EPOLLET;
-    conn_event_ |= EPOLLET;
+    // the workers of a pool must never handle a connection twice at once, and io_uring arms without a syscall
+    // anyway, otherwise the connections stay registered level triggered and are armed again only on a change
+    bool is_oneshot = pool_ || work_stealing_pool_ || poller_->IsIoUring();
+    conn_event_ = is_oneshot ? EPOLLONESHOT | EPOLLRDHUP | EPOLLET : EPOLLRDHUP;
+    interest_ = std::make_unique<InterestTracker>(*poller_, is_oneshot, kMaxFd);
 }
 
-void HttpServer::AddClient(int fd, sockaddr_in addr, int proxy_fd)
+// a proxied client borrows an upstream connection only when it has a request to forward, the fd is nonblocking
+void HttpServer::AddClient(int fd, sockaddr_in addr)
 {
-    users_[fd].Init(fd, addr, proxy_fd, index_file_);
-    if(timeout_)
-        timer_->AddTimer(fd, timeout_, std::bind(&HttpServer::CloseConn, this, std::ref(users_[fd]))); // close after timeout
-    epoll_.AddFd(fd, EPOLLIN | conn_event_);
-    SetNoBlock(fd);
-    if(proxy_fd != -1)
-    {
-        proxy_fd_map_.emplace(proxy_fd, fd);
-        epoll_.AddFd(proxy_fd, EPOLLIN | conn_event_);
-        SetNoBlock(proxy_fd);
-    }  
+    ConnSlot &slot = users_[fd];
+    slot.conn.Init(fd, addr, -1, hosts_);
+    AddTimer(slot.conn);
+    interest_->Add(fd, EPOLLIN | conn_event_, &slot, true);
 }
 
-void HttpServer::DealListen()
+void HttpServer::DealListen(int accepted_fd)
 {
     sockaddr_in client_addr;
     socklen_t client_addr_len = sizeof(client_addr);
     do
     {
-        int client_fd = accept(listenfd_, (sockaddr *)&client_addr, &client_addr_len);
+        int client_fd = accepted_fd;
+        if(client_fd >= 0)
+            getpeername(client_fd, (sockaddr *)&client_addr, &client_addr_len);
+        else
+            client_fd = accept4(listenfd_, (sockaddr *)&client_addr, &client_addr_len, SOCK_NONBLOCK);
         if(client_fd < 0)
             return;
-        else if(HttpConn::user_count >= kMaxFd)
+        else if(HttpConn::user_count >= kMaxFd || !users_.Contains(client_fd))
         {
             SendError(client_fd, "Server busy");
             LOG_WARN("Client is full");
             return;
         }
-        int proxy_fd = -1;
-        if(is_set_proxy_)
-            if((proxy_fd = GetNewProxyFd()) == -1)
-                continue;
-        AddClient(client_fd, client_addr, proxy_fd);
-    } while (true);
+        AddClient(client_fd, client_addr);
+    } while (accepted_fd < 0);
 }
 
-void HttpServer::DealDisconnect(int fd)
+void HttpServer::DealDisconnect(ConnSlot &slot)
 {
-    if(is_set_proxy_ && proxy_fd_map_.count(fd))
+    // the upstream closing may end a response framed by the close, read what is left first
+    ConnSlot *upstream_client = slot.client.load(std::memory_order_acquire);
+    if(upstream_client)
     {
-        int retry_count = 0;
-        int new_proxy_fd;
-        while((new_proxy_fd = GetNewProxyFd()) == -1)
-        {
-            if(++retry_count > 5)
-            {
-                LOG_ERROR("Unable to connect to proxy server!");
-                CloseConn(users_[proxy_fd_map_[fd]]);
-            }
-            LOG_WARN("Try to reconnect to the proxy server!");
-        }
-        LOG_INFO("Reconnect to the proxy server!");
-        close(fd);
-        epoll_.DelFd(fd);
-        int client_fd = proxy_fd_map_[fd];
-        users_[client_fd].ResetProxyFd(new_proxy_fd);
-        proxy_fd_map_.erase(fd);
-        proxy_fd_map_.emplace(new_proxy_fd, client_fd);
-        epoll_.AddFd(new_proxy_fd, EPOLLIN);
-        SetNoBlock(new_proxy_fd);
+        if(upstream_client->conn.IsUpstreamConnecting())
+            DealWrite(slot); // the connection is refused
+        else
+            DealRead(slot);
     }else
-        CloseConn(users_[fd]);
+        CloseConn(slot.conn);
 }
 
 void HttpServer::SendError(int fd, const char *info)
@@ -262,15 +454,20 @@ void HttpServer::SendError(int fd, const char *info)
 
 void HttpServer::CloseConn(HttpConn &client)
 {
-    epoll_.DelFd(client.GetFd());
+    users_[client.GetFd()].generation.fetch_add(1, std::memory_order_relaxed);
+    interest_->Del(client.GetFd());
     if(is_set_proxy_)
-    {
-        proxy_fd_map_.erase(client.GetProxyFd());
-        epoll_.DelFd(client.GetProxyFd());
-    }
+        DetachUpstream(client, false); // the response may be half read
     client.Close();
 }
 
+// the timer of a connection closed meanwhile is stale, its fd may serve another one
+void HttpServer::OnTimeout(ConnSlot &slot, uint32_t generation)
+{
+    if(slot.generation.load(std::memory_order_relaxed) == generation)
+        CloseConn(slot.conn);
+}
+
 void HttpServer::OnRead(HttpConn &client, bool in_proxy)
 {
     int read_error;
@@ -279,7 +476,8 @@ void HttpServer::OnRead(HttpConn &client, bool in_proxy)
         ret = client.ReadResponseFromProxy(&read_error);
     else
         ret = client.Read(&read_error);
-    if(ret <= 0 && read_error != EAGAIN && read_error != EWOULDBLOCK)
+    // the upstream closing or failing is handled by the framing of the response
+    if(!in_proxy && ret <= 0 && read_error != EAGAIN && read_error != EWOULDBLOCK)
     {
         CloseConn(client);
         return;
@@ -295,19 +493,28 @@ void HttpServer::OnWrite(HttpConn &client, bool in_proxy)
         ret = client.SendRequestToProxy(&write_error);
     else
         ret = client.Write(&write_error);
+    if(!in_proxy && is_set_proxy_ && (ret >= 0 || write_error == EAGAIN || write_error == EWOULDBLOCK) && client.ShouldReadUpstream())
+    {
+        // the rest of the response from the upstream, only one of the two connections is waited at a time
+        interest_->Arm(client.GetProxyFd(), conn_event_ | EPOLLIN);
+        return;
+    }
     if (client.PendingWriteBytes() == 0)
     {
         if(in_proxy)
         {
             ExtentTime(client);
-            epoll_.ModFd(client.GetProxyFd(), conn_event_ | EPOLLIN); // waiting for response from proxy server
+            interest_->Arm(client.GetProxyFd(), conn_event_ | EPOLLIN); // waiting for response from proxy server
             return;
         }
         if (client.IsKeepAlive())
         {
-            // wait for the next in
             ExtentTime(client);
-            epoll_.ModFd(client.GetFd(), conn_event_ | EPOLLIN);
+            // pipelined requests already read would never raise another EPOLLIN
+            if(client.HasPendingRequest())
+                OnProcess(client);
+            else
+                ReadClient(client);
             return;
         }
     }else if(ret < 0)
@@ -316,9 +523,9 @@ void HttpServer::OnWrite(HttpConn &client, bool in_proxy)
         if(write_error == EAGAIN || write_error == EWOULDBLOCK)
         {
             if(in_proxy)
-                epoll_.ModFd(client.GetProxyFd(), conn_event_ | EPOLLOUT);
+                interest_->Arm(client.GetProxyFd(), conn_event_ | EPOLLOUT);
             else
-                epoll_.ModFd(client.GetFd(), conn_event_ | EPOLLOUT);
+                interest_->Arm(client.GetFd(), conn_event_ | EPOLLOUT);
             return;
         }
     }
@@ -332,13 +539,13 @@ void HttpServer::OnProcessStatic(HttpConn &client)
     switch (process_result)
     {
         case HttpConn::PROCESS_STATE::FINISH:
-            epoll_.ModFd(client.GetFd(), conn_event_ | EPOLLOUT);
+            WriteClient(client);
             break;
         case HttpConn::PROCESS_STATE::PENDING:
-            epoll_.ModFd(client.GetFd(), conn_event_ | EPOLLIN);
+            ReadClient(client);
             break;
         case HttpConn::PROCESS_STATE::FAIL:
-            epoll_.ModFd(client.GetFd(), conn_event_ | EPOLLIN);
+            ReadClient(client);
             break;
         default:
             break;
@@ -348,17 +555,161 @@ void HttpServer::OnProcessStatic(HttpConn &client)
 void HttpServer::OnProcessProxy(HttpConn &client)
 {
     auto process_result = client.ProcessProxy();
+    if(client.GetProxyFd() != -1 && client.IsUpstreamDone())
+        DetachUpstream(client, client.IsUpstreamReusable());
     switch (process_result)
     {
         case HttpConn::PROXY_PROCESS_STATE::PENDING_WRITE_TO_PROXY_SERVER:
-            epoll_.ModFd(client.GetProxyFd(), conn_event_ | EPOLLOUT);
+            if(client.GetProxyFd() != -1)
+                interest_->Arm(client.GetProxyFd(), conn_event_ | EPOLLOUT);
+            else if(!pool_ && !work_stealing_pool_)
+                AttachUpstream(client);
+            else
+                interest_->Arm(client.GetFd(), conn_event_ | EPOLLOUT); // the timer belongs to the reactor, let it attach
+            break;
+        case HttpConn::PROXY_PROCESS_STATE::PENDING_READ_FROM_PROXY_SERVER:
+            interest_->Arm(client.GetProxyFd(), conn_event_ | EPOLLIN);
+            break;
+        case HttpConn::PROXY_PROCESS_STATE::FAIL:
+            CloseConn(client);
             break;
         case HttpConn::PROXY_PROCESS_STATE::PENDING_WRITE_TO_CLIENT:
-            epoll_.ModFd(client.GetFd(), conn_event_ | EPOLLOUT);
+            WriteClient(client);
+            break;
+        case HttpConn::PROXY_PROCESS_STATE::PENDING_READ_FROM_CLIENT:
+            ReadClient(client);
+            break;
+        case HttpConn::PROXY_PROCESS_STATE::PENDING_WAIT_FLIGHT:
+            // nothing is armed meanwhile, the end of the flight arms the client from the thread of its leader
+            interest_->Park(client.GetFd());
+            if(!client.WaitFlight([this, slot = &users_[client.GetFd()]] {
+                   poller_->ModFd(slot->fd, conn_event_ | EPOLLOUT | EPOLLONESHOT, slot);
+               }))
+                OnProcessProxy(client);
             break;
         default:
             break;
     }
 }
 
+// the reactor owning its connections alone writes at once, the socket has room for most responses
+void HttpServer::WriteClient(HttpConn &client)
+{
+    if(interest_->IsOneShot())
+    {
+        interest_->Arm(client.GetFd(), conn_event_ | EPOLLOUT);
+        return;
+    }
+    interest_->Save();
+    OnWrite(client, false);
+}
+
+// an idle keep-alive connection holds none of the memory of the requests, it is taken again by the next read
+void HttpServer::ReadClient(HttpConn &client)
+{
+    client.Trim();
+    interest_->Arm(client.GetFd(), conn_event_ | EPOLLIN);
+}
+
+void HttpServer::AttachUpstream(HttpConn &client)
+{
+    UpstreamGroup &group = *client.GetLocation().upstream;
+    uint64_t key = 0;
+    if(group.Balance() == ProxyBalance::HASH_IP)
+        key = client.GetAddress().sin_addr.s_addr;
+    else if(group.Balance() == ProxyBalance::HASH_URI)
+        key = client.GetPathHash();
+
+    // a server failing to connect backs off, so the next try selects another one
+    bool is_connecting;
+    int proxy_fd = -1;
+    int index = -1;
+    for(std::size_t i = 0; i < group.Size() && proxy_fd == -1; ++i)
+    {
+        index = group.Select(key);
+        if(index == -1)
+            break;
+        proxy_fd = group.Pool(index).Acquire(&is_connecting);
+    }
+    if(proxy_fd != -1 && !users_.Contains(proxy_fd))
+    {
+        LOG_WARN("Upstream connection fd ", proxy_fd, " out of range");
+        group.Pool(index).Discard(proxy_fd);
+        proxy_fd = -1;
+    }
+    if(proxy_fd == -1)
+    {
+        SendUpstreamError(client, 502);
+        return;
+    }
+    group.OnAttach(index);
+    client.ResetProxyFd(proxy_fd, index);
+    ConnSlot &upstream = users_[proxy_fd];
+    upstream.client.store(&users_[client.GetFd()], std::memory_order_release);
+    client.SetUpstreamConnecting(is_connecting);
+    if(is_connecting)
+        AddConnectTimer(client);
+    interest_->Add(proxy_fd, conn_event_ | EPOLLOUT, &upstream);
+}
+
+bool HttpServer::OnUpstreamConnected(HttpConn &client)
+{
+    int error = 0;
+    socklen_t len = sizeof(error);
+    getsockopt(client.GetProxyFd(), SOL_SOCKET, SO_ERROR, &error, &len);
+    DelConnectTimer(client);
+    client.SetUpstreamConnecting(false);
+    client.GetLocation().upstream->Pool(client.GetUpstreamIndex()).ReportConnect(error == 0);
+    if(error == 0)
+        return true;
+    LOG_WARN("Fail to connect to upstream for client[", client.GetFd(), "]: ", strerror(error));
+    DetachUpstream(client, false);
+    AttachUpstream(client); // nothing is sent yet, try the next server, the failed one is backing off
+    return false;
+}
+
+void HttpServer::OnUpstreamConnectTimeout(ConnSlot &upstream, uint32_t generation)
+{
+    ConnSlot *upstream_client = upstream.client.load(std::memory_order_acquire);
+    if(upstream.generation.load(std::memory_order_relaxed) != generation || !upstream_client
+       || !upstream_client->conn.IsUpstreamConnecting())
+        return; // connected or detached in the meantime
+    HttpConn &client = upstream_client->conn;
+    LOG_WARN("Connecting to upstream timed out for client[", client.GetFd(), "]");
+    client.SetUpstreamConnecting(false); // the timer is being removed already
+    client.GetLocation().upstream->Pool(client.GetUpstreamIndex()).ReportConnect(false);
+    DetachUpstream(client, false);
+    SendUpstreamError(client, 504);
+}
+
+void HttpServer::SendUpstreamError(HttpConn &client, int code)
+{
+    client.QueueErrorResponse(code);
+    interest_->Arm(client.GetFd(), conn_event_ | EPOLLOUT);
+}
+
+void HttpServer::DetachUpstream(HttpConn &client, bool reuse)
+{
+    int proxy_fd = client.GetProxyFd();
+    if(proxy_fd == -1)
+        return;
+    if(client.IsUpstreamConnecting())
+    {
+        DelConnectTimer(client);
+        client.SetUpstreamConnecting(false);
+    }
+    interest_->Del(proxy_fd);
+    ConnSlot &upstream = users_[proxy_fd];
+    upstream.generation.fetch_add(1, std::memory_order_relaxed);
+    upstream.client.store(nullptr, std::memory_order_release);
+    int index = client.GetUpstreamIndex();
+    UpstreamGroup &group = *client.GetLocation().upstream;
+    client.ResetProxyFd(-1);
+    group.OnDetach(index);
+    if(reuse)
+        group.Pool(index).Release(proxy_fd);
+    else
+        group.Pool(index).Discard(proxy_fd);
+}
+
 } // namespace white
\ No newline at end of file
@@ -8,10 +8,16 @@
 
 #include "protocol/http/http_conn.h"
 #include "pool/thread_pool.h"
+#include "pool/work_stealing_pool.h"
 #include "timer/heap_timer.h"
+#include "timer/timing_wheel.h"
 #include "logger/logger.h"
-#include "epoll/epoll.h"
+#include "epoll/poller.h"
+#include "epoll/interest_tracker.h"
 #include "config/config.h"
+#include "proxy/upstream_group.h"
+#include "router/virtual_hosts.h"
+#include "server/conn_slab.h"
 
 #include <sys/epoll.h>
 #include <sys/socket.h>
@@ -19,31 +25,78 @@
 
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 namespace white {
 
 class HttpServer
 {
 public:
-    HttpServer(const Config &config);
+    /**
+     * @brief Construct the main reactor serving the configs sharing an address and a port, as virtual hosts picked
+     * by the Host header. The threads, timers, caches and logs of the process follow the default server.
+     * 
+     * @param configs 
+     */
+    HttpServer(const std::vector<Config> &configs);
     ~HttpServer();
 
     void Run();
 
 private:
+    /**
+     * @brief Construct a sub reactor of multi reactor mode, which owns its own epoll, timer and connections,
+     * and handles all the events in the thread running it.
+     * 
+     * @param main_reactor the server which creates this sub reactor.
+     */
+    explicit HttpServer(HttpServer *main_reactor);
+    HttpServer(const Config &config, const std::vector<Config> &configs);
+
+    /**
+     * @brief The server marked default_server, or the first one.
+     * 
+     * @param configs 
+     * @return const Config& 
+     */
+    static const Config &DefaultServer(const std::vector<Config> &configs);
+
+    /**
+     * @brief Build the locations of a server with their upstream groups, the root or proxy_pass of the server
+     * as the default location.
+     * 
+     * @param config 
+     * @return std::unique_ptr<Site> 
+     */
+    static std::unique_ptr<Site> MakeSite(const Config &config);
+
+    void RunLoop();
+
+    template<typename F>
+    void Dispatch(F &&task);
+
     bool InitSocket();
-    void InitEventMode(); // default: et
-    void AddClient(int fd, sockaddr_in addr, int proxy_fd = -1);
+    void InitEventMode(); // et and one shot with a pool, level triggered otherwise
+    void AddClient(int fd, sockaddr_in addr);
 
-    void DealListen();
-    void DealWrite(int fd);
-    void DealRead(int fd);
-    void DealDisconnect(int fd);
+    /**
+     * @brief Take the connection accepted by the poller, or accept every one waiting if it is -1.
+     * 
+     * @param accepted_fd 
+     */
+    void DealListen(int accepted_fd);
+    void DealWrite(ConnSlot &slot);
+    void DealRead(ConnSlot &slot);
+    void DealDisconnect(ConnSlot &slot);
 
     void SendError(int fd, const char *info);
+    void AddTimer(HttpConn &client);
     void ExtentTime(HttpConn &client);
+    int NextTickTime();
     void CloseConn(HttpConn &client);
+    void OnTimeout(ConnSlot &slot, uint32_t generation);
 
     void OnRead(HttpConn &client, bool in_proxy);
     void OnWrite(HttpConn &client, bool in_proxy);
@@ -56,11 +109,68 @@ private:
     void OnProcessStatic(HttpConn &client);
     void OnProcessProxy(HttpConn &client);
 
-    int GetNewProxyFd();
+    /**
+     * @brief Send the response, at once if no worker may touch the connection meanwhile, or wait for EPOLLOUT.
+     * 
+     * @param client 
+     */
+    void WriteClient(HttpConn &client);
+
+    /**
+     * @brief Wait for the next request of the client, trimmed to its core meanwhile if nothing is in flight.
+     * 
+     * @param client 
+     */
+    void ReadClient(HttpConn &client);
+
+    /**
+     * @brief Borrow a connection from the upstream pool for the request of the client and wait for it to be writable,
+     * answer 502 if unable to connect. A connection in progress is given connect_timeout on the timer, so it must
+     * run in the reactor thread.
+     * 
+     * @param client 
+     */
+    void AttachUpstream(HttpConn &client);
+
+    /**
+     * @brief The connection in progress became writable or failed, forward the request if connected.
+     * 
+     * @param client 
+     * @return true connected
+     * @return false failed, the request is tried on the next server, or answered with 502 if none is left
+     */
+    bool OnUpstreamConnected(HttpConn &client);
+    void OnUpstreamConnectTimeout(ConnSlot &upstream, uint32_t generation);
+    void AddConnectTimer(HttpConn &client);
+    void DelConnectTimer(HttpConn &client);
+
+    /**
+     * @brief Answer the client with an error instead of the upstream.
+     * 
+     * @param client 
+     * @param code 
+     */
+    void SendUpstreamError(HttpConn &client, int code);
+
+    /**
+     * @brief Stop watching the upstream connection of the client, give it back to the pool if reusable, or close it.
+     * 
+     * @param client 
+     * @param reuse 
+     */
+    void DetachUpstream(HttpConn &client, bool reuse);
 
 private:
     static const int kMaxFd;
 
+    // an event of a round, the generation of its slot when delivered
+    struct RoundEvent
+    {
+        ConnSlot *slot;
+        uint32_t generation;
+        bool is_wanted;
+    };
+
 private:
 
     int port_;
@@ -70,6 +180,8 @@ private:
 
     int listenfd_;
     bool is_close_;
+    bool is_reuse_port_;
+    int thread_num_;
 
     uint32_t listen_event_;
     uint32_t conn_event_;
@@ -77,17 +189,22 @@ private:
     sockaddr_in address_;
 
     std::unique_ptr<HeapTimer> timer_;
+    std::unique_ptr<TimingWheel> timing_wheel_;
     std::unique_ptr<ThreadPool> pool_;
-    Epoll epoll_;
-    std::unordered_map<int, HttpConn> users_;
+    std::unique_ptr<WorkStealingPool> work_stealing_pool_;
+    std::unique_ptr<Poller> poller_;
+    std::unique_ptr<InterestTracker> interest_; // the connections of this reactor, none in the main one of multi reactor mode
+    std::vector<RoundEvent> round_;
+    ConnSlab users_; // indexed by the fds of the clients and of their upstream connections
+
+    // sub reactors in multi reactor mode, empty in single reactor mode
+    std::vector<std::unique_ptr<HttpServer>> sub_reactors_;
 
 // for proxy
 private:
     bool is_set_proxy_;
     ProxyConfig proxy_config_;
-    sockaddr_in proxy_address_;
-    std::unordered_map<int, int> proxy_fd_map_;
-    std::shared_ptr<std::vector<std::string>> index_file_;
+    std::shared_ptr<const VirtualHosts> hosts_; // shared by all sub reactors, with the upstream groups of the locations
 };
 
 inline void HttpServer::SetNoBlock(int fd)
@@ -96,43 +213,97 @@ inline void HttpServer::SetNoBlock(int fd)
     fcntl(fd, F_SETFL, old_option | O_NONBLOCK);
 }
 
-inline void HttpServer::DealWrite(int fd)
+// Hand the task to the thread pool, or run it in place if this reactor owns no pool (multi reactor mode).
+template<typename F>
+inline void HttpServer::Dispatch(F &&task)
 {
-    bool in_proxy = false;
-    if(is_set_proxy_ && proxy_fd_map_.count(fd))
-    {
-        fd = proxy_fd_map_[fd];
-        in_proxy = true;
-    }
-    ExtentTime(users_[fd]);
-    pool_->AddTask(std::bind(&HttpServer::OnWrite, this, std::ref(users_[fd]), in_proxy));
+    if(work_stealing_pool_)
+        work_stealing_pool_->AddTask(std::forward<F>(task));
+    else if(pool_)
+        pool_->AddTask(std::forward<F>(task));
+    else
+        task();
 }
 
-inline void HttpServer::DealRead(int fd)
+// an event of an upstream connection comes on its own slot, which points to the client served
+inline void HttpServer::DealWrite(ConnSlot &slot)
 {
-    bool in_proxy = false;
-    if(is_set_proxy_ && proxy_fd_map_.count(fd))
+    ConnSlot *upstream_client = slot.client.load(std::memory_order_acquire);
+    bool in_proxy = upstream_client != nullptr;
+    HttpConn &client = in_proxy ? upstream_client->conn : slot.conn;
+    if(in_proxy)
     {
-        fd = proxy_fd_map_[fd];
-        in_proxy = true;
+        if(client.IsUpstreamConnecting() && !OnUpstreamConnected(client))
+            return;
+    }else if(is_set_proxy_ && client.IsWaitingUpstream())
+    {
+        AttachUpstream(client); // handed over by a worker thread
+        return;
+    }else if(is_set_proxy_ && client.IsWaitingFlight())
+    {
+        // woken by the end of the flight, process the request again
+        ExtentTime(client);
+        Dispatch(std::bind(&HttpServer::OnProcessProxy, this, std::ref(client)));
+        return;
     }
-    ExtentTime(users_[fd]);
-    pool_->AddTask(std::bind(&HttpServer::OnRead, this, std::ref(users_[fd]), in_proxy));
+    ExtentTime(client);
+    Dispatch(std::bind(&HttpServer::OnWrite, this, std::ref(client), in_proxy));
+}
+
+inline void HttpServer::DealRead(ConnSlot &slot)
+{
+    ConnSlot *upstream_client = slot.client.load(std::memory_order_acquire);
+    bool in_proxy = upstream_client != nullptr;
+    HttpConn &client = in_proxy ? upstream_client->conn : slot.conn;
+    ExtentTime(client);
+    Dispatch(std::bind(&HttpServer::OnRead, this, std::ref(client), in_proxy));
+}
+
+inline void HttpServer::AddTimer(HttpConn &client)
+{
+    if(!timeout_)
+        return;
+    ConnSlot &slot = users_[client.GetFd()];
+    auto cb = std::bind(&HttpServer::OnTimeout, this, std::ref(slot), slot.generation.load(std::memory_order_relaxed)); // close after timeout
+    if(timing_wheel_)
+        timing_wheel_->AddTimer(client.GetTimerNode(), timeout_, cb);
+    else
+        timer_->AddTimer(client.GetFd(), timeout_, cb);
 }
 
 inline void HttpServer::ExtentTime(HttpConn &client)
 {
-    if(timeout_)
+    if(!timeout_)
+        return;
+    if(timing_wheel_)
+        timing_wheel_->AdjustTimer(client.GetTimerNode(), timeout_);
+    else
         timer_->AdjustTimer(client.GetFd(), timeout_);
 }
 
-inline int HttpServer::GetNewProxyFd()
+inline int HttpServer::NextTickTime()
+{
+    if(timing_wheel_)
+        return timing_wheel_->NextTickTime();
+    return timer_->NextTickTime();
+}
+
+inline void HttpServer::AddConnectTimer(HttpConn &client)
+{
+    ConnSlot &upstream = users_[client.GetProxyFd()];
+    auto cb = std::bind(&HttpServer::OnUpstreamConnectTimeout, this, std::ref(upstream), upstream.generation.load(std::memory_order_relaxed));
+    if(timing_wheel_)
+        timing_wheel_->AddTimer(client.GetConnectTimerNode(), proxy_config_.connect_timeout_, cb);
+    else
+        timer_->AddTimer(client.GetProxyFd(), proxy_config_.connect_timeout_, cb); // never the same as a client fd
+}
+
+inline void HttpServer::DelConnectTimer(HttpConn &client)
 {
-    int proxy_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if(connect(proxy_fd, (sockaddr*)&proxy_address_, sizeof(proxy_address_)) == -1)
-        return -1;
-    LOG_DEBUG("Connect to proxy: ", proxy_fd);
-    return proxy_fd;
+    if(timing_wheel_)
+        timing_wheel_->DelTimer(client.GetConnectTimerNode());
+    else
+        timer_->DelTimer(client.GetProxyFd());
 }
 
 } // namespace white
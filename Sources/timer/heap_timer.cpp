@@ -21,6 +21,7 @@ HeapTimer::~HeapTimer()
 
 void HeapTimer::AddTimer(int fd, int timeout, const TimeoutCallback& cb)
 {
+    std::lock_guard<std::mutex> locker(mutex_);
     if(fd_heap_map_.count(fd))
     {
         std::size_t exist_node{fd_heap_map_[fd]};
@@ -41,7 +42,11 @@ void HeapTimer::AddTimer(int fd, int timeout, const TimeoutCallback& cb)
 
 void HeapTimer::AdjustTimer(int fd, int timeout)
 {
-    std::size_t exist_node{fd_heap_map_[fd]};
+    std::lock_guard<std::mutex> locker(mutex_);
+    auto it = fd_heap_map_.find(fd);
+    if(it == fd_heap_map_.end()) // already timed out
+        return;
+    std::size_t exist_node{it->second};
     heap_[exist_node].expires = Clock::now() + Ms{timeout};
     if (Check_up_or_down(exist_node))
         PercolateUp(exist_node);
@@ -51,33 +56,51 @@ void HeapTimer::AdjustTimer(int fd, int timeout)
 
 void HeapTimer::DoRightNow(int fd)
 {
-    if(!fd_heap_map_.count(fd))
+    TimeoutCallback cb;
+    {
+        std::lock_guard<std::mutex> locker(mutex_);
+        auto it = fd_heap_map_.find(fd);
+        if(it == fd_heap_map_.end())
+            return;
+        cb = std::move(heap_[it->second].cb);
+        DeleteNode(it->second);
+    }
+    cb();
+}
+
+void HeapTimer::DelTimer(int fd)
+{
+    std::lock_guard<std::mutex> locker(mutex_);
+    auto it = fd_heap_map_.find(fd);
+    if(it == fd_heap_map_.end())
         return;
-    std::size_t index{fd_heap_map_[fd]};
-    heap_[index].cb();
-    DeleteNode(index);
+    DeleteNode(it->second);
 }
 
 void HeapTimer::Tick()
 {
-    if(heap_.empty())
-        return;
-    else
+    while(true)
     {
-        while(!heap_.empty())
+        TimeoutCallback cb;
         {
+            std::lock_guard<std::mutex> locker(mutex_);
+            if(heap_.empty())
+                return;
             TimerNode &node = heap_.front();
             if(std::chrono::duration_cast<Ms>(node.expires - Clock::now()).count() > 0)
-                break;
-            node.cb();
+                return;
+            // removed before running, the callback may add or delete timers
+            cb = std::move(node.cb);
             DeleteNode(0);
         }
+        cb();
     }
 }
 
 long int HeapTimer::NextTickTime()
 {
     Tick();
+    std::lock_guard<std::mutex> locker(mutex_);
     if(heap_.empty())
         return -1;
     long int ret{std::chrono::duration_cast<Ms>(heap_.front().expires - Clock::now()).count()};
@@ -86,9 +109,12 @@ long int HeapTimer::NextTickTime()
 
 void HeapTimer::DeleteNode(std::size_t index)
 {
-    SwapNode(index, heap_.size() - 1);
+    if(index != heap_.size() - 1) // a node swapped with itself would be moved from
+        SwapNode(index, heap_.size() - 1);
     fd_heap_map_.erase(heap_.back().fd);
     heap_.pop_back();
+    if(index == heap_.size()) // the last one removed
+        return;
     if(Check_up_or_down(index))
         PercolateUp(index);
     else
@@ -98,14 +124,13 @@ void HeapTimer::DeleteNode(std::size_t index)
 // Judging from the parent node
 void HeapTimer::PercolateUp(std::size_t index)
 {
-    std::size_t parent_node{(index - 1) / 2};
-    while(parent_node > 0)
+    while(index > 0)
     {
+        std::size_t parent_node{(index - 1) / 2};
         if(heap_[parent_node] < heap_[index])
             break;
-        std::swap(heap_[parent_node], heap_[index]);
+        SwapNode(parent_node, index);
         index = parent_node;
-        parent_node = (index - 1) / 2;
     }
 }
 
@@ -128,8 +153,8 @@ void HeapTimer::PercolateDown(std::size_t index)
 void HeapTimer::SwapNode(std::size_t node_1, std::size_t node_2)
 {
     std::swap(heap_[node_1], heap_[node_2]);
-    fd_heap_map_[heap_[node_1].fd] = node_2;
-    fd_heap_map_[heap_[node_2].fd] = node_1;
+    fd_heap_map_[heap_[node_1].fd] = node_1;
+    fd_heap_map_[heap_[node_2].fd] = node_2;
 }
 
 } // namespace white
\ No newline at end of file
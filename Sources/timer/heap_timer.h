@@ -8,13 +8,15 @@
 
 #include <functional>
 #include <chrono>
+#include <mutex>
 #include <vector>
 #include <unordered_map>
 namespace white {
 
 
 /**
- * @brief A timer base on min heap, to handle timeout connections.
+ * @brief A timer base on min heap, to handle timeout connections. Timers may be adjusted from the worker threads,
+ * the callbacks run without the lock held, so they may add or delete timers.
  * 
  */
 class HeapTimer
@@ -52,6 +54,13 @@ public:
      */
     void DoRightNow(int fd);
 
+    /**
+     * @brief Remove the node which file descriptor is fd without running its callback.
+     * 
+     * @param fd the file descriptor.
+     */
+    void DelTimer(int fd);
+
     void Clear();
 
     /**
@@ -85,6 +94,7 @@ private:
     };
 
 private:
+    std::mutex mutex_;
     std::vector<TimerNode> heap_;
     std::unordered_map<int, std::size_t> fd_heap_map_;
 
@@ -109,6 +119,7 @@ private:
 
 inline void HeapTimer::Clear()
 {
+    std::lock_guard<std::mutex> locker(mutex_);
     heap_.clear();
     fd_heap_map_.clear();
 }
@@ -0,0 +1,196 @@
+#include "timer/timing_wheel.h"
+
+namespace white {
+
+TimingWheel::TimingWheel(int tick_ms) :
+tick_ms_(tick_ms > 0 ? tick_ms : 1),
+start_(Clock::now()),
+now_tick_(0),
+current_tick_(0),
+size_(0),
+near_bitmap_{}
+{
+    for(auto &slot : near_)
+        InitHead(slot);
+    for(auto &level : levels_)
+        for(auto &slot : level)
+            InitHead(slot);
+}
+
+TimingWheel::~TimingWheel()
+{
+    Clear();
+}
+
+void TimingWheel::AddTimer(TimerNode &node, int timeout, const TimeoutCallback &cb)
+{
+    if(node.IsLinked())
+        Unlink(node);
+    else
+        ++size_;
+    node.wheel = this;
+    node.cb = cb;
+    node.expires.store(now_tick_.load(std::memory_order_relaxed) + ToTicks(timeout), std::memory_order_relaxed);
+    Insert(node);
+}
+
+void TimingWheel::DelTimer(TimerNode &node)
+{
+    if(!node.IsLinked())
+        return;
+    Unlink(node);
+    --size_;
+}
+
+void TimingWheel::DoRightNow(TimerNode &node)
+{
+    if(!node.IsLinked())
+        return;
+    Unlink(node);
+    --size_;
+    node.cb();
+}
+
+void TimingWheel::Clear()
+{
+    auto clear_slot = [](TimerLink &slot)
+    {
+        while(slot.next != &slot)
+            Unlink(*slot.next);
+    };
+    for(auto &slot : near_)
+        clear_slot(slot);
+    for(auto &level : levels_)
+        for(auto &slot : level)
+            clear_slot(slot);
+    for(auto &bits : near_bitmap_)
+        bits = 0;
+    size_ = 0;
+}
+
+void TimingWheel::Tick()
+{
+    uint64_t now_tick = now_tick_.load(std::memory_order_relaxed);
+    if(size_ == 0)
+    {
+        if(current_tick_ <= now_tick)
+            current_tick_ = now_tick + 1;
+        return;
+    }
+    while(current_tick_ <= now_tick)
+    {
+        int index = current_tick_ & (kNearSize - 1);
+        // the near wheel wraps around, move the next slot of outer wheels in
+        for(int level = 0; index == 0 && level < kLevels; ++level)
+        {
+            index = (current_tick_ >> (kNearBits + level * kLevelBits)) & (kLevelSize - 1);
+            Cascade(level, index);
+        }
+        index = current_tick_ & (kNearSize - 1);
+        near_bitmap_[index / 64] &= ~(uint64_t{1} << (index % 64));
+        RunSlot(near_[index]);
+        ++current_tick_;
+    }
+}
+
+long int TimingWheel::NextTickTime()
+{
+    Update();
+    Tick();
+    if(size_ == 0)
+        return -1;
+    // find the first nonempty near slot before the near wheel wraps around, the outer wheels cascade at index 0
+    int index = current_tick_ & (kNearSize - 1);
+    int ticks = index == 0 ? 0 : kNearSize - index;
+    for(int i = index / 64; ticks && i < kNearSize / 64; ++i)
+    {
+        uint64_t bits = near_bitmap_[i];
+        if(i == index / 64)
+            bits &= ~uint64_t{0} << (index % 64);
+        if(bits)
+        {
+            ticks = i * 64 + __builtin_ctzll(bits) - index;
+            break;
+        }
+    }
+    // the slot of current_tick_ is due at the end of the current tick
+    auto elapsed = std::chrono::duration_cast<Ms>(Clock::now() - start_).count();
+    long int ret = static_cast<long int>((current_tick_ + ticks) * tick_ms_) - elapsed;
+    return ret > 0 ? ret : 0;
+}
+
+void TimingWheel::Insert(TimerNode &node)
+{
+    uint64_t expires = node.expires.load(std::memory_order_relaxed);
+    if(expires < current_tick_)
+        expires = current_tick_;
+    uint64_t span = expires - current_tick_;
+    if(span > kMaxSpan) // the node comes back in when it is cascaded too early
+    {
+        span = kMaxSpan;
+        expires = current_tick_ + span;
+    }
+    if(span < kNearSize)
+    {
+        int index = expires & (kNearSize - 1);
+        near_bitmap_[index / 64] |= uint64_t{1} << (index % 64);
+        LinkTail(near_[index], node);
+        return;
+    }
+    for(int level = 0; level < kLevels; ++level)
+    {
+        int shift = kNearBits + level * kLevelBits;
+        if(span < (uint64_t{1} << (shift + kLevelBits)))
+        {
+            LinkTail(levels_[level][(expires >> shift) & (kLevelSize - 1)], node);
+            return;
+        }
+    }
+}
+
+void TimingWheel::Detach(TimerLink &slot, TimerLink &pending)
+{
+    if(slot.next == &slot)
+    {
+        InitHead(pending);
+        return;
+    }
+    pending.next = slot.next;
+    pending.prev = slot.prev;
+    pending.next->prev = &pending;
+    pending.prev->next = &pending;
+    InitHead(slot);
+}
+
+void TimingWheel::Cascade(int level, int index)
+{
+    TimerLink pending;
+    Detach(levels_[level][index], pending);
+    while(pending.next != &pending)
+    {
+        TimerNode &node = static_cast<TimerNode&>(*pending.next);
+        Unlink(node);
+        Insert(node);
+    }
+}
+
+void TimingWheel::RunSlot(TimerLink &slot)
+{
+    // detach the whole slot, callbacks may add nodes back into it
+    TimerLink pending;
+    Detach(slot, pending);
+    while(pending.next != &pending)
+    {
+        TimerNode &node = static_cast<TimerNode&>(*pending.next);
+        Unlink(node);
+        if(node.expires.load(std::memory_order_relaxed) > current_tick_) // adjusted after being inserted
+        {
+            Insert(node);
+            continue;
+        }
+        --size_;
+        node.cb();
+    }
+}
+
+} // namespace white
@@ -0,0 +1,177 @@
+#ifndef WHITEWEBSERVER_TIMER_TIMING_WHEEL_H_
+#define WHITEWEBSERVER_TIMER_TIMING_WHEEL_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+namespace white {
+
+/**
+ * @brief A hierarchical timing wheel to handle timeout connections, add, refresh and cancel are all O(1).
+ *
+ * Timer nodes are embedded in their owners, so no lookup is needed. The near wheel has 256 slots of one tick,
+ * the 3 outer wheels have 64 slots each, whose slots are cascaded into the inner wheel when it wraps around.
+ */
+class TimingWheel
+{
+    using TimeoutCallback = std::function<void()>;
+    using Clock = std::chrono::steady_clock;
+    using Ms = std::chrono::milliseconds;
+    using TimeStamp = std::chrono::steady_clock::time_point;
+
+public:
+    struct TimerLink
+    {
+        TimerLink *prev = nullptr;
+        TimerLink *next = nullptr;
+    };
+
+    struct TimerNode : TimerLink
+    {
+        TimerNode() = default;
+        TimerNode(const TimerNode &) = delete;
+        TimerNode &operator=(const TimerNode &) = delete;
+        ~TimerNode();
+
+        bool IsLinked() const { return next != nullptr; }
+
+        TimingWheel *wheel = nullptr;
+        std::atomic<uint64_t> expires{0}; // in ticks, may be pushed forward from any thread
+        TimeoutCallback cb;
+    };
+
+public:
+    TimingWheel(int tick_ms = 10);
+    ~TimingWheel();
+
+    /**
+     * @brief Add node into timer, the node will be moved if it is already in the timer.
+     *
+     * @param node the node embedded in the owner.
+     * @param timeout timeout in milliseconds.
+     * @param cb the callback function when time runs out.
+     */
+    void AddTimer(TimerNode &node, int timeout, const TimeoutCallback &cb);
+
+    /**
+     * @brief Push back the expiration of the node. It only stores the new expiration, the node is moved
+     * when its old slot comes up, so it is safe to call from threads other than the one ticking.
+     *
+     * @param node
+     * @param timeout timeout in milliseconds.
+     */
+    void AdjustTimer(TimerNode &node, int timeout);
+
+    /**
+     * @brief Remove the node without running its callback.
+     *
+     * @param node
+     */
+    void DelTimer(TimerNode &node);
+
+    /**
+     * @brief Excute the callback function of the node, and remove the node.
+     *
+     * @param node
+     */
+    void DoRightNow(TimerNode &node);
+
+    void Clear();
+
+    /**
+     * @brief Refresh the cached current time, the expiration of new and adjusted nodes is based on it.
+     *
+     */
+    void Update();
+
+    /**
+     * @brief Process all the slots up to the cached current time.
+     *
+     */
+    void Tick();
+
+    /**
+     * @brief Get the time duration from now on until next timeout event.
+     *
+     * @return long int
+     */
+    long int NextTickTime();
+
+private:
+    static constexpr int kNearBits = 8;
+    static constexpr int kNearSize = 1 << kNearBits;
+    static constexpr int kLevelBits = 6;
+    static constexpr int kLevelSize = 1 << kLevelBits;
+    static constexpr int kLevels = 3;
+    static constexpr uint64_t kMaxSpan = (uint64_t{1} << (kNearBits + kLevels * kLevelBits)) - 1;
+
+private:
+    void Insert(TimerNode &node);
+    void Cascade(int level, int index);
+    void RunSlot(TimerLink &slot);
+
+    uint64_t ToTicks(int timeout) const;
+
+    static void LinkTail(TimerLink &head, TimerLink &node);
+    static void Unlink(TimerLink &node);
+    static void InitHead(TimerLink &head);
+    static void Detach(TimerLink &slot, TimerLink &pending);
+
+private:
+    const int tick_ms_;
+    TimeStamp start_;
+    std::atomic<uint64_t> now_tick_;
+    uint64_t current_tick_; // the next tick to be processed
+    std::size_t size_;
+
+    TimerLink near_[kNearSize];
+    TimerLink levels_[kLevels][kLevelSize];
+    uint64_t near_bitmap_[kNearSize / 64]; // nonempty slots of near_
+};
+
+inline TimingWheel::TimerNode::~TimerNode()
+{
+    if(IsLinked())
+        wheel->DelTimer(*this);
+}
+
+inline void TimingWheel::LinkTail(TimerLink &head, TimerLink &node)
+{
+    node.prev = head.prev;
+    node.next = &head;
+    head.prev->next = &node;
+    head.prev = &node;
+}
+
+inline void TimingWheel::Unlink(TimerLink &node)
+{
+    node.prev->next = node.next;
+    node.next->prev = node.prev;
+    node.prev = node.next = nullptr;
+}
+
+inline void TimingWheel::InitHead(TimerLink &head)
+{
+    head.prev = head.next = &head;
+}
+
+inline uint64_t TimingWheel::ToTicks(int timeout) const
+{
+    return (static_cast<uint64_t>(timeout) + tick_ms_ - 1) / tick_ms_;
+}
+
+inline void TimingWheel::AdjustTimer(TimerNode &node, int timeout)
+{
+    node.expires.store(now_tick_.load(std::memory_order_relaxed) + ToTicks(timeout), std::memory_order_relaxed);
+}
+
+inline void TimingWheel::Update()
+{
+    now_tick_.store(std::chrono::duration_cast<Ms>(Clock::now() - start_).count() / tick_ms_, std::memory_order_relaxed);
+}
+
+} // namespace white
+
+#endif
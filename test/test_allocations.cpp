@@ -0,0 +1,181 @@
+// Count the heap allocations made by a keep-alive connection answering static files once it is warmed up, which
+// must be none. The connection is driven through a socket pair as the server does, the calls to malloc are counted
+// only while it reads, processes and writes.
+//
+// Built with the sources of the server but its main.cpp:
+//   g++ -std=c++17 -I../Sources test_allocations.cpp $(find ../Sources -name '*.cpp' ! -name main.cpp) -ljsoncpp -lpthread
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "protocol/http/http_conn.h"
+#include "router/virtual_hosts.h"
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+
+static thread_local bool is_counting = false; // by the thread serving, not the one of the logger
+static std::size_t allocations = 0;
+
+extern "C" void *malloc(size_t size)
+{
+    if(is_counting)
+        ++allocations;
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    if(is_counting)
+        ++allocations;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    if(is_counting)
+        ++allocations;
+    return __libc_realloc(ptr, size);
+}
+
+struct Scenario
+{
+    const char *name;
+    bool is_sendfile;
+    bool is_open_file_cache;
+    bool is_hot_object_cache;
+    std::string request;
+};
+
+constexpr int kWarmupRequests = 64;
+constexpr int kCountedRequests = 1000;
+
+void WriteFile(const std::string &path, std::size_t size)
+{
+    std::ofstream file(path);
+    file << std::string(size, 'x');
+}
+
+std::shared_ptr<const white::VirtualHosts> MakeHosts(const std::string &root)
+{
+    white::Location location{};
+    location.handler = white::Location::HANDLER::STATIC;
+    location.root = root;
+    location.name = "default";
+
+    auto site = std::make_unique<white::Site>();
+    site->names = {"localhost"};
+    site->root = root;
+    site->index_file = std::make_shared<std::vector<std::string>>(1, "index.html");
+    site->router = std::make_unique<white::LocationRouter>(std::move(location));
+    auto hosts = std::make_shared<white::VirtualHosts>();
+    hosts->Add(std::move(site), true);
+    return hosts;
+}
+
+// one request as the server answers it, the response is drained from the peer
+bool Serve(white::HttpConn &conn, int peer, const std::string &request, bool is_counted)
+{
+    if(write(peer, request.data(), request.size()) != static_cast<ssize_t>(request.size()))
+        return false;
+    int err = 0;
+    is_counting = is_counted;
+    conn.Read(&err);
+    bool is_processed = conn.Process() == white::HttpConn::PROCESS_STATE::FINISH;
+    while(is_processed && conn.PendingWriteBytes() > 0 && conn.Write(&err) > 0)
+        ;
+    bool is_written = conn.PendingWriteBytes() == 0;
+    conn.Trim();
+    is_counting = false;
+
+    char buffer[65536];
+    while(read(peer, buffer, sizeof(buffer)) > 0)
+        ;
+    return is_processed && is_written;
+}
+
+bool Run(const Scenario &scenario, const std::shared_ptr<const white::VirtualHosts> &hosts)
+{
+    white::HttpConn::is_sendfile = scenario.is_sendfile;
+    white::HttpConn::open_file_cache = scenario.is_open_file_cache ?
+        std::make_shared<white::OpenFileCache>(64, 60000, &white::HttpResponse::GetMimeType) : nullptr;
+    white::HttpConn::hot_object_cache = scenario.is_hot_object_cache ?
+        std::make_shared<white::HotObjectCache>(1 << 20, 64 << 10, 60000) : nullptr;
+
+    int fds[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+    {
+        std::cerr << "Error: socketpair() : " << strerror(errno) << std::endl;
+        exit(1);
+    }
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+
+    bool is_ok = true;
+    {
+        white::HttpConn conn;
+        conn.Init(fds[0], sockaddr_in{}, -1, hosts);
+        for(int i = 0; i < kWarmupRequests && is_ok; ++i)
+            is_ok = Serve(conn, fds[1], scenario.request, false);
+        allocations = 0;
+        for(int i = 0; i < kCountedRequests && is_ok; ++i)
+            is_ok = Serve(conn, fds[1], scenario.request, true);
+    } // closes fds[0]
+    close(fds[1]);
+
+    if(!is_ok)
+    {
+        std::cout << scenario.name << ": the request failed" << std::endl;
+        return false;
+    }
+    std::cout << scenario.name << ": " << allocations << " allocations in " << kCountedRequests << " requests" << std::endl;
+    return allocations == 0;
+}
+
+int main()
+{
+    char root_template[] = "/tmp/white_allocations_XXXXXX";
+    char *root = mkdtemp(root_template);
+    if(!root)
+    {
+        std::cerr << "Error: mkdtemp() : " << strerror(errno) << std::endl;
+        exit(1);
+    }
+    WriteFile(std::string(root) + "/index.html", 512);
+    WriteFile(std::string(root) + "/style.css", 8192);
+    white::LOG_INIT(std::string(root) + "/test.log", 1);
+    white::HttpConn::web_root = root;
+    auto hosts = MakeHosts(root);
+
+    const std::string kGet = "GET /style.css HTTP/1.1\r\nHost: localhost\r\nUser-Agent: test\r\nAccept: */*\r\n\r\n";
+    const std::string kGet10 = "GET /index.html HTTP/1.0\r\nHost: localhost\r\nConnection: keep-alive\r\n\r\n";
+    const std::string kMissing = "GET /missing.html HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    const Scenario kScenarios[] = {
+        {"sendfile", true, false, false, kGet},
+        {"mmap", false, false, false, kGet},
+        {"sendfile open_file_cache", true, true, false, kGet},
+        {"mmap open_file_cache", false, true, false, kGet},
+        {"http/1.0 keep-alive", true, true, false, kGet10},
+        {"hot_object_cache", true, true, true, kGet},
+        {"not found", true, false, false, kMissing},
+        {"not found open_file_cache", true, true, false, kMissing},
+    };
+
+    int failures = 0;
+    for(auto &scenario : kScenarios)
+        failures += !Run(scenario, hosts);
+
+    unlink((std::string(root) + "/index.html").c_str());
+    unlink((std::string(root) + "/style.css").c_str());
+    unlink((std::string(root) + "/test.log").c_str());
+    rmdir(root);
+    std::cout << (failures ? "FAILED" : "PASSED") << std::endl;
+    return failures ? 1 : 0;
+}
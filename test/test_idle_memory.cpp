@@ -0,0 +1,124 @@
+#include <iostream>
+#include <fstream>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <arpa/inet.h>
+#include <libgen.h>
+#include <cstring>
+#include <errno.h>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <unistd.h>
+#include <vector>
+#include <signal.h>
+
+// Measure how much memory the server holds for each idle keep-alive connection: the resident memory of its process
+// is read before any connection, after the connections are accepted, and after each of them is answered once and
+// left idle.
+
+long ReadRss(int pid)
+{
+    std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+    std::string line;
+    while(getline(status, line))
+    {
+        if(line.compare(0, 6, "VmRSS:") == 0)
+            return atol(line.c_str() + 6) * 1024;
+    }
+    std::cerr << "Error: no VmRSS of process " << pid << std::endl;
+    exit(1);
+}
+
+void Settle()
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+}
+
+// read the whole response, its body framed by Content-Length
+bool ReadResponse(int fd)
+{
+    std::string response;
+    char buffer[8192];
+    std::size_t head_end = std::string::npos;
+    std::size_t total = 0;
+    while(head_end == std::string::npos || response.size() < total)
+    {
+        ssize_t len = recv(fd, buffer, sizeof(buffer), 0);
+        if(len <= 0)
+            return false;
+        response.append(buffer, len);
+        if(head_end != std::string::npos)
+            continue;
+        head_end = response.find("\r\n\r\n");
+        if(head_end == std::string::npos)
+            continue;
+        total = head_end + 4;
+        auto length = response.find("Content-Length: ");
+        if(length != std::string::npos && length < head_end)
+            total += atol(response.c_str() + length + 16);
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc != 5 && argc != 6)
+    {
+        std::cerr << "Usage: " << basename(argv[0]) << " <IP> <PORT> <SERVER_PID> <CONNECTIONS> [PATH]" << std::endl;
+        exit(1);
+    }
+    int pid = atoi(argv[3]);
+    int count = atoi(argv[4]);
+    std::string path = argc == 6 ? argv[5] : "/index.html";
+
+    rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    signal(SIGPIPE, SIG_IGN);
+
+    sockaddr_in server_addr;
+    bzero(&server_addr, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(atoi(argv[2]));
+    inet_pton(AF_INET, argv[1], &server_addr.sin_addr);
+
+    long rss_begin = ReadRss(pid);
+    std::vector<int> fds;
+    fds.reserve(count);
+    for(int i = 0; i < count; ++i)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if(fd < 0 || connect(fd, (sockaddr *)&server_addr, sizeof(server_addr)) < 0)
+        {
+            std::cerr << "Error: connect() : " << strerror(errno) << " after " << i << " connections" << std::endl;
+            exit(1);
+        }
+        fds.push_back(fd);
+    }
+    Settle();
+    long rss_accepted = ReadRss(pid);
+
+    std::string request = "GET " + path + " HTTP/1.1\r\nHost: " + argv[1] + "\r\nConnection: keep-alive\r\n\r\n";
+    for(int fd : fds)
+    {
+        if(send(fd, request.data(), request.size(), 0) != static_cast<ssize_t>(request.size()) || !ReadResponse(fd))
+        {
+            std::cerr << "Error: the request on connection " << fd << " failed" << std::endl;
+            exit(1);
+        }
+    }
+    Settle();
+    long rss_idle = ReadRss(pid);
+
+    std::cout << "connections: " << count << std::endl;
+    std::cout << "rss before: " << rss_begin / 1024 << " KB, accepted: " << rss_accepted / 1024
+              << " KB, idle after a request: " << rss_idle / 1024 << " KB" << std::endl;
+    std::cout << "bytes per accepted connection: " << (rss_accepted - rss_begin) / count << std::endl;
+    std::cout << "bytes per idle keep-alive connection: " << (rss_idle - rss_begin) / count << std::endl;
+
+    for(int fd : fds)
+        close(fd);
+    return 0;
+}
@@ -0,0 +1,208 @@
+// Relay upstream responses through a proxying HttpConn with the response split at every byte boundary, once in
+// two reads and once a byte per read, so the head, the chunk sizes, their extensions, the CRLFs and the trailers
+// are each cut somewhere. The client must receive exactly the bytes of the response, and the response must be done
+// once its last byte is read and not before.
+//
+// Built with the sources of the server but its main.cpp:
+//   g++ -std=c++17 -I../Sources test_upstream_framing.cpp $(find ../Sources -name '*.cpp' ! -name main.cpp) -ljsoncpp -lpthread
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#include "protocol/http/http_conn.h"
+#include "router/virtual_hosts.h"
+
+struct Case
+{
+    const char *name;
+    const char *method;
+    std::string response; // followed by bytes which are not part of it, unless framed by the close
+    std::size_t framed; // bytes of the response to relay
+    bool is_close_framed;
+};
+
+const std::string kNext = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+
+std::shared_ptr<const white::VirtualHosts> MakeHosts(const std::string &root)
+{
+    white::Location location{};
+    location.handler = white::Location::HANDLER::PROXY;
+    location.name = "default";
+
+    auto site = std::make_unique<white::Site>();
+    site->names = {"localhost"};
+    site->root = root;
+    site->index_file = std::make_shared<std::vector<std::string>>(1, "index.html");
+    site->router = std::make_unique<white::LocationRouter>(std::move(location));
+    auto hosts = std::make_shared<white::VirtualHosts>();
+    hosts->Add(std::move(site), true);
+    return hosts;
+}
+
+void MakePair(int fds[2])
+{
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+    {
+        std::cerr << "Error: socketpair() : " << strerror(errno) << std::endl;
+        exit(1);
+    }
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+}
+
+void Drain(int fd, std::string *received)
+{
+    char buffer[65536];
+    ssize_t len;
+    while((len = read(fd, buffer, sizeof(buffer))) > 0)
+        received->append(buffer, len);
+}
+
+// relay the response given in pieces as the server does, false with the reason if it is framed wrong
+bool Relay(const Case &test, const std::vector<std::size_t> &cuts, const std::shared_ptr<const white::VirtualHosts> &hosts, std::string *reason)
+{
+    int client[2], upstream[2];
+    MakePair(client);
+    MakePair(upstream);
+    white::HttpConn conn;
+    conn.Init(client[0], sockaddr_in{}, upstream[0], hosts);
+
+    std::string request = std::string(test.method) + " / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    std::string received;
+    int err = 0;
+    bool is_ok = write(client[1], request.data(), request.size()) == static_cast<ssize_t>(request.size());
+    conn.Read(&err);
+    is_ok = is_ok && conn.ProcessProxy() == white::HttpConn::PROXY_PROCESS_STATE::PENDING_WRITE_TO_PROXY_SERVER;
+    while(is_ok && conn.PendingWriteBytes() > 0 && conn.SendRequestToProxy(&err) > 0)
+        ;
+    Drain(upstream[1], &received);
+    received.clear();
+    if(!is_ok)
+        *reason = "the request was not forwarded";
+
+    std::size_t fed = 0;
+    for(std::size_t i = 0; is_ok && i <= cuts.size(); ++i)
+    {
+        std::size_t end = i < cuts.size() ? cuts[i] : test.response.size();
+        if(write(upstream[1], test.response.data() + fed, end - fed) != static_cast<ssize_t>(end - fed))
+        {
+            *reason = "the upstream could not write";
+            is_ok = false;
+            break;
+        }
+        fed = end;
+        bool is_last = i == cuts.size();
+        if(is_last && test.is_close_framed)
+            shutdown(upstream[1], SHUT_WR);
+        conn.ReadResponseFromProxy(&err);
+        if(conn.ProcessProxy() == white::HttpConn::PROXY_PROCESS_STATE::FAIL)
+        {
+            *reason = "the relay failed after " + std::to_string(fed) + " bytes";
+            is_ok = false;
+            break;
+        }
+        while(conn.PendingWriteBytes() > 0 && conn.Write(&err) > 0)
+            ;
+        Drain(client[1], &received);
+        bool is_complete = test.is_close_framed ? is_last : fed >= test.framed;
+        if(conn.IsUpstreamDone() != is_complete)
+        {
+            *reason = std::string(is_complete ? "not done" : "done") + " after " + std::to_string(fed) + " bytes";
+            is_ok = false;
+        }
+        if(conn.IsUpstreamDone())
+            break; // nothing more is read from the upstream
+    }
+    if(is_ok && received != test.response.substr(0, test.framed))
+    {
+        *reason = std::to_string(received.size()) + " bytes relayed instead of " + std::to_string(test.framed);
+        is_ok = false;
+    }
+
+    conn.Close(); // closes client[0]
+    close(client[1]);
+    close(upstream[0]);
+    close(upstream[1]);
+    return is_ok;
+}
+
+bool Run(const Case &test, const std::shared_ptr<const white::VirtualHosts> &hosts)
+{
+    std::string reason;
+    // in two reads, at every byte boundary
+    for(std::size_t cut = 0; cut <= test.response.size(); ++cut)
+    {
+        if(!Relay(test, {cut}, hosts, &reason))
+        {
+            std::cout << test.name << ": split at " << cut << ": " << reason << std::endl;
+            return false;
+        }
+    }
+    // a byte per read
+    std::vector<std::size_t> cuts;
+    for(std::size_t cut = 1; cut < test.response.size(); ++cut)
+        cuts.push_back(cut);
+    if(!Relay(test, cuts, hosts, &reason))
+    {
+        std::cout << test.name << ": a byte per read: " << reason << std::endl;
+        return false;
+    }
+    std::cout << test.name << ": ok" << std::endl;
+    return true;
+}
+
+Case Framed(const char *name, const char *method, const std::string &response)
+{
+    return {name, method, response + kNext, response.size(), false};
+}
+
+int main()
+{
+    char root_template[] = "/tmp/white_framing_XXXXXX";
+    char *root = mkdtemp(root_template);
+    if(!root)
+    {
+        std::cerr << "Error: mkdtemp() : " << strerror(errno) << std::endl;
+        exit(1);
+    }
+    white::LOG_INIT(std::string(root) + "/test.log", 1);
+    white::HttpConn::web_root = root;
+    auto hosts = MakeHosts(root);
+
+    const std::string kCloseFramed = "HTTP/1.1 200 OK\r\nConnection: close\r\n\r\nuntil the upstream closes";
+    const Case kCases[] = {
+        Framed("content-length", "GET", "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello"),
+        Framed("content-length zero", "GET", "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n"),
+        Framed("chunked", "GET", "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                                 "5\r\nhello\r\n1a\r\nabcdefghijklmnopqrstuvwxyz\r\n0\r\n\r\n"),
+        Framed("chunked extensions and trailers", "GET", "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                                 "5;name=value\r\nhello\r\n1A;a;b=\"c\"\r\nabcdefghijklmnopqrstuvwxyz\r\n"
+                                 "0;last\r\nX-Trailer: 1\r\nX-Other: two\r\n\r\n"),
+        Framed("chunked data with blank lines", "GET", "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                                 "10\r\n0123\r\n\r\n89abcdef\r\n0\r\n\r\n"),
+        Framed("head", "HEAD", "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\n"),
+        Framed("204", "GET", "HTTP/1.1 204 No Content\r\n\r\n"),
+        Framed("304", "GET", "HTTP/1.1 304 Not Modified\r\nContent-Length: 5\r\n\r\n"),
+        Framed("1xx then final", "GET", "HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 103 Early Hints\r\nLink: </a.css>\r\n\r\n"
+                                        "HTTP/1.1 200 OK\r\nContent-Length: 3\r\n\r\nabc"),
+        Framed("1xx then chunked", "GET", "HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                                          "3\r\nabc\r\n0\r\n\r\n"),
+        {"close-framed", "GET", kCloseFramed, kCloseFramed.size(), true},
+        {"http/1.0 close-framed", "GET", "HTTP/1.0 200 OK\r\n\r\nno length", 28, true},
+    };
+
+    int failures = 0;
+    for(auto &test : kCases)
+        failures += !Run(test, hosts);
+
+    unlink((std::string(root) + "/test.log").c_str());
+    rmdir(root);
+    std::cout << (failures ? "FAILED" : "PASSED") << std::endl;
+    return failures ? 1 : 0;
+}